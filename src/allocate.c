@@ -0,0 +1,487 @@
+/*
+ * allocate.c: fits the registers a program uses onto the ones the target has
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocate.h"
+#include "optimize.h"
+#include "controlflow.h"
+#include "liveness.h"
+#include "opcodes.h"
+#include "codeobjects.h"
+#include "atoms.h"
+#include "lib/arena.h"
+#include "lib/stringutils.h"
+
+// what out of memory errors say this file was doing
+#define OUT_OF_MEMORY_TASK "allocating registers"
+
+// most registers kept back for loading and storing spilled registers, LSTR can read three at once
+#define MAX_SCRATCH_REGISTERS 3
+// a use inside a loop counts this many times as much as one outside it, per level of nesting
+#define LOOP_WEIGHT 8
+#define MAX_LOOP_DEPTH 6
+
+#define NOT_ASSIGNED 0
+
+// the stretch of instructions (by position in the program) a register holds a value that's still needed over
+struct Interval {
+  size_t start;
+  size_t end;
+  size_t weight;     // how much spilling it would cost, uses in loops count for more
+  size_t assigned;   // register it ends up in, NOT_ASSIGNED if it's spilled
+  size_t slot;       // memory address it's spilled to
+};
+
+struct Allocator {
+  struct Program* program;
+  struct ControlFlow flow;
+  struct Liveness liveness;
+  struct Interval* intervals; // by register number
+  size_t registerCount;       // registers the program uses, plus one
+};
+
+static void touch(struct Interval* interval, size_t position, size_t weight) {
+  if (position < interval->start) {
+    interval->start = position;
+  }
+  if (position > interval->end || interval->end == (size_t) -1) {
+    interval->end = position;
+  }
+  interval->weight += weight;
+}
+
+static void buildIntervals(struct Allocator* allocator) {
+  // one interval per register, covering everywhere it's live, used or written
+  // (an interval doesn't have holes, so two registers only share a home if their intervals don't overlap at all)
+  struct Program* program = allocator->program;
+  struct ControlFlow* flow = &allocator->flow;
+  size_t blockCount = flow->blockCount;
+
+  // how deeply nested in loops each block is, a branch back to an earlier block closes a loop over everything between
+  long* depthChange = checkedCalloc(blockCount + 1, sizeof(long), OUT_OF_MEMORY_TASK);
+  size_t blockIndex = 0;
+  while (blockIndex < blockCount) {
+    struct Block* block = &flow->blocks[blockIndex];
+    size_t edge = block->firstSuccessor;
+    while (edge < block->firstSuccessor + block->successorCount) {
+      size_t successor = flow->successors[edge];
+      if (successor <= blockIndex) {
+        depthChange[successor]++;
+        depthChange[blockIndex + 1]--;
+      }
+      edge++;
+    }
+    blockIndex++;
+  }
+
+  size_t registerIndex = 0;
+  while (registerIndex < allocator->registerCount) {
+    allocator->intervals[registerIndex].start = (size_t) -1;
+    allocator->intervals[registerIndex].end = (size_t) -1;
+    registerIndex++;
+  }
+
+  size_t position = 0;
+  long depth = 0;
+  blockIndex = 0;
+  while (blockIndex < blockCount) {
+    struct Block* block = &flow->blocks[blockIndex];
+    depth += depthChange[blockIndex];
+    size_t weight = 1;
+    long level = 0;
+    while (level < depth && level < MAX_LOOP_DEPTH) {
+      weight *= LOOP_WEIGHT;
+      level++;
+    }
+    size_t blockStart = position;
+    size_t index = block->first;
+    while (1) {
+      struct Instruction* instruction = &program->instructions[index];
+      size_t registers[3];
+      __uint8_t count = readRegisters(instruction, registers);
+      while (count > 0) {
+        count--;
+        touch(&allocator->intervals[registers[count]], position, weight);
+      }
+      size_t written = writtenRegister(instruction);
+      if (written != NO_REGISTER) {
+        touch(&allocator->intervals[written], position, weight);
+      }
+      position++;
+      if (index == block->last) {
+        break;
+      }
+      index = instruction->next;
+    }
+    size_t blockEnd = position - 1;
+    size_t words = allocator->liveness.words;
+    registerIndex = 1;
+    while (registerIndex < allocator->registerCount) {
+      size_t word = registerIndex / 64;
+      __uint64_t bit = (__uint64_t) 1 << (registerIndex % 64);
+      if (allocator->liveness.liveIn[blockIndex * words + word] & bit) {
+        touch(&allocator->intervals[registerIndex], blockStart, 0);
+      }
+      if (allocator->liveness.liveOut[blockIndex * words + word] & bit) {
+        touch(&allocator->intervals[registerIndex], blockEnd, 0);
+      }
+      registerIndex++;
+    }
+    blockIndex++;
+  }
+  free(depthChange);
+}
+
+static struct Interval* sortIntervals;
+
+static int compareStarts(const void* a, const void* b) {
+  const struct Interval* first = &sortIntervals[*(const size_t*) a];
+  const struct Interval* second = &sortIntervals[*(const size_t*) b];
+  if (first->start != second->start) {
+    return first->start < second->start ? -1 : 1;
+  }
+  return *(const size_t*) a < *(const size_t*) b ? -1 : 1;
+}
+
+static size_t linearScan(struct Allocator* allocator, size_t available) {
+  // hand out registers 1 to available in order of where intervals start, freeing them as intervals end
+  // when none are free, whichever of the live intervals is cheapest to spill goes to memory
+  // returns how many registers got spilled
+  struct Interval* intervals = allocator->intervals;
+  size_t* order = checkedCalloc(allocator->registerCount, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  size_t* active = checkedCalloc(available, sizeof(size_t), OUT_OF_MEMORY_TASK);  // intervals holding a register, by register - 1
+  size_t intervalCount = 0;
+  size_t registerIndex = 1;
+  while (registerIndex < allocator->registerCount) {
+    intervals[registerIndex].assigned = NOT_ASSIGNED;
+    if (intervals[registerIndex].end != (size_t) -1) {
+      order[intervalCount] = registerIndex;
+      intervalCount++;
+    }
+    registerIndex++;
+  }
+  sortIntervals = intervals;
+  qsort(order, intervalCount, sizeof(size_t), compareStarts);
+
+  size_t spilled = 0;
+  size_t orderIndex = 0;
+  while (orderIndex < intervalCount) {
+    size_t current = order[orderIndex];
+    orderIndex++;
+    // expire intervals that ended before this one starts, and find the cheapest one still going
+    size_t open = 0;
+    size_t cheapest = current;
+    size_t slot = 0;
+    while (slot < available) {
+      if (active[slot] != 0 && intervals[active[slot]].end < intervals[current].start) {
+        active[slot] = 0;
+      }
+      if (active[slot] == 0) {
+        if (open == 0) {
+          open = slot + 1;
+        }
+      }
+      else if (intervals[active[slot]].weight < intervals[cheapest].weight) {
+        cheapest = active[slot];
+      }
+      slot++;
+    }
+    if (open != 0) {
+      intervals[current].assigned = open;
+      active[open - 1] = current;
+      continue;
+    }
+    spilled++;
+    if (cheapest == current) {
+      continue;
+    }
+    // the cheaper interval gives up its register, from its start, so it's spilled everywhere
+    size_t taken = intervals[cheapest].assigned;
+    intervals[cheapest].assigned = NOT_ASSIGNED;
+    intervals[current].assigned = taken;
+    active[taken - 1] = current;
+  }
+  free(order);
+  free(active);
+  return spilled;
+}
+
+static struct Operand registerOperand(size_t number) {
+  struct Operand operand = {TOKEN_REGISTER, ATOM_NONE, (__int128_t) number, NEW_TOKEN};
+  return operand;
+}
+
+static void setInstruction(struct Program* program, size_t index, Atom opcode, struct Operand a, struct Operand b) {
+  struct Instruction* instruction = &program->instructions[index];
+  instruction->opcode = opcode;
+  instruction->operandCount = 2;
+  instruction->operands[0] = a;
+  instruction->operands[1] = b;
+  instruction->changed = 1;
+}
+
+static void rewriteInstruction(struct Allocator* allocator, size_t index, size_t firstScratch) {
+  // point every register operand at its new home, loading spilled ones into scratch registers first
+  // and storing a spilled result afterwards
+  struct Program* program = allocator->program;
+  struct Interval* intervals = allocator->intervals;
+  struct Instruction copy = program->instructions[index];
+  const struct OpcodeInfo* info = opcodeInfo(copy.opcode);
+  if (info == NULL) {
+    return;
+  }
+  __uint8_t writes = (info->flags & OP_WRITES_FIRST) && copy.operands[0].type == TOKEN_REGISTER && copy.operands[0].value > 0;
+  size_t loaded[MAX_SCRATCH_REGISTERS] = {0, 0, 0};   // spilled register held in each scratch register
+  size_t loadedCount = 0;
+  __uint8_t changed = 0;
+  __uint8_t operandIndex = writes ? 1 : 0;
+  while (operandIndex < copy.operandCount) {
+    struct Operand* operand = &copy.operands[operandIndex];
+    if (operand->type == TOKEN_REGISTER && operand->value > 0) {
+      struct Interval* interval = &intervals[operand->value];
+      if (interval->assigned != NOT_ASSIGNED) {
+        if ((size_t) operand->value != interval->assigned) {
+          *operand = registerOperand(interval->assigned);
+          changed = 1;
+        }
+      }
+      else {
+        size_t scratch = 0;
+        while (scratch < loadedCount && loaded[scratch] != (size_t) operand->value) {
+          scratch++;
+        }
+        if (scratch == loadedCount) {
+          loaded[loadedCount] = (size_t) operand->value;
+          loadedCount++;
+          struct Operand memory = {TOKEN_MEMORY, ATOM_NONE, (__int128_t) interval->slot, NEW_TOKEN};
+          size_t load = insertInstructionBefore(program, index);
+          setInstruction(program, load, ATOM_LOD, registerOperand(firstScratch + scratch), memory);
+        }
+        *operand = registerOperand(firstScratch + scratch);
+        changed = 1;
+      }
+    }
+    operandIndex++;
+  }
+  if (writes) {
+    struct Interval* interval = &intervals[copy.operands[0].value];
+    if (interval->assigned != NOT_ASSIGNED) {
+      if ((size_t) copy.operands[0].value != interval->assigned) {
+        copy.operands[0] = registerOperand(interval->assigned);
+        changed = 1;
+      }
+    }
+    else {
+      // results can go in the first scratch register, the sources have all been read by then
+      struct Operand memory = {TOKEN_MEMORY, ATOM_NONE, (__int128_t) interval->slot, NEW_TOKEN};
+      copy.operands[0] = registerOperand(firstScratch);
+      size_t store = insertInstruction(program, index);
+      setInstruction(program, store, ATOM_STR, memory, registerOperand(firstScratch));
+      changed = 1;
+    }
+  }
+  if (changed) {
+    // the instruction's links may have changed from the inserts, so only its contents are copied back
+    struct Instruction* instruction = &program->instructions[index];
+    memcpy(instruction->operands, copy.operands, sizeof(copy.operands));
+    instruction->changed = 1;
+  }
+}
+
+static size_t scratchNeeded(struct Allocator* allocator) {
+  // how many scratch registers rewriteInstruction() will use, which is the most different spilled
+  // registers any one instruction reads (a spilled result reuses the first one, so that's never more)
+  struct Program* program = allocator->program;
+  size_t needed = 0;
+  size_t index = program->first;
+  while (index != NO_INSTRUCTION) {
+    struct Instruction* instruction = &program->instructions[index];
+    index = instruction->next;
+    const struct OpcodeInfo* info = opcodeInfo(instruction->opcode);
+    if (info == NULL) {
+      continue;
+    }
+    __uint8_t writes = (info->flags & OP_WRITES_FIRST) && instruction->operands[0].type == TOKEN_REGISTER && instruction->operands[0].value > 0;
+    size_t loaded[MAX_SCRATCH_REGISTERS] = {0, 0, 0};
+    size_t loadedCount = 0;
+    __uint8_t operandIndex = writes ? 1 : 0;
+    while (operandIndex < instruction->operandCount) {
+      struct Operand* operand = &instruction->operands[operandIndex];
+      operandIndex++;
+      if (operand->type != TOKEN_REGISTER || operand->value <= 0 || allocator->intervals[operand->value].assigned != NOT_ASSIGNED) {
+        continue;
+      }
+      size_t scratch = 0;
+      while (scratch < loadedCount && loaded[scratch] != (size_t) operand->value) {
+        scratch++;
+      }
+      if (scratch == loadedCount) {
+        loaded[loadedCount] = (size_t) operand->value;
+        loadedCount++;
+      }
+    }
+    if (loadedCount > needed) {
+      needed = loadedCount;
+    }
+  }
+  return needed;
+}
+
+static size_t addressOperands(Atom opcode, __uint8_t* first) {
+  // which operands of a memory instruction make up the address it reads or writes, returns how many
+  switch (opcode) {
+    case ATOM_LOD: *first = 1; return 1;
+    case ATOM_STR: *first = 0; return 1;
+    case ATOM_LLOD: *first = 1; return 2;
+    case ATOM_LSTR: *first = 0; return 2;
+    case ATOM_CPY: *first = 0; return 2;
+    default: return 0;
+  }
+}
+
+static size_t firstFreeAddress(struct Program* program) {
+  // spilled registers go right after the heap the program asked for, or after the highest address it uses,
+  // and never over the strings in the data section
+  struct Code* code = program->code;
+  size_t address = code->data.base + code->data.length;
+  size_t minHeap = headerLine(code, ATOM_MINHEAP);
+  if (minHeap != code->lineCount) {
+    size_t heap = (size_t) tokenValue(code, code->lines[minHeap].firstToken + 1);
+    return heap > address ? heap : address;
+  }
+  size_t index = program->first;
+  while (index != NO_INSTRUCTION) {
+    struct Instruction* instruction = &program->instructions[index];
+    __uint8_t first = 0;
+    size_t count = addressOperands(instruction->opcode, &first);
+    // LLOD and LSTR add their two address operands, CPY has two separate addresses
+    __uint8_t sum = instruction->opcode == ATOM_LLOD || instruction->opcode == ATOM_LSTR;
+    size_t total = 0;
+    __uint8_t operandIndex = first;
+    while (operandIndex < first + count) {
+      struct Operand* operand = &instruction->operands[operandIndex];
+      if (operand->type == TOKEN_IMMEDIATE || operand->type == TOKEN_MEMORY) {
+        size_t value = (size_t) operand->value;
+        total = sum ? total + value : value;
+        if (total + 1 > address) {
+          address = total + 1;
+        }
+      }
+      operandIndex++;
+    }
+    // M<n> operands are addresses wherever they are
+    operandIndex = 0;
+    while (operandIndex < instruction->operandCount) {
+      struct Operand* operand = &instruction->operands[operandIndex];
+      if (operand->type == TOKEN_MEMORY && (size_t) operand->value + 1 > address) {
+        address = (size_t) operand->value + 1;
+      }
+      operandIndex++;
+    }
+    index = instruction->next;
+  }
+  return address;
+}
+
+void allocateRegisters(struct Code* code, __uint32_t registerCount, __uint32_t bits, __uint8_t compact) {
+  // renumber the program's registers so it only uses R1 to R<registerCount>, spilling to memory if it has to
+  // if compact is zero, programs that already fit are left alone
+  struct Program program = buildProgram(code, bits);
+  size_t highest = highestRegister(&program);
+  if (highest == 0 || (highest <= registerCount && !compact)) {
+    freeProgram(&program);
+    return;
+  }
+
+  struct Allocator allocator;
+  allocator.program = &program;
+  allocator.flow = buildControlFlow(&program);
+  allocator.liveness = computeLiveness(&program, &allocator.flow);
+  allocator.registerCount = highest + 1;
+  allocator.intervals = checkedCalloc(allocator.registerCount, sizeof(struct Interval), OUT_OF_MEMORY_TASK);
+  buildIntervals(&allocator);
+
+  size_t spilled = linearScan(&allocator, registerCount);
+  size_t firstScratch = 0;
+  if (spilled > 0) {
+    // run again with scratch registers kept back, keeping more back can spill more registers,
+    // so start from one and add more while some instruction reads more spilled registers than that
+    size_t scratchCount = 1;
+    while (scratchCount < registerCount && !program.hasRelative) {
+      spilled = linearScan(&allocator, registerCount - scratchCount);
+      size_t needed = scratchNeeded(&allocator);
+      if (needed <= scratchCount) {
+        break;
+      }
+      scratchCount = needed;
+    }
+    if (scratchCount >= registerCount || program.hasRelative) {
+      fprintf(stderr, "Warning: program needs more registers than the target's %u, and can't be spilled to memory (%s), so registers are left as they are.\n", registerCount, program.hasRelative ? "it uses ~ relative addresses" : "too few registers to spill through");
+      free(allocator.intervals);
+      freeLiveness(&allocator.liveness);
+      freeControlFlow(&allocator.flow);
+      freeProgram(&program);
+      return;
+    }
+    firstScratch = registerCount - scratchCount + 1;
+  }
+
+  size_t address = firstFreeAddress(&program);
+  size_t used = spilled > 0 ? registerCount : 0;
+  size_t registerIndex = 1;
+  while (registerIndex < allocator.registerCount) {
+    struct Interval* interval = &allocator.intervals[registerIndex];
+    if (interval->end != (size_t) -1 && interval->assigned == NOT_ASSIGNED) {
+      interval->slot = address;
+      address++;
+    }
+    if (interval->assigned > used) {
+      used = interval->assigned;
+    }
+    registerIndex++;
+  }
+
+  // instructions inserted along the way are never revisited, they only use scratch registers
+  size_t count = program.count;
+  size_t index = 0;
+  while (index < count) {
+    if (!program.instructions[index].deleted) {
+      rewriteInstruction(&allocator, index, firstScratch);
+    }
+    index++;
+  }
+  writeProgram(&program);
+
+  // keep the headers honest about what the program now needs
+  size_t minReg = headerLine(code, ATOM_MINREG);
+  if (minReg != code->lineCount) {
+    setHeader(code, minReg, used);
+  }
+  size_t minHeap = headerLine(code, ATOM_MINHEAP);
+  if (minHeap != code->lineCount && spilled > 0) {
+    setHeader(code, minHeap, address);
+  }
+
+  free(allocator.intervals);
+  freeLiveness(&allocator.liveness);
+  freeControlFlow(&allocator.flow);
+  freeProgram(&program);
+}
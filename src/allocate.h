@@ -0,0 +1,27 @@
+/*
+ * allocate.h: fits the registers a program uses onto the ones the target has
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ALLOCATE_H
+#define ALLOCATE_H
+
+#include <bits/types.h>
+
+#include "codeobjects.h"
+
+void allocateRegisters(struct Code* code, __uint32_t registerCount, __uint32_t bits, __uint8_t compact);
+
+#endif
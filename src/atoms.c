@@ -0,0 +1,56 @@
+/*
+ * atoms.c: interned names shared by every step of the toolchain
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atoms.h"
+#include "lib/intern.h"
+
+struct InternTable atomTable;
+
+#define KEYWORD_SPELLING(name, spelling) spelling,
+static const char* keywordSpellings[] = {
+  KEYWORD_LIST(KEYWORD_SPELLING)
+};
+#undef KEYWORD_SPELLING
+
+struct InternTable newAtomTable() {
+  // make an intern table with all the keywords already in it, at their fixed atom numbers
+  struct InternTable table = newInternTable();
+  size_t index = 0;
+  while (index < ATOM_KEYWORD_COUNT - 1) {
+    const char* spelling = keywordSpellings[index];
+    Atom atom = intern(&table, spelling, strlen(spelling));
+    if (atom != index + 1) {
+      fprintf(stderr, "Internal error: keyword \"%s\" is listed twice.\n", spelling);
+      exit(-1);
+    }
+    index++;
+  }
+  return table;
+}
+
+void initAtoms() {
+  atomTable = newAtomTable();
+}
+
+void freeAtoms() {
+  freeInternTable(&atomTable);
+}
@@ -0,0 +1,73 @@
+/*
+ * atoms.h: interned names shared by every step of the toolchain
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ATOMS_H
+#define ATOMS_H
+
+#include "lib/intern.h"
+
+// keywords are interned first, in this order, so their atoms are compile time constants (ATOM_ADD, ATOM_BITS, etc.)
+// keyword atoms are always the uppercase spelling, compare against upperAtom(&atomTable, atom) for case insensitive matching
+#define KEYWORD_LIST(X) \
+  /* core */ \
+  X(ADD, "ADD") X(RSH, "RSH") X(LOD, "LOD") X(STR, "STR") X(BGE, "BGE") X(NOR, "NOR") \
+  X(SUB, "SUB") X(JMP, "JMP") X(MOV, "MOV") X(NOP, "NOP") X(IMM, "IMM") \
+  /* basic */ \
+  X(LSH, "LSH") X(INC, "INC") X(DEC, "DEC") X(NEG, "NEG") X(AND, "AND") X(OR, "OR") \
+  X(NOT, "NOT") X(XNOR, "XNOR") X(XOR, "XOR") X(NAND, "NAND") X(BRL, "BRL") X(BRG, "BRG") \
+  X(BRE, "BRE") X(BNE, "BNE") X(BOD, "BOD") X(BEV, "BEV") X(BLE, "BLE") X(BRZ, "BRZ") \
+  X(BNZ, "BNZ") X(BRN, "BRN") X(BRP, "BRP") X(PSH, "PSH") X(POP, "POP") X(CAL, "CAL") \
+  X(RET, "RET") X(HLT, "HLT") X(CPY, "CPY") X(BRC, "BRC") X(BNC, "BNC") \
+  /* complex */ \
+  X(MLT, "MLT") X(UMLT, "UMLT") X(SUMLT, "SUMLT") X(DIV, "DIV") X(SDIV, "SDIV") X(MOD, "MOD") \
+  X(BSR, "BSR") X(BSL, "BSL") X(SRS, "SRS") X(BSS, "BSS") X(SBRL, "SBRL") X(SBRG, "SBRG") \
+  X(SBLE, "SBLE") X(SBGE, "SBGE") X(SETE, "SETE") X(SETNE, "SETNE") X(SETG, "SETG") \
+  X(SETL, "SETL") X(SETGE, "SETGE") X(SETLE, "SETLE") X(SETC, "SETC") X(SETNC, "SETNC") \
+  X(SSETG, "SSETG") X(SSETL, "SSETL") X(SSETLE, "SSETLE") X(SSETGE, "SSETGE") X(ABS, "ABS") \
+  X(LLOD, "LLOD") X(LSTR, "LSTR") X(IN, "IN") X(OUT, "OUT") \
+  /* headers and data */ \
+  X(BITS, "BITS") X(MINREG, "MINREG") X(MINHEAP, "MINHEAP") X(MINSTACK, "MINSTACK") \
+  X(RUN, "RUN") X(RAM, "RAM") X(ROM, "ROM") X(DW, "DW") \
+  /* special registers */ \
+  X(SP, "SP") X(PC, "PC") \
+  /* macros and defined immediates */ \
+  X(MACRO_DEFINE, "@DEFINE") X(MACRO_DEBUG, "@DEBUG") X(MACRO_BITS, "@BITS") \
+  X(MACRO_MINREG, "@MINREG") X(MACRO_MINHEAP, "@MINHEAP") X(MACRO_MINSTACK, "@MINSTACK") \
+  X(MACRO_HEAP, "@HEAP") X(MACRO_MAX, "@MAX") X(MACRO_SMAX, "@SMAX") X(MACRO_MSB, "@MSB") \
+  X(MACRO_SMSB, "@SMSB") X(MACRO_UHALF, "@UHALF") X(MACRO_LHALF, "@LHALF")
+
+#define KEYWORD_ENUM(name, spelling) ATOM_##name,
+enum {
+  ATOM_NONE = 0,
+  KEYWORD_LIST(KEYWORD_ENUM)
+  ATOM_KEYWORD_COUNT
+};
+#undef KEYWORD_ENUM
+
+// the first and last opcode atoms, every atom in between is an opcode
+#define ATOM_FIRST_OPCODE ATOM_ADD
+#define ATOM_LAST_OPCODE ATOM_OUT
+
+extern struct InternTable atomTable;
+
+struct InternTable newAtomTable();
+
+void initAtoms();
+
+void freeAtoms();
+
+#endif
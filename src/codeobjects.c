@@ -0,0 +1,231 @@
+/*
+ * codeobjects.c: used by the toolchain to store URCL code and metadata
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "codeobjects.h"
+#include "lib/arena.h"
+#include "lib/map.h"
+#include "lib/stringutils.h"
+#include "atoms.h"
+
+// size of each block in a compilation unit's arena
+#define CODE_ARENA_BLOCK_SIZE (1 << 20)
+
+struct Code newCode(const char* source, size_t sourceLength) {
+  struct Code code;
+  code.arena = newArena(CODE_ARENA_BLOCK_SIZE);
+  code.source = source;
+  code.sourceLength = sourceLength;
+  code.generated = NULL;
+  code.generatedLength = 0;
+  code.generatedCapacity = 0;
+  code.stringMap = empty_map();
+  code.tokens.types = NULL;
+  code.tokens.atoms = NULL;
+  code.tokens.values = NULL;
+  code.tokens.offsets = NULL;
+  code.tokens.lengths = NULL;
+  code.tokens.count = 0;
+  code.tokens.capacity = 0;
+  code.tokens.wideValues = NULL;
+  code.tokens.wideCount = 0;
+  code.tokens.wideCapacity = 0;
+  code.lines = NULL;
+  code.lineCount = 0;
+  code.data = emptyDataSection();
+  return code;
+}
+
+void freeCode(struct Code* code) {
+  // string map keys and values live in the arena, so only the map's own lists get freed here
+  mapFree(&code->stringMap);
+  // token columns are resized constantly while tokenizing, so they use realloc (which can grow big blocks in place)
+  // instead of the arena
+  free(code->tokens.types);
+  free(code->tokens.atoms);
+  free(code->tokens.values);
+  free(code->tokens.offsets);
+  free(code->tokens.lengths);
+  free(code->tokens.wideValues);
+  code->tokens.count = 0;
+  code->tokens.capacity = 0;
+  code->tokens.wideCount = 0;
+  code->tokens.wideCapacity = 0;
+  free(code->generated);
+  code->generated = NULL;
+  code->generatedLength = 0;
+  code->generatedCapacity = 0;
+  freeDataSection(&code->data);
+  arenaFree(&code->arena);
+  code->lines = NULL;
+  code->lineCount = 0;
+}
+
+static void* growColumn(void* column, size_t capacity, size_t elementSize) {
+  void* output = realloc(column, capacity * elementSize);
+  if (output == NULL) {
+    fprintf(stderr, "Error: out of memory while storing tokens.\n");
+    exit(-1);
+  }
+  return output;
+}
+
+static void packValue(struct TokenStore* store, size_t index, __int128_t value) {
+  if (value >= INT64_MIN && value <= INT64_MAX) {
+    store->values[index] = (__int64_t) value;
+    return;
+  }
+  if (store->wideCount == store->wideCapacity) {
+    store->wideCapacity = store->wideCapacity == 0 ? 16 : store->wideCapacity * 2;
+    store->wideValues = growColumn(store->wideValues, store->wideCapacity, sizeof(__int128_t));
+  }
+  store->wideValues[store->wideCount] = value;
+  store->values[index] = store->wideCount;
+  store->types[index] |= TOKEN_WIDE;
+  store->wideCount++;
+}
+
+const char* codeText(struct Code* code, size_t offset) {
+  // text a token offset points at, either in the source or in the generated text after it
+  if (offset < code->sourceLength) {
+    return code->source + offset;
+  }
+  return code->generated + (offset - code->sourceLength);
+}
+
+size_t addGeneratedText(struct Code* code, const char* text, size_t length) {
+  // copy text into the code's generated text, returns the token offset it starts at
+  if (code->generatedLength + length > code->generatedCapacity) {
+    size_t capacity = code->generatedCapacity == 0 ? 4096 : code->generatedCapacity;
+    while (capacity < code->generatedLength + length) {
+      capacity *= 2;
+    }
+    code->generated = growColumn(code->generated, capacity, sizeof(char));
+    code->generatedCapacity = capacity;
+  }
+  memcpy(code->generated + code->generatedLength, text, length);
+  size_t offset = code->sourceLength + code->generatedLength;
+  code->generatedLength += length;
+  return offset;
+}
+
+size_t addToken(struct Code* code, struct Token token) {
+  // append a token to the code's token store, returns its index
+  struct TokenStore* store = &code->tokens;
+  if (store->count == store->capacity) {
+    store->capacity = store->capacity == 0 ? 1024 : store->capacity * 2;
+    store->types = growColumn(store->types, store->capacity, sizeof(char));
+    store->atoms = growColumn(store->atoms, store->capacity, sizeof(Atom));
+    store->values = growColumn(store->values, store->capacity, sizeof(__int64_t));
+    store->offsets = growColumn(store->offsets, store->capacity, sizeof(size_t));
+    store->lengths = growColumn(store->lengths, store->capacity, sizeof(__uint32_t));
+  }
+  size_t index = store->count;
+  store->count++;
+  setToken(code, index, token);
+  return index;
+}
+
+void setToken(struct Code* code, size_t index, struct Token token) {
+  // overwrite a token, a replaced wide value just stays unused in the side table
+  struct TokenStore* store = &code->tokens;
+  store->types[index] = token.type;
+  store->atoms[index] = token.atom;
+  store->offsets[index] = token.offset;
+  store->lengths[index] = token.length;
+  packValue(store, index, token.value);
+}
+
+char tokenType(struct Code* code, size_t index) {
+  return code->tokens.types[index] & ~TOKEN_WIDE;
+}
+
+__int128_t tokenValue(struct Code* code, size_t index) {
+  struct TokenStore* store = &code->tokens;
+  if (store->types[index] & TOKEN_WIDE) {
+    return store->wideValues[store->values[index]];
+  }
+  return store->values[index];
+}
+
+struct Token getToken(struct Code* code, size_t index) {
+  struct Token token;
+  token.type = tokenType(code, index);
+  token.atom = code->tokens.atoms[index];
+  token.offset = code->tokens.offsets[index];
+  token.length = code->tokens.lengths[index];
+  token.value = tokenValue(code, index);
+  return token;
+}
+
+int addString(struct Code* code, __uint64_t id, struct StringData* string) {
+  // store a decoded literal under its id (&S1, &S2, &S3, etc.), the string should live in the code's arena
+  // returns 0 on success
+  // returns -1 if the id is already taken
+  char* stringID = arenaAlloc(&code->arena, 23 * sizeof(char)); // string ID is 20 max digits from a u64 + 2 for &S + 1 for null terminator
+  sprintf(stringID, "&S%lu", id);
+  return mapAdd(&code->stringMap, stringID, (char*) string);
+}
+
+struct StringData* getString(struct Code* code, __uint64_t id) {
+  // returns NULL if there is no string with that id
+  char key[23];
+  char* output;
+  sprintf(key, "&S%lu", id);
+  if (mapGet(&code->stringMap, key, &output) != 0) {
+    return NULL;
+  }
+  return (struct StringData*) output;
+}
+
+struct StringData* copyString(struct Arena* arena, struct StringData* string) {
+  size_t size = sizeof(struct StringData) + string->length;
+  struct StringData* output = arenaAlloc(arena, size);
+  memcpy(output, string, size);
+  return output;
+}
+
+size_t headerLine(struct Code* code, Atom header) {
+  // returns the index of the line starting with header, or code->lineCount if there isn't one
+  size_t lineIndex = 0;
+  while (lineIndex < code->lineCount) {
+    struct Line line = code->lines[lineIndex];
+    if (line.tokenCount == 2 && upperAtom(&atomTable, code->tokens.atoms[line.firstToken]) == header && tokenType(code, line.firstToken + 1) == TOKEN_IMMEDIATE) {
+      return lineIndex;
+    }
+    lineIndex++;
+  }
+  return code->lineCount;
+}
+
+void setHeader(struct Code* code, size_t lineIndex, __uint64_t value) {
+  // change the number a header like MINREG 8 declares
+  struct StringBuilder number = newStringBuilder(24);
+  builderAppendUnsigned(&number, value);
+  size_t index = code->lines[lineIndex].firstToken + 1;
+  struct Token token = getToken(code, index);
+  token.value = value;
+  token.offset = addGeneratedText(code, number.data, number.length);
+  token.length = number.length;
+  setToken(code, index, token);
+  freeStringBuilder(&number);
+}
@@ -20,24 +20,106 @@
 
 #include <bits/types.h>
 #include "lib/map.h"
+#include "lib/arena.h"
+#include "lib/intern.h"
+#include "datasection.h"
 
+// token types
+#define TOKEN_NONE '\0'       // anything that isn't recognised below, only has its text
+#define TOKEN_NAME 'n'        // opcodes, headers and other bare words, has an atom
+#define TOKEN_REGISTER 'r'    // R<n>, $<n>, value is the register number
+#define TOKEN_IMMEDIATE 'i'   // decimal, hex, binary and octal numbers, value is the number
+#define TOKEN_MEMORY 'a'      // #<n>, M<n>, value is the address
+#define TOKEN_RELATIVE '~'    // ~+<n>, ~-<n>, value is the offset
+#define TOKEN_LABEL 'l'       // .name, has an atom
+#define TOKEN_MACRO 'm'       // @NAME, has an atom
+#define TOKEN_PORT 'p'        // %NAME, has an atom
+#define TOKEN_STRING 's'      // string or character literal, value is its id in the string map (&S<value>)
+
+// set in TokenStore.types when a token's value didn't fit in 64 bits and lives in the wide value table
+#define TOKEN_WIDE ((char) 0x80)
+
+// unpacked copy of one token, handy for code that isn't performance critical
 struct Token {
   char type;
-  char* string;
+  size_t offset;  // start of the token in the source
+  size_t length;  // length of the token in the source
+  Atom atom;      // interned spelling for names, labels, macros and ports, 0 otherwise
   __int128_t value;
 };
 
+// all tokens of a program stored column by column, so a pass that only looks at types or atoms
+// doesn't drag source positions and 128 bit values through the cache with it
+struct TokenStore {
+  char* types;
+  Atom* atoms;
+  __int64_t* values;     // value, or index into wideValues if the type has TOKEN_WIDE set
+  size_t* offsets;
+  __uint32_t* lengths;
+  size_t count;
+  size_t capacity;
+  __int128_t* wideValues;  // side table for the rare values that need more than 64 bits
+  size_t wideCount;
+  size_t wideCapacity;
+};
+
 struct Line {
-  __uint64_t linenumber;
+  __uint64_t linenumber;  // line in the source this line starts on
   char linetype;
-  struct Token* tokens;
+  size_t firstToken;  // index of the line's first token in the code's token store
   __uint64_t tokenCount;
 };
 
+// decoded string or character literal, string map values point at one of these
+// the length is stored up front so strings can hold zero bytes
+struct StringData {
+  size_t length;
+  __uint8_t isCharacter;  // literal was written in single quotes
+  unsigned char bytes[];  // NOT null terminated
+};
+
 struct Code {
+  struct Arena arena;  // owns the lines and string map entries, released all at once by freeCode()
+  const char* source;  // source text tokens point into, NOT null terminated
+  size_t sourceLength;
+  // text that isn't in the source (ex. the bodies of @DEFINE macros), token offsets past the end of the source
+  // point in here, use codeText() rather than indexing either one directly
+  char* generated;
+  size_t generatedLength;
+  size_t generatedCapacity;
   Map stringMap;
+  struct TokenStore tokens;
   struct Line* lines;
   size_t lineCount;
+  struct DataSection data;  // string literals laid out as data words, filled in by parse()
 };
 
+struct Code newCode(const char* source, size_t sourceLength);
+
+void freeCode(struct Code* code);
+
+const char* codeText(struct Code* code, size_t offset);
+
+size_t addGeneratedText(struct Code* code, const char* text, size_t length);
+
+size_t addToken(struct Code* code, struct Token token);
+
+struct Token getToken(struct Code* code, size_t index);
+
+void setToken(struct Code* code, size_t index, struct Token token);
+
+__int128_t tokenValue(struct Code* code, size_t index);
+
+char tokenType(struct Code* code, size_t index);
+
+int addString(struct Code* code, __uint64_t id, struct StringData* string);
+
+struct StringData* getString(struct Code* code, __uint64_t id);
+
+struct StringData* copyString(struct Arena* arena, struct StringData* string);
+
+size_t headerLine(struct Code* code, Atom header);
+
+void setHeader(struct Code* code, size_t lineIndex, __uint64_t value);
+
 #endif
\ No newline at end of file
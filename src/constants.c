@@ -0,0 +1,330 @@
+/*
+ * constants.c: works out which registers always hold the same number, and uses that number directly
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "optimize.h"
+#include "controlflow.h"
+#include "liveness.h"
+#include "opcodes.h"
+#include "codeobjects.h"
+#include "atoms.h"
+#include "lib/arena.h"
+
+// what out of memory errors say this file was doing
+#define OUT_OF_MEMORY_TASK "propagating constants"
+
+// what's known about a register at some point, from nothing yet to a single number to anything
+#define CONSTANT_UNKNOWN 0  // no path that runs has reached here yet
+#define CONSTANT_KNOWN 1
+#define CONSTANT_VARIES 2
+
+// one state per register per block, past this many the pass isn't worth the memory and is skipped
+#define CONSTANT_STATE_LIMIT ((size_t) 1 << 24)
+
+struct RegisterStates {
+  __uint8_t* states;
+  __uint128_t* values;
+};
+
+struct Propagator {
+  struct Program* program;
+  struct ControlFlow flow;
+  size_t registerCount;
+  struct RegisterStates entry;  // registerCount entries per block, what's known when the block starts
+  struct RegisterStates scratch;
+  __uint8_t* runs;              // block can be reached by a path that runs (not one behind a branch that never goes that way)
+  size_t* worklist;
+  __uint8_t* queued;
+  size_t worklistCount;
+};
+
+static void queueBlock(struct Propagator* propagator, size_t block) {
+  if (propagator->queued[block]) {
+    return;
+  }
+  propagator->queued[block] = 1;
+  propagator->worklist[propagator->worklistCount] = block;
+  propagator->worklistCount++;
+}
+
+static int sourceValue(struct Propagator* propagator, struct Operand* operand, __uint128_t* value) {
+  // returns 0 if the operand is known to read as one number
+  if (operand->type == TOKEN_IMMEDIATE || (operand->type == TOKEN_REGISTER && operand->value == 0)) {
+    *value = operand->type == TOKEN_IMMEDIATE ? (__uint128_t) operand->value : 0;
+    return 0;
+  }
+  if (operand->type == TOKEN_REGISTER && (size_t) operand->value < propagator->registerCount && propagator->scratch.states[operand->value] == CONSTANT_KNOWN) {
+    *value = propagator->scratch.values[operand->value];
+    return 0;
+  }
+  return -1;
+}
+
+static int sourceValues(struct Propagator* propagator, struct Instruction* instruction, __uint8_t firstSource, __uint128_t* sources) {
+  // returns 0 if every operand from firstSource on is known
+  sources[0] = 0;
+  sources[1] = 0;
+  __uint8_t operandIndex = firstSource;
+  while (operandIndex < instruction->operandCount) {
+    if (sourceValue(propagator, &instruction->operands[operandIndex], &sources[operandIndex - firstSource]) != 0) {
+      return -1;
+    }
+    operandIndex++;
+  }
+  return 0;
+}
+
+static void step(struct Propagator* propagator, struct Instruction* instruction) {
+  // update the scratch states for one instruction
+  size_t written = writtenRegister(instruction);
+  if (written == NO_REGISTER) {
+    return;
+  }
+  __uint128_t sources[2];
+  __uint128_t result;
+  if (sourceValues(propagator, instruction, 1, sources) == 0 && foldOpcode(instruction->opcode, sources, propagator->program->bits, &result) == 0) {
+    propagator->scratch.states[written] = CONSTANT_KNOWN;
+    propagator->scratch.values[written] = result;
+  }
+  else {
+    propagator->scratch.states[written] = CONSTANT_VARIES;
+  }
+}
+
+static int branchDirection(struct Propagator* propagator, struct Instruction* instruction, __uint8_t* taken) {
+  // returns 0 if the block's last instruction always goes the same way
+  const struct OpcodeInfo* info = opcodeInfo(instruction->opcode);
+  if (info == NULL || !(info->flags & OP_BRANCH)) {
+    return -1;
+  }
+  __uint128_t sources[2];
+  if (sourceValues(propagator, instruction, 1, sources) != 0) {
+    return -1;
+  }
+  return foldBranch(instruction->opcode, sources, propagator->program->bits, taken);
+}
+
+static void mergeInto(struct Propagator* propagator, size_t block) {
+  // meet the scratch states into a block's entry states, requeue it if anything changed
+  size_t registerCount = propagator->registerCount;
+  __uint8_t* states = &propagator->entry.states[block * registerCount];
+  __uint128_t* values = &propagator->entry.values[block * registerCount];
+  __uint8_t changed = !propagator->runs[block];
+  propagator->runs[block] = 1;
+  size_t index = 1;
+  while (index < registerCount) {
+    __uint8_t incoming = propagator->scratch.states[index];
+    if (states[index] == CONSTANT_VARIES || incoming == CONSTANT_UNKNOWN) {
+      index++;
+      continue;
+    }
+    if (states[index] == CONSTANT_UNKNOWN) {
+      states[index] = incoming;
+      values[index] = propagator->scratch.values[index];
+      changed = 1;
+    }
+    else if (incoming == CONSTANT_VARIES || values[index] != propagator->scratch.values[index]) {
+      states[index] = CONSTANT_VARIES;
+      changed = 1;
+    }
+    index++;
+  }
+  if (changed) {
+    queueBlock(propagator, block);
+  }
+}
+
+static void loadEntry(struct Propagator* propagator, size_t block) {
+  size_t registerCount = propagator->registerCount;
+  memcpy(propagator->scratch.states, &propagator->entry.states[block * registerCount], registerCount);
+  memcpy(propagator->scratch.values, &propagator->entry.values[block * registerCount], registerCount * sizeof(__uint128_t));
+}
+
+static void runBlock(struct Propagator* propagator, size_t blockIndex) {
+  struct Program* program = propagator->program;
+  struct Block* block = &propagator->flow.blocks[blockIndex];
+  loadEntry(propagator, blockIndex);
+  size_t index = block->first;
+  while (1) {
+    step(propagator, &program->instructions[index]);
+    if (index == block->last) {
+      break;
+    }
+    index = program->instructions[index].next;
+  }
+
+  // only follow the way a branch can actually go
+  __uint8_t taken;
+  if (branchDirection(propagator, &program->instructions[block->last], &taken) == 0) {
+    if (taken && block->target != NO_BLOCK) {
+      mergeInto(propagator, block->target);
+    }
+    if (!taken && blockIndex + 1 < propagator->flow.blockCount) {
+      mergeInto(propagator, blockIndex + 1);
+    }
+    return;
+  }
+  size_t edge = block->firstSuccessor;
+  while (edge < block->firstSuccessor + block->successorCount) {
+    mergeInto(propagator, propagator->flow.successors[edge]);
+    edge++;
+  }
+}
+
+static int rewriteBlock(struct Propagator* propagator, size_t blockIndex) {
+  // use what's known: registers become immediates, instructions with a known result become IMMs, and branches
+  // that always go the same way become a JMP or go away
+  // returns 1 if anything changed
+  struct Program* program = propagator->program;
+  struct Block* block = &propagator->flow.blocks[blockIndex];
+  int changed = 0;
+  loadEntry(propagator, blockIndex);
+  size_t index = block->first;
+  while (1) {
+    size_t next = program->instructions[index].next;
+    __uint8_t isLast = index == block->last;
+    struct Instruction* instruction = &program->instructions[index];
+    const struct OpcodeInfo* info = opcodeInfo(instruction->opcode);
+
+    __uint8_t taken;
+    // targets without JMP keep branches that are always taken as they are
+    if (isLast && branchDirection(propagator, instruction, &taken) == 0 && (!taken || program->available[ATOM_JMP])) {
+      if (taken) {
+        instruction->opcode = ATOM_JMP;
+        instruction->operandCount = 1;
+        changeInstruction(program, index);
+      }
+      else {
+        removeInstruction(program, index);
+      }
+      changed = 1;
+      break;
+    }
+
+    size_t written = writtenRegister(instruction);
+    __uint128_t sources[2];
+    __uint128_t result;
+    if (written != NO_REGISTER && hasNoSideEffects(instruction->opcode) && sourceValues(propagator, instruction, 1, sources) == 0 && foldOpcode(instruction->opcode, sources, program->bits, &result) == 0) {
+      struct Operand folded[2] = {instruction->operands[0], {TOKEN_IMMEDIATE, ATOM_NONE, (__int128_t) result, NEW_TOKEN}};
+      if ((instruction->opcode != ATOM_IMM || instruction->operands[1].type != TOKEN_IMMEDIATE) && formAvailable(program, ATOM_IMM, folded, 2)) {
+        instruction->opcode = ATOM_IMM;
+        instruction->operandCount = 2;
+        instruction->operands[1] = folded[1];
+        changeInstruction(program, index);
+        changed = 1;
+      }
+    }
+    else if (info != NULL) {
+      // a branch's target has to stay as it is, everything else it reads can be a number
+      // as long as the target has the instruction with an immediate there
+      __uint8_t operandIndex = (info->flags & (OP_WRITES_FIRST | OP_BRANCH | OP_JUMP | OP_CALL)) ? 1 : 0;
+      while (operandIndex < instruction->operandCount) {
+        struct Operand* operand = &instruction->operands[operandIndex];
+        struct Operand original = *operand;
+        __uint128_t value;
+        if (operand->type == TOKEN_REGISTER && operand->value != 0 && sourceValue(propagator, operand, &value) == 0) {
+          struct Operand immediate = {TOKEN_IMMEDIATE, ATOM_NONE, (__int128_t) value, NEW_TOKEN};
+          *operand = immediate;
+          if (formAvailable(program, instruction->opcode, instruction->operands, instruction->operandCount)) {
+            changeInstruction(program, index);
+            changed = 1;
+          }
+          else {
+            *operand = original;
+          }
+        }
+        operandIndex++;
+      }
+    }
+    step(propagator, instruction);
+    if (isLast) {
+      break;
+    }
+    index = next;
+  }
+  return changed;
+}
+
+int propagateConstants(struct Program* program) {
+  // forward dataflow over the blocks, only along the ways branches can actually go
+  // each register settles on nothing known yet, one number, or anything, so every block runs a bounded number of times
+  // returns 1 if anything changed
+  struct Propagator propagator;
+  propagator.program = program;
+  propagator.flow = buildControlFlow(program);
+  propagator.registerCount = highestRegister(program) + 1;
+  size_t blockCount = propagator.flow.blockCount;
+  if (blockCount == 0 || blockCount * propagator.registerCount > CONSTANT_STATE_LIMIT) {
+    freeControlFlow(&propagator.flow);
+    return 0;
+  }
+  propagator.entry.states = checkedCalloc(blockCount * propagator.registerCount, sizeof(__uint8_t), OUT_OF_MEMORY_TASK);
+  propagator.entry.values = checkedCalloc(blockCount * propagator.registerCount, sizeof(__uint128_t), OUT_OF_MEMORY_TASK);
+  propagator.scratch.states = checkedCalloc(propagator.registerCount, sizeof(__uint8_t), OUT_OF_MEMORY_TASK);
+  propagator.scratch.values = checkedCalloc(propagator.registerCount, sizeof(__uint128_t), OUT_OF_MEMORY_TASK);
+  propagator.runs = checkedCalloc(blockCount, sizeof(__uint8_t), OUT_OF_MEMORY_TASK);
+  propagator.worklist = checkedCalloc(blockCount, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  propagator.queued = checkedCalloc(blockCount, sizeof(__uint8_t), OUT_OF_MEMORY_TASK);
+  propagator.worklistCount = 0;
+
+  // nothing is known where the program starts, where a RET lands, or where an indirect jump could land
+  memset(propagator.scratch.states, CONSTANT_VARIES, propagator.registerCount);
+  size_t blockIndex = 0;
+  while (blockIndex < blockCount) {
+    struct Block* block = &propagator.flow.blocks[blockIndex];
+    const struct OpcodeInfo* info = opcodeInfo(program->instructions[block->last].opcode);
+    if (block->flags & (BLOCK_ENTRY | BLOCK_ADDRESS_TAKEN)) {
+      mergeInto(&propagator, blockIndex);
+    }
+    if (info != NULL && (info->flags & OP_CALL) && blockIndex + 1 < blockCount) {
+      mergeInto(&propagator, blockIndex + 1);
+    }
+    blockIndex++;
+  }
+
+  while (propagator.worklistCount > 0) {
+    propagator.worklistCount--;
+    blockIndex = propagator.worklist[propagator.worklistCount];
+    propagator.queued[blockIndex] = 0;
+    runBlock(&propagator, blockIndex);
+  }
+
+  // blocks that never run are left for removeUnreachableCode()
+  int changed = 0;
+  blockIndex = 0;
+  while (blockIndex < blockCount) {
+    if (propagator.runs[blockIndex]) {
+      changed |= rewriteBlock(&propagator, blockIndex);
+    }
+    blockIndex++;
+  }
+
+  free(propagator.entry.states);
+  free(propagator.entry.values);
+  free(propagator.scratch.states);
+  free(propagator.scratch.values);
+  free(propagator.runs);
+  free(propagator.worklist);
+  free(propagator.queued);
+  freeControlFlow(&propagator.flow);
+  return changed;
+}
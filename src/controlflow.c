@@ -0,0 +1,295 @@
+/*
+ * controlflow.c: splits a program into basic blocks and links them up
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "controlflow.h"
+#include "optimize.h"
+#include "opcodes.h"
+#include "codeobjects.h"
+#include "atoms.h"
+#include "lib/arena.h"
+
+// what out of memory errors say this file was doing
+#define OUT_OF_MEMORY_TASK "building control flow graph"
+
+#define CONTROL_FLAGS (OP_BRANCH | OP_JUMP | OP_CALL | OP_RETURN | OP_HALT)
+
+static Atom lineLabel(struct Program* program, struct Instruction* instruction) {
+  // returns the label a line defines, ATOM_NONE if it isn't a label line
+  if (instruction->opcode != ATOM_NONE) {
+    return ATOM_NONE;
+  }
+  struct Line line = program->code->lines[instruction->line];
+  if (line.tokenCount == 0 || tokenType(program->code, line.firstToken) != TOKEN_LABEL) {
+    return ATOM_NONE;
+  }
+  return program->code->tokens.atoms[line.firstToken];
+}
+
+struct FlowBuilder {
+  struct Program* program;
+  size_t* labels;     // label atom -> instruction index
+  size_t* ordinals;   // instruction index -> how many instructions come before it, for ~ operands
+  size_t* byOrdinal;  // the reverse
+  size_t instructionCount;
+};
+
+static size_t targetInstruction(struct FlowBuilder* builder, size_t index, struct Operand* operand) {
+  // where a branch to operand goes, NO_INSTRUCTION if that's only known at run time
+  if (operand->type == TOKEN_LABEL && operand->atom < atomTable.count) {
+    return builder->labels[operand->atom];
+  }
+  if (operand->type == TOKEN_RELATIVE) {
+    __int128_t ordinal = (__int128_t) builder->ordinals[index] + operand->value;
+    if (ordinal >= 0 && ordinal < (__int128_t) builder->instructionCount) {
+      return builder->byOrdinal[ordinal];
+    }
+  }
+  return NO_INSTRUCTION;
+}
+
+static void addSuccessor(struct ControlFlow* flow, size_t* capacity, struct Block* block, size_t target) {
+  size_t index = block->firstSuccessor;
+  while (index < flow->edgeCount) {
+    if (flow->successors[index] == target) {
+      return;
+    }
+    index++;
+  }
+  if (flow->edgeCount == *capacity) {
+    *capacity *= 2;
+    flow->successors = realloc(flow->successors, *capacity * sizeof(size_t));
+    if (flow->successors == NULL) {
+      fprintf(stderr, "Error: out of memory while building control flow graph.\n");
+      exit(-1);
+    }
+  }
+  flow->successors[flow->edgeCount] = target;
+  flow->edgeCount++;
+  block->successorCount++;
+}
+
+struct ControlFlow buildControlFlow(struct Program* program) {
+  // blocks start at labels, at ~ targets and after anything that can jump, and end before the next one starts
+  struct ControlFlow flow;
+  memset(&flow, 0, sizeof(struct ControlFlow));
+  struct FlowBuilder builder;
+  builder.program = program;
+  builder.labels = checkedCalloc(atomTable.count, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  builder.ordinals = checkedCalloc(program->count, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  builder.byOrdinal = checkedCalloc(program->count, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  builder.instructionCount = 0;
+  __uint8_t* leaders = checkedCalloc(program->count, sizeof(__uint8_t), OUT_OF_MEMORY_TASK);
+  flow.blockOf = checkedCalloc(program->count, sizeof(size_t), OUT_OF_MEMORY_TASK);
+
+  size_t index = 0;
+  while (index < atomTable.count) {
+    builder.labels[index] = NO_INSTRUCTION;
+    index++;
+  }
+  index = 0;
+  while (index < program->count) {
+    flow.blockOf[index] = NO_BLOCK;
+    index++;
+  }
+
+  // number the instructions and find the labels
+  index = program->first;
+  while (index != NO_INSTRUCTION) {
+    struct Instruction* instruction = &program->instructions[index];
+    Atom label = lineLabel(program, instruction);
+    if (label != ATOM_NONE) {
+      if (builder.labels[label] == NO_INSTRUCTION) {
+        builder.labels[label] = index;
+      }
+      leaders[index] = 1;
+    }
+    if (instruction->opcode != ATOM_NONE) {
+      builder.ordinals[index] = builder.instructionCount;
+      builder.byOrdinal[builder.instructionCount] = index;
+      builder.instructionCount++;
+    }
+    index = instruction->next;
+  }
+
+  // mark where blocks start
+  if (program->first != NO_INSTRUCTION) {
+    leaders[program->first] = 1;
+  }
+  index = program->first;
+  while (index != NO_INSTRUCTION) {
+    struct Instruction* instruction = &program->instructions[index];
+    const struct OpcodeInfo* info = opcodeInfo(instruction->opcode);
+    if (info != NULL && (info->flags & CONTROL_FLAGS)) {
+      if (instruction->next != NO_INSTRUCTION) {
+        leaders[instruction->next] = 1;
+      }
+      if (info->flags & (OP_BRANCH | OP_JUMP | OP_CALL)) {
+        size_t target = targetInstruction(&builder, index, &instruction->operands[0]);
+        if (target != NO_INSTRUCTION) {
+          leaders[target] = 1;
+        }
+      }
+    }
+    index = instruction->next;
+  }
+
+  // cut the program into blocks
+  size_t blockCapacity = 16;
+  flow.blocks = checkedCalloc(blockCapacity, sizeof(struct Block), OUT_OF_MEMORY_TASK);
+  index = program->first;
+  while (index != NO_INSTRUCTION) {
+    if (leaders[index]) {
+      if (flow.blockCount == blockCapacity) {
+        blockCapacity *= 2;
+        flow.blocks = realloc(flow.blocks, blockCapacity * sizeof(struct Block));
+        if (flow.blocks == NULL) {
+          fprintf(stderr, "Error: out of memory while building control flow graph.\n");
+          exit(-1);
+        }
+      }
+      memset(&flow.blocks[flow.blockCount], 0, sizeof(struct Block));
+      flow.blocks[flow.blockCount].first = index;
+      flow.blockCount++;
+    }
+    flow.blocks[flow.blockCount - 1].last = index;
+    flow.blockOf[index] = flow.blockCount - 1;
+    index = program->instructions[index].next;
+  }
+  if (flow.blockCount > 0) {
+    flow.blocks[0].flags |= BLOCK_ENTRY;
+  }
+
+  // link each block to where it can go next
+  size_t edgeCapacity = 16;
+  flow.successors = checkedCalloc(edgeCapacity, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  size_t blockIndex = 0;
+  while (blockIndex < flow.blockCount) {
+    struct Block* block = &flow.blocks[blockIndex];
+    block->firstSuccessor = flow.edgeCount;
+    block->target = NO_BLOCK;
+    struct Instruction* last = &program->instructions[block->last];
+    const struct OpcodeInfo* info = opcodeInfo(last->opcode);
+    __uint16_t flags = info != NULL ? info->flags : 0;
+    __uint8_t fallsThrough = !(flags & (OP_JUMP | OP_RETURN | OP_HALT)) && blockIndex + 1 < flow.blockCount;
+    if (flags & (OP_BRANCH | OP_JUMP | OP_CALL)) {
+      size_t target = targetInstruction(&builder, block->last, &last->operands[0]);
+      if (target != NO_INSTRUCTION) {
+        block->target = flow.blockOf[target];
+        addSuccessor(&flow, &edgeCapacity, block, block->target);
+      }
+      else {
+        block->flags |= BLOCK_INDIRECT;
+      }
+    }
+    if (fallsThrough) {
+      addSuccessor(&flow, &edgeCapacity, block, blockIndex + 1);
+    }
+    if (flags & OP_RETURN) {
+      block->flags |= BLOCK_RETURNS;
+    }
+    if (flags & OP_HALT) {
+      block->flags |= BLOCK_HALTS;
+    }
+
+    // writing to PC is a jump too, and a label used as a value could be jumped to from anywhere
+    index = block->first;
+    while (1) {
+      struct Instruction* instruction = &program->instructions[index];
+      const struct OpcodeInfo* instructionInfo = opcodeInfo(instruction->opcode);
+      if (instructionInfo != NULL) {
+        if ((instructionInfo->flags & OP_WRITES_FIRST) && instruction->operands[0].type == TOKEN_NAME && upperAtom(&atomTable, instruction->operands[0].atom) == ATOM_PC) {
+          block->flags |= BLOCK_INDIRECT;
+        }
+        __uint8_t operandIndex = (instructionInfo->flags & (OP_BRANCH | OP_JUMP | OP_CALL)) ? 1 : 0;
+        while (operandIndex < instruction->operandCount) {
+          struct Operand* operand = &instruction->operands[operandIndex];
+          if (operand->type == TOKEN_LABEL && builder.labels[operand->atom] != NO_INSTRUCTION) {
+            flow.blocks[flow.blockOf[builder.labels[operand->atom]]].flags |= BLOCK_ADDRESS_TAKEN;
+          }
+          operandIndex++;
+        }
+      }
+      else {
+        // DW .label and such
+        struct Line line = program->code->lines[instruction->line];
+        size_t tokenIndex = lineLabel(program, instruction) != ATOM_NONE ? 1 : 0;
+        while (tokenIndex < line.tokenCount) {
+          Atom atom = program->code->tokens.atoms[line.firstToken + tokenIndex];
+          if (tokenType(program->code, line.firstToken + tokenIndex) == TOKEN_LABEL && builder.labels[atom] != NO_INSTRUCTION) {
+            flow.blocks[flow.blockOf[builder.labels[atom]]].flags |= BLOCK_ADDRESS_TAKEN;
+          }
+          tokenIndex++;
+        }
+      }
+      if (index == block->last) {
+        break;
+      }
+      index = instruction->next;
+    }
+    blockIndex++;
+  }
+
+  // predecessors are the same edges turned around
+  flow.predecessors = checkedCalloc(flow.edgeCount, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  blockIndex = 0;
+  while (blockIndex < flow.blockCount) {
+    size_t edge = flow.blocks[blockIndex].firstSuccessor;
+    while (edge < flow.blocks[blockIndex].firstSuccessor + flow.blocks[blockIndex].successorCount) {
+      flow.blocks[flow.successors[edge]].predecessorCount++;
+      edge++;
+    }
+    blockIndex++;
+  }
+  size_t offset = 0;
+  blockIndex = 0;
+  while (blockIndex < flow.blockCount) {
+    flow.blocks[blockIndex].firstPredecessor = offset;
+    offset += flow.blocks[blockIndex].predecessorCount;
+    flow.blocks[blockIndex].predecessorCount = 0;
+    blockIndex++;
+  }
+  blockIndex = 0;
+  while (blockIndex < flow.blockCount) {
+    size_t edge = flow.blocks[blockIndex].firstSuccessor;
+    while (edge < flow.blocks[blockIndex].firstSuccessor + flow.blocks[blockIndex].successorCount) {
+      struct Block* target = &flow.blocks[flow.successors[edge]];
+      flow.predecessors[target->firstPredecessor + target->predecessorCount] = blockIndex;
+      target->predecessorCount++;
+      edge++;
+    }
+    blockIndex++;
+  }
+
+  free(builder.labels);
+  free(builder.ordinals);
+  free(builder.byOrdinal);
+  free(leaders);
+  return flow;
+}
+
+void freeControlFlow(struct ControlFlow* flow) {
+  free(flow->blocks);
+  free(flow->successors);
+  free(flow->predecessors);
+  free(flow->blockOf);
+  memset(flow, 0, sizeof(struct ControlFlow));
+}
@@ -0,0 +1,59 @@
+/*
+ * controlflow.h: splits a program into basic blocks and links them up
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef CONTROLFLOW_H
+#define CONTROLFLOW_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+#include "optimize.h"
+
+#define NO_BLOCK ((size_t) -1)
+
+// block flags
+#define BLOCK_ENTRY 0x01          // the program starts here
+#define BLOCK_ADDRESS_TAKEN 0x02  // one of the block's labels is used as a value, so an indirect jump could land here
+#define BLOCK_RETURNS 0x04        // ends with RET, where it goes is only known at run time
+#define BLOCK_INDIRECT 0x08       // jumps somewhere only known at run time (ex. JMP R1)
+#define BLOCK_HALTS 0x10
+
+struct Block {
+  size_t first;             // first and last instruction, in the program's linked order
+  size_t last;
+  size_t target;            // block the last instruction branches, jumps or calls to, NO_BLOCK if none or unknown
+  size_t firstSuccessor;    // into ControlFlow.successors
+  size_t successorCount;
+  size_t firstPredecessor;  // into ControlFlow.predecessors
+  size_t predecessorCount;
+  __uint8_t flags;
+};
+
+struct ControlFlow {
+  struct Block* blocks;     // in program order, block 0 is the entry
+  size_t blockCount;
+  size_t* successors;       // block indices, each block's are next to each other
+  size_t* predecessors;
+  size_t edgeCount;
+  size_t* blockOf;          // instruction index -> block index, NO_BLOCK for deleted instructions
+};
+
+struct ControlFlow buildControlFlow(struct Program* program);
+
+void freeControlFlow(struct ControlFlow* flow);
+
+#endif
@@ -0,0 +1,264 @@
+/*
+ * datasection.c: string literals laid out as one shared block of data words
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "codeobjects.h"
+#include "datasection.h"
+#include "atoms.h"
+#include "lib/stringutils.h"
+
+struct DataSection emptyDataSection() {
+  struct DataSection section;
+  section.words = NULL;
+  section.wordBytes = 1;
+  section.dataBits = 8;
+  section.length = 0;
+  section.base = 0;
+  section.addresses = NULL;
+  section.stringCount = 0;
+  return section;
+}
+
+// one string while the section is being laid out
+// -n terminators are the same for every string, so suffixes are worked out on the text alone
+struct DataEntry {
+  const unsigned char* bytes;
+  size_t length;  // without the terminator
+  size_t id;
+};
+
+// storage that gets written out, sorted back into source order before layout
+struct DataOwner {
+  size_t id;
+  size_t entry;
+};
+
+static int compareReversed(const void* a, const void* b) {
+  // order strings by their bytes read back to front, so every string lands right before the strings it is a suffix of
+  const struct DataEntry* left = a;
+  const struct DataEntry* right = b;
+  size_t index = 0;
+  while (index < left->length && index < right->length) {
+    unsigned char l = left->bytes[left->length - 1 - index];
+    unsigned char r = right->bytes[right->length - 1 - index];
+    if (l != r) {
+      return l < r ? -1 : 1;
+    }
+    index++;
+  }
+  if (left->length != right->length) {
+    return left->length < right->length ? -1 : 1;
+  }
+  // identical strings keep their original order
+  return left->id < right->id ? -1 : (left->id > right->id);
+}
+
+static int compareOwners(const void* a, const void* b) {
+  const struct DataOwner* left = a;
+  const struct DataOwner* right = b;
+  return left->id < right->id ? -1 : (left->id > right->id);
+}
+
+static __uint8_t isSuffix(struct DataEntry* shorter, struct DataEntry* longer) {
+  if (shorter->length > longer->length) {
+    return 0;
+  }
+  return memcmp(shorter->bytes, longer->bytes + longer->length - shorter->length, shorter->length) == 0;
+}
+
+static void setWord(struct DataSection* section, size_t index, __uint64_t value) {
+  if (section->dataBits < 64) {
+    value &= ((__uint64_t) 1 << section->dataBits) - 1;
+  }
+  switch (section->wordBytes) {
+    case 1:
+      ((__uint8_t*) section->words)[index] = value;
+      return;
+    case 2:
+      ((__uint16_t*) section->words)[index] = value;
+      return;
+    case 4:
+      ((__uint32_t*) section->words)[index] = value;
+      return;
+    default:
+      ((__uint64_t*) section->words)[index] = value;
+      return;
+  }
+}
+
+static void addNumber(struct Code* code, __uint64_t value) {
+  struct StringBuilder number = newStringBuilder(24);
+  builderAppendUnsigned(&number, value);
+  struct Token token = {TOKEN_IMMEDIATE, addGeneratedText(code, number.data, number.length), number.length, ATOM_NONE, value};
+  addToken(code, token);
+  freeStringBuilder(&number);
+}
+
+void placeDataSection(struct Code* code) {
+  // put the data section in memory right after the heap the program asks for, and write it there with
+  // STR instructions at the start of the program, so the strings are where their addresses say on any target
+  // MINHEAP grows to cover the strings, without it they go at address 0 like before
+  struct DataSection* section = &code->data;
+  if (section->length == 0) {
+    return;
+  }
+  size_t minHeap = headerLine(code, ATOM_MINHEAP);
+  if (minHeap != code->lineCount) {
+    section->base = (size_t) tokenValue(code, code->lines[minHeap].firstToken + 1);
+    setHeader(code, minHeap, section->base + section->length);
+  }
+  size_t id = 1;
+  while (id <= section->stringCount) {
+    struct StringData* string = getString(code, id);
+    if (string != NULL && !string->isCharacter) {
+      section->addresses[id] += section->base;
+    }
+    id++;
+  }
+
+  // the stores go after the headers at the top of the program
+  size_t position = 0;
+  while (position < code->lineCount) {
+    Atom header = upperAtom(&atomTable, code->tokens.atoms[code->lines[position].firstToken]);
+    if (header != ATOM_BITS && header != ATOM_MINREG && header != ATOM_MINHEAP && header != ATOM_MINSTACK && header != ATOM_RUN) {
+      break;
+    }
+    position++;
+  }
+  struct Line* lines = arenaAlloc(&code->arena, (code->lineCount + section->length) * sizeof(struct Line));
+  memcpy(lines, code->lines, position * sizeof(struct Line));
+  size_t text = addGeneratedText(code, "STR", 3);
+  __uint64_t linenumber = position < code->lineCount ? code->lines[position].linenumber : 1;
+  size_t index = 0;
+  while (index < section->length) {
+    struct Token store = {TOKEN_NAME, text, 3, ATOM_STR, 0};
+    struct Line line;
+    line.linenumber = linenumber;
+    line.linetype = '\0';
+    line.firstToken = addToken(code, store);
+    line.tokenCount = 3;
+    addNumber(code, section->base + index);
+    addNumber(code, dataWord(section, index));
+    lines[position + index] = line;
+    index++;
+  }
+  memcpy(lines + position + section->length, code->lines + position, (code->lineCount - position) * sizeof(struct Line));
+  code->lines = lines;
+  code->lineCount += section->length;
+}
+
+__uint64_t dataWord(struct DataSection* section, size_t index) {
+  switch (section->wordBytes) {
+    case 1:
+      return ((__uint8_t*) section->words)[index];
+    case 2:
+      return ((__uint16_t*) section->words)[index];
+    case 4:
+      return ((__uint32_t*) section->words)[index];
+    default:
+      return ((__uint64_t*) section->words)[index];
+  }
+}
+
+void buildDataSection(struct DataSection* section, struct Code* code, __uint8_t dataBits, __uint8_t nullStrings) {
+  // lay out every string in code's string map
+  // identical strings are stored once, and a string that ends another string points into that string's storage
+  // (ex. "lo" is stored at the end of "hello") so the section is only as big as the distinct string tails
+  // character literals are immediates, they get an address of 0 and take up no space
+  freeDataSection(section);
+  section->dataBits = dataBits == 0 ? 8 : dataBits;
+  section->wordBytes = section->dataBits <= 8 ? 1 : section->dataBits <= 16 ? 2 : section->dataBits <= 32 ? 4 : 8;
+  section->stringCount = code->stringMap.length;
+  section->addresses = calloc(section->stringCount + 1, sizeof(size_t));
+
+  struct DataEntry* entries = malloc((section->stringCount + 1) * sizeof(struct DataEntry));
+  size_t entryCount = 0;
+  size_t id = 1;
+  while (id <= section->stringCount) {
+    struct StringData* string = getString(code, id);
+    if (string != NULL && !string->isCharacter) {
+      entries[entryCount].bytes = string->bytes;
+      entries[entryCount].length = string->length;
+      entries[entryCount].id = id;
+      entryCount++;
+    }
+    id++;
+  }
+  size_t terminator = nullStrings ? 1 : 0;
+
+  qsort(entries, entryCount, sizeof(struct DataEntry), compareReversed);
+  // walk from the back, each string either fits on the end of the string after it or owns its own storage
+  size_t* owners = malloc((entryCount + 1) * sizeof(size_t));
+  struct DataOwner* order = malloc((entryCount + 1) * sizeof(struct DataOwner));
+  size_t ownerCount = 0;
+  size_t entryIndex = entryCount;
+  while (entryIndex > 0) {
+    entryIndex--;
+    owners[entryIndex] = entryIndex;
+    if (entryIndex + 1 < entryCount && isSuffix(&entries[entryIndex], &entries[entryIndex + 1])) {
+      owners[entryIndex] = owners[entryIndex + 1];
+      continue;
+    }
+    order[ownerCount].id = entries[entryIndex].id;
+    order[ownerCount].entry = entryIndex;
+    ownerCount++;
+    section->length += entries[entryIndex].length + terminator;
+  }
+  // lay the owners out in the order they were written, so the section reads like the source
+  qsort(order, ownerCount, sizeof(struct DataOwner), compareOwners);
+
+  section->words = malloc((section->length + 1) * section->wordBytes);
+  size_t* ownerAddress = malloc((entryCount + 1) * sizeof(size_t));
+  size_t address = 0;
+  size_t orderIndex = 0;
+  while (orderIndex < ownerCount) {
+    struct DataEntry* entry = &entries[order[orderIndex].entry];
+    ownerAddress[order[orderIndex].entry] = address;
+    size_t byteIndex = 0;
+    while (byteIndex < entry->length) {
+      setWord(section, address, entry->bytes[byteIndex]);
+      address++;
+      byteIndex++;
+    }
+    if (nullStrings) {
+      setWord(section, address, 0);
+      address++;
+    }
+    orderIndex++;
+  }
+  entryIndex = 0;
+  while (entryIndex < entryCount) {
+    size_t owner = owners[entryIndex];
+    section->addresses[entries[entryIndex].id] = ownerAddress[owner] + entries[owner].length - entries[entryIndex].length;
+    entryIndex++;
+  }
+
+  free(ownerAddress);
+  free(order);
+  free(owners);
+  free(entries);
+}
+
+void freeDataSection(struct DataSection* section) {
+  free(section->words);
+  free(section->addresses);
+  *section = emptyDataSection();
+}
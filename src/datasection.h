@@ -0,0 +1,48 @@
+/*
+ * datasection.h: string literals laid out as one shared block of data words
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DATASECTION_H
+#define DATASECTION_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+struct Code;
+
+// every string literal in a program, with duplicates and suffixes of other strings sharing storage
+// urcl gives each character its own word, words are stored at the width of the data bus
+struct DataSection {
+  void* words;            // array of 1, 2, 4 or 8 byte words, see wordBytes
+  __uint8_t wordBytes;
+  __uint8_t dataBits;     // words are masked to this many bits
+  size_t length;          // in words
+  size_t base;            // memory address of the first word, set by placeDataSection()
+  size_t* addresses;      // memory address of each string, indexed by string id (id 0 is unused)
+  size_t stringCount;
+};
+
+struct DataSection emptyDataSection();
+
+void buildDataSection(struct DataSection* section, struct Code* code, __uint8_t dataBits, __uint8_t nullStrings);
+
+void placeDataSection(struct Code* code);
+
+__uint64_t dataWord(struct DataSection* section, size_t index);
+
+void freeDataSection(struct DataSection* section);
+
+#endif
@@ -0,0 +1,715 @@
+/*
+ * expression.c: compiles and evaluates preprocessor expressions
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expression.h"
+
+// expressions are parsed once into postfix ops, so evaluating one (ex. for every instruction a translation template
+// is used for) is a single pass over a handful of ops with no parsing involved
+// the language is described in preprocessor.md, on top of that operands can take suffixes the translation files use:
+//   u, s      treat the operand as unsigned or signed at @BITS width
+//   h, hu, l  the next * gives the signed high, unsigned high or low word of the product (ex. Bhu*C)
+// and a single > right after a u or s operand is a right shift (ex. Bu>C, Bs>C)
+
+// op codes
+#define EXPR_NUMBER 0
+#define EXPR_OPERAND 1
+#define EXPR_CONSTANT 2        // one of the @BITS based constants below
+#define EXPR_NEGATE 3
+#define EXPR_NOT 4
+#define EXPR_LOGICAL_NOT 5
+#define EXPR_ABS 6
+#define EXPR_HIGH 7            // argument is the number of bits, 0 for half of @BITS
+#define EXPR_LOW 8             // argument is the number of bits, 0 for half of @BITS
+#define EXPR_HIGH_ADJUSTED 9   // high half, plus one if the low half is negative as a signed number
+#define EXPR_UNSIGNED 10
+#define EXPR_SIGNED 11
+#define EXPR_ADD 12
+#define EXPR_SUBTRACT 13
+#define EXPR_MULTIPLY 14
+#define EXPR_MULTIPLY_HIGH 15
+#define EXPR_MULTIPLY_HIGH_UNSIGNED 16
+#define EXPR_DIVIDE 17
+#define EXPR_MODULO 18
+#define EXPR_SHIFT_LEFT 19
+#define EXPR_SHIFT_RIGHT 20
+#define EXPR_AND 21
+#define EXPR_OR 22
+#define EXPR_XOR 23
+#define EXPR_EQUAL 24
+#define EXPR_NOT_EQUAL 25
+#define EXPR_LESS 26
+#define EXPR_GREATER 27
+#define EXPR_LESS_EQUAL 28
+#define EXPR_GREATER_EQUAL 29
+#define EXPR_LOGICAL_AND 30
+#define EXPR_LOGICAL_OR 31
+
+// @BITS based constants
+#define CONSTANT_BITS 0
+#define CONSTANT_MSB 1
+#define CONSTANT_SMSB 2
+#define CONSTANT_MAX 3
+#define CONSTANT_SMAX 4
+#define CONSTANT_UHALF 5
+#define CONSTANT_LHALF 6
+
+static const char* constantNames[] = {"BITS", "MSB", "SMSB", "MAX", "SMAX", "UHALF", "LHALF"};
+#define CONSTANT_COUNT (sizeof(constantNames) / sizeof(constantNames[0]))
+
+// deepest the value stack can get, checked when compiling so evaluating doesn't have to
+#define EXPRESSION_STACK_SIZE 32
+
+struct Parser {
+  const char* text;
+  size_t length;
+  size_t position;
+  struct ExpressionCode* output;
+  size_t depth;        // values on the stack after the ops emitted so far
+  const char* error;   // first error found, parsing stops there
+  size_t signedEnd;    // position just after an operand with a u or s suffix, 0 if there isn't one
+  size_t halfEnd;      // position just after an operand with an h suffix, 0 if there isn't one
+  __uint8_t halfUnsigned;
+};
+
+// ########################  COMPILING  ########################
+
+static int fail(struct Parser* parser, const char* error) {
+  if (parser->error == NULL) {
+    parser->error = error;
+  }
+  return -1;
+}
+
+static int emit(struct Parser* parser, __uint8_t code, __uint8_t argument, __uint64_t value, int stackEffect) {
+  // append an op, stackEffect is how many values it leaves on the stack minus how many it takes
+  struct ExpressionCode* output = parser->output;
+  if (output->count == output->capacity) {
+    output->capacity = output->capacity == 0 ? 64 : output->capacity * 2;
+    output->ops = realloc(output->ops, output->capacity * sizeof(struct ExpressionOp));
+    if (output->ops == NULL) {
+      fprintf(stderr, "Error: out of memory while compiling expressions.\n");
+      exit(-1);
+    }
+  }
+  struct ExpressionOp op;
+  op.code = code;
+  op.argument = argument;
+  op.value = value;
+  output->ops[output->count] = op;
+  output->count++;
+  parser->depth += stackEffect;
+  if (parser->depth > EXPRESSION_STACK_SIZE) {
+    return fail(parser, "expression is nested too deeply");
+  }
+  return 0;
+}
+
+static char peek(struct Parser* parser, size_t ahead) {
+  // skips blanks first, returns '\0' at the end of the expression
+  while (parser->position < parser->length && (parser->text[parser->position] == ' ' || parser->text[parser->position] == '\t')) {
+    parser->position++;
+  }
+  if (parser->position + ahead >= parser->length) {
+    return '\0';
+  }
+  return parser->text[parser->position + ahead];
+}
+
+static __uint8_t isNameCharacter(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static int parseLogical(struct Parser* parser);
+static int parseBitXor(struct Parser* parser);
+
+static int parseNumber(struct Parser* parser) {
+  const char* text = parser->text;
+  size_t index = parser->position;
+  __uint64_t base = 10;
+  if (text[index] == '0' && index + 1 < parser->length) {
+    char prefix = text[index + 1];
+    if (prefix == 'x' || prefix == 'X') {
+      base = 16;
+    }
+    else if (prefix == 'b' || prefix == 'B') {
+      base = 2;
+    }
+    else if (prefix == 'o' || prefix == 'O') {
+      base = 8;
+    }
+    if (base != 10) {
+      index += 2;
+    }
+  }
+  size_t digitStart = index;
+  __uint64_t value = 0;
+  while (index < parser->length && isNameCharacter(text[index])) {
+    char c = text[index];
+    __uint64_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    }
+    else {
+      digit = base;
+    }
+    if (digit >= base) {
+      return fail(parser, "bad digit in number");
+    }
+    if (value > (~(__uint64_t) 0 - digit) / base) {
+      return fail(parser, "number doesn't fit in 64 bits");
+    }
+    value = value * base + digit;
+    index++;
+  }
+  if (index == digitStart) {
+    return fail(parser, "expected digits after number prefix");
+  }
+  parser->position = index;
+  return emit(parser, EXPR_NUMBER, 0, value, 1);
+}
+
+static int parseName(struct Parser* parser) {
+  // operands (A, B, C with optional suffixes) and @BITS based constants, the @ on constants is optional
+  const char* text = parser->text;
+  size_t start = parser->position;
+  __uint8_t hasAt = text[start] == '@';
+  start += hasAt;
+  size_t end = start;
+  while (end < parser->length && isNameCharacter(text[end])) {
+    end++;
+  }
+  parser->position = end;
+  const char* name = text + start;
+  size_t length = end - start;
+  if (length == 0) {
+    return fail(parser, "expected a name after @");
+  }
+
+  if (!hasAt && name[0] >= 'A' && name[0] < 'A' + EXPRESSION_OPERANDS) {
+    __uint8_t isUnsigned = 0;
+    __uint8_t isSigned = 0;
+    __uint8_t isHigh = 0;
+    __uint8_t isOperand = 1;
+    size_t index = 1;
+    while (index < length && isOperand) {
+      switch (name[index]) {
+        case 'u': isUnsigned = 1; break;
+        case 's': isSigned = 1; break;
+        case 'h': isHigh = 1; break;
+        case 'l': break;
+        default: isOperand = 0; break;
+      }
+      index++;
+    }
+    if (isOperand && !(isUnsigned && isSigned)) {
+      if (emit(parser, EXPR_OPERAND, name[0] - 'A', 0, 1) != 0) {
+        return -1;
+      }
+      if (isHigh) {
+        parser->halfEnd = end;
+        parser->halfUnsigned = isUnsigned;
+      }
+      if (isUnsigned || isSigned) {
+        parser->signedEnd = end;
+        return emit(parser, isUnsigned ? EXPR_UNSIGNED : EXPR_SIGNED, 0, 0, 0);
+      }
+      return 0;
+    }
+  }
+
+  size_t constant = 0;
+  while (constant < CONSTANT_COUNT) {
+    if (strlen(constantNames[constant]) == length && memcmp(constantNames[constant], name, length) == 0) {
+      return emit(parser, EXPR_CONSTANT, constant, 0, 1);
+    }
+    constant++;
+  }
+  return fail(parser, "unknown name");
+}
+
+static int parsePrimary(struct Parser* parser) {
+  char c = peek(parser, 0);
+  if (c == '(') {
+    parser->position++;
+    if (parseLogical(parser) != 0) {
+      return -1;
+    }
+    if (peek(parser, 0) != ')') {
+      return fail(parser, "missing )");
+    }
+    parser->position++;
+    return 0;
+  }
+  if (c == '|') {
+    // |x| is the absolute value, the inside can't use | itself without brackets
+    parser->position++;
+    if (parseBitXor(parser) != 0) {
+      return -1;
+    }
+    if (peek(parser, 0) != '|') {
+      return fail(parser, "missing closing |");
+    }
+    parser->position++;
+    return emit(parser, EXPR_ABS, 0, 0, 0);
+  }
+  if (c >= '0' && c <= '9') {
+    return parseNumber(parser);
+  }
+  if (c == '@' || c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+    return parseName(parser);
+  }
+  if (c == '\0') {
+    return fail(parser, "expression ends early");
+  }
+  return fail(parser, "expected a value");
+}
+
+static int parseModifiers(struct Parser* parser) {
+  // one or more modifiers after an @, ex. @h, @ha, @l5, @u
+  const char* text = parser->text;
+  parser->position++;
+  size_t start = parser->position;
+  while (parser->position < parser->length) {
+    char c = text[parser->position];
+    __uint8_t code;
+    if (c == 'h' && parser->position + 1 < parser->length && text[parser->position + 1] == 'a') {
+      code = EXPR_HIGH_ADJUSTED;
+      parser->position++;
+    }
+    else if (c == 'h') {
+      code = EXPR_HIGH;
+    }
+    else if (c == 'l') {
+      code = EXPR_LOW;
+    }
+    else if (c == 'u') {
+      code = EXPR_UNSIGNED;
+    }
+    else if (c == 's') {
+      code = EXPR_SIGNED;
+    }
+    else {
+      break;
+    }
+    parser->position++;
+    // h and l can say how many bits they keep, ex. @l5
+    __uint32_t width = 0;
+    while ((code == EXPR_HIGH || code == EXPR_LOW) && parser->position < parser->length
+           && text[parser->position] >= '0' && text[parser->position] <= '9') {
+      width = width * 10 + (text[parser->position] - '0');
+      if (width > 128) {
+        return fail(parser, "modifier width is over 128 bits");
+      }
+      parser->position++;
+    }
+    if (emit(parser, code, width, 0, 0) != 0) {
+      return -1;
+    }
+  }
+  if (parser->position == start || (parser->position < parser->length && isNameCharacter(text[parser->position]))) {
+    return fail(parser, "unknown modifier");
+  }
+  return 0;
+}
+
+static int parsePostfix(struct Parser* parser) {
+  if (parsePrimary(parser) != 0) {
+    return -1;
+  }
+  while (parser->position < parser->length && parser->text[parser->position] == '@') {
+    if (parseModifiers(parser) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int parseUnary(struct Parser* parser) {
+  char c = peek(parser, 0);
+  if (c == '-' || c == '~') {
+    parser->position++;
+    if (parseUnary(parser) != 0) {
+      return -1;
+    }
+    return emit(parser, c == '-' ? EXPR_NEGATE : EXPR_NOT, 0, 0, 0);
+  }
+  if (c == '+') {
+    parser->position++;
+    return parseUnary(parser);
+  }
+  return parsePostfix(parser);
+}
+
+static int parseMultiplicative(struct Parser* parser) {
+  if (parseUnary(parser) != 0) {
+    return -1;
+  }
+  while (1) {
+    // Bh*C and Bhu*C ask for the high word of the product
+    __uint8_t high = parser->halfEnd != 0 && parser->position == parser->halfEnd;
+    char c = peek(parser, 0);
+    __uint8_t code;
+    if (c == '*') {
+      code = !high ? EXPR_MULTIPLY : parser->halfUnsigned ? EXPR_MULTIPLY_HIGH_UNSIGNED : EXPR_MULTIPLY_HIGH;
+    }
+    else if (c == '/') {
+      code = EXPR_DIVIDE;
+    }
+    else if (c == '%') {
+      code = EXPR_MODULO;
+    }
+    else {
+      return 0;
+    }
+    parser->position++;
+    if (parseUnary(parser) != 0 || emit(parser, code, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+}
+
+static int parseAdditive(struct Parser* parser) {
+  if (parseMultiplicative(parser) != 0) {
+    return -1;
+  }
+  while (1) {
+    char c = peek(parser, 0);
+    if (c != '+' && c != '-') {
+      return 0;
+    }
+    parser->position++;
+    if (parseMultiplicative(parser) != 0 || emit(parser, c == '+' ? EXPR_ADD : EXPR_SUBTRACT, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+}
+
+static int parseShift(struct Parser* parser) {
+  if (parseAdditive(parser) != 0) {
+    return -1;
+  }
+  while (1) {
+    __uint8_t afterSigned = parser->signedEnd != 0 && parser->position == parser->signedEnd;
+    char c = peek(parser, 0);
+    char next = peek(parser, 1);
+    __uint8_t code;
+    size_t width = 2;
+    if (c == '<' && next == '<') {
+      code = EXPR_SHIFT_LEFT;
+    }
+    else if (c == '>' && next == '>') {
+      code = EXPR_SHIFT_RIGHT;
+    }
+    else if (c == '>' && next != '=' && afterSigned) {
+      code = EXPR_SHIFT_RIGHT;
+      width = 1;
+    }
+    else {
+      return 0;
+    }
+    parser->position += width;
+    if (parseAdditive(parser) != 0 || emit(parser, code, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+}
+
+static int parseEquality(struct Parser* parser) {
+  if (parseShift(parser) != 0) {
+    return -1;
+  }
+  while (1) {
+    char c = peek(parser, 0);
+    if ((c != '=' && c != '!') || peek(parser, 1) != '=') {
+      return 0;
+    }
+    parser->position += 2;
+    if (parseShift(parser) != 0 || emit(parser, c == '=' ? EXPR_EQUAL : EXPR_NOT_EQUAL, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+}
+
+static int parseRelational(struct Parser* parser) {
+  if (parseEquality(parser) != 0) {
+    return -1;
+  }
+  while (1) {
+    char c = peek(parser, 0);
+    char next = peek(parser, 1);
+    if ((c != '<' && c != '>') || next == c) {
+      return 0;
+    }
+    __uint8_t orEqual = next == '=';
+    __uint8_t code = c == '<' ? (orEqual ? EXPR_LESS_EQUAL : EXPR_LESS) : (orEqual ? EXPR_GREATER_EQUAL : EXPR_GREATER);
+    parser->position += 1 + orEqual;
+    if (parseEquality(parser) != 0 || emit(parser, code, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+}
+
+static int parseBitAnd(struct Parser* parser) {
+  if (parseRelational(parser) != 0) {
+    return -1;
+  }
+  while (peek(parser, 0) == '&' && peek(parser, 1) != '&') {
+    parser->position++;
+    if (parseRelational(parser) != 0 || emit(parser, EXPR_AND, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int parseBitXor(struct Parser* parser) {
+  if (parseBitAnd(parser) != 0) {
+    return -1;
+  }
+  while (peek(parser, 0) == '^') {
+    parser->position++;
+    if (parseBitAnd(parser) != 0 || emit(parser, EXPR_XOR, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int parseBitOr(struct Parser* parser) {
+  if (parseBitXor(parser) != 0) {
+    return -1;
+  }
+  while (peek(parser, 0) == '|' && peek(parser, 1) != '|') {
+    parser->position++;
+    if (parseBitXor(parser) != 0 || emit(parser, EXPR_OR, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int parseNot(struct Parser* parser) {
+  if (peek(parser, 0) == '!' && peek(parser, 1) != '=') {
+    parser->position++;
+    if (parseNot(parser) != 0) {
+      return -1;
+    }
+    return emit(parser, EXPR_LOGICAL_NOT, 0, 0, 0);
+  }
+  return parseBitOr(parser);
+}
+
+static int parseLogical(struct Parser* parser) {
+  if (parseNot(parser) != 0) {
+    return -1;
+  }
+  while (1) {
+    char c = peek(parser, 0);
+    if ((c != '&' && c != '|') || peek(parser, 1) != c) {
+      return 0;
+    }
+    parser->position += 2;
+    if (parseNot(parser) != 0 || emit(parser, c == '&' ? EXPR_LOGICAL_AND : EXPR_LOGICAL_OR, 0, 0, -1) != 0) {
+      return -1;
+    }
+  }
+}
+
+int compileExpression(const char* text, size_t length, struct ExpressionCode* output, const char** error) {
+  // compile text (without the surrounding brackets) and append its ops to output
+  // returns 0 on success
+  // returns -1 if the expression isn't valid, error is set to what's wrong and output is left as it was
+  struct Parser parser;
+  memset(&parser, 0, sizeof(struct Parser));
+  parser.text = text;
+  parser.length = length;
+  parser.output = output;
+  size_t start = output->count;
+  if (parseLogical(&parser) == 0 && peek(&parser, 0) != '\0') {
+    fail(&parser, "unexpected character");
+  }
+  if (parser.error != NULL) {
+    output->count = start;
+    *error = parser.error;
+    return -1;
+  }
+  return 0;
+}
+
+// ########################  EVALUATING  ########################
+
+static __uint128_t bitMask(__uint32_t bits) {
+  if (bits == 0 || bits >= 128) {
+    return ~(__uint128_t) 0;
+  }
+  return ((__uint128_t) 1 << bits) - 1;
+}
+
+__int128_t maskToBits(__int128_t value, __uint32_t bits) {
+  // value as an unsigned number of the given width
+  return (__int128_t) ((__uint128_t) value & bitMask(bits));
+}
+
+static __int128_t signExtend(__int128_t value, __uint32_t bits) {
+  if (bits == 0 || bits >= 128) {
+    return value;
+  }
+  __uint32_t shift = 128 - bits;
+  return (__int128_t) ((__uint128_t) value << shift) >> shift;
+}
+
+static __int128_t shiftLeft(__int128_t value, __int128_t amount) {
+  return amount >= 128 ? 0 : (__int128_t) ((__uint128_t) value << amount);
+}
+
+static __int128_t shiftRight(__int128_t value, __int128_t amount) {
+  if (amount >= 128) {
+    return value < 0 ? -1 : 0;
+  }
+  return value >> amount;
+}
+
+static __int128_t constantValue(__uint8_t constant, __uint32_t bits) {
+  __uint32_t half = bits / 2;
+  switch (constant) {
+    case CONSTANT_BITS: return bits;
+    case CONSTANT_MSB: return bits < 1 ? 0 : (__int128_t) ((__uint128_t) 1 << (bits - 1));
+    case CONSTANT_SMSB: return bits < 2 ? 0 : (__int128_t) ((__uint128_t) 1 << (bits - 2));
+    case CONSTANT_MAX: return (__int128_t) bitMask(bits);
+    case CONSTANT_SMAX: return (__int128_t) bitMask(bits - 1);
+    case CONSTANT_UHALF: return (__int128_t) (bitMask(bits) & ~bitMask(half));
+    case CONSTANT_LHALF: return (__int128_t) bitMask(half);
+  }
+  return 0;
+}
+
+int evaluateExpression(const struct ExpressionOp* ops, size_t count, const struct ExpressionInput* input, __int128_t* output, const char** error) {
+  // run a compiled expression, the result isn't masked to @BITS (see maskToBits())
+  // returns 0 on success
+  // returns -1 if the expression can't be worked out for this input (ex. it uses a register, or divides by zero),
+  // error is set to what went wrong
+  __int128_t stack[EXPRESSION_STACK_SIZE];
+  size_t depth = 0;
+  __uint32_t bits = input->bits;
+  __uint32_t half = bits / 2;
+  size_t index = 0;
+  while (index < count) {
+    struct ExpressionOp op = ops[index];
+    index++;
+    // binary ops take their right side from the top of the stack and leave the result in place of the left side
+    __int128_t right = depth > 0 ? stack[depth - 1] : 0;
+    __int128_t* left = depth > 1 ? &stack[depth - 2] : NULL;
+    __int128_t* top = depth > 0 ? &stack[depth - 1] : NULL;
+    switch (op.code) {
+      case EXPR_NUMBER:
+        stack[depth] = op.value;
+        depth++;
+        break;
+      case EXPR_OPERAND:
+        if (!input->known[op.argument]) {
+          *error = "operand isn't an immediate";
+          return -1;
+        }
+        stack[depth] = input->operands[op.argument];
+        depth++;
+        break;
+      case EXPR_CONSTANT:
+        stack[depth] = constantValue(op.argument, bits);
+        depth++;
+        break;
+      case EXPR_NEGATE: *top = (__int128_t) (0 - (__uint128_t) *top); break;
+      case EXPR_NOT: *top = ~*top; break;
+      case EXPR_LOGICAL_NOT: *top = *top == 0; break;
+      case EXPR_ABS: *top = *top < 0 ? (__int128_t) (0 - (__uint128_t) *top) : *top; break;
+      case EXPR_HIGH: {
+        // the top half, or the top width bits of a @BITS wide word
+        __uint32_t width = op.argument == 0 ? half : op.argument;
+        *top = maskToBits(shiftRight(*top, op.argument == 0 ? half : width < bits ? bits - width : 0), width);
+        break;
+      }
+      case EXPR_LOW: *top = maskToBits(*top, op.argument == 0 ? half : op.argument); break;
+      case EXPR_HIGH_ADJUSTED:
+        // rounding by half of the low half makes up for the low half being added back as a signed number
+        if (half > 0) {
+          *top = maskToBits(shiftRight((__int128_t) ((__uint128_t) *top + ((__uint128_t) 1 << (half - 1))), half), half);
+        }
+        break;
+      case EXPR_UNSIGNED: *top = maskToBits(*top, bits); break;
+      case EXPR_SIGNED: *top = signExtend(*top, bits); break;
+      default:
+        depth--;
+        switch (op.code) {
+          case EXPR_ADD: *left = (__int128_t) ((__uint128_t) *left + (__uint128_t) right); break;
+          case EXPR_SUBTRACT: *left = (__int128_t) ((__uint128_t) *left - (__uint128_t) right); break;
+          case EXPR_MULTIPLY: *left = (__int128_t) ((__uint128_t) *left * (__uint128_t) right); break;
+          case EXPR_MULTIPLY_HIGH:
+            *left = shiftRight((__int128_t) ((__uint128_t) signExtend(*left, bits) * (__uint128_t) signExtend(right, bits)), bits);
+            break;
+          case EXPR_MULTIPLY_HIGH_UNSIGNED:
+            *left = shiftRight((__int128_t) ((__uint128_t) maskToBits(*left, bits) * (__uint128_t) maskToBits(right, bits)), bits);
+            break;
+          case EXPR_DIVIDE:
+          case EXPR_MODULO:
+            if (right == 0) {
+              *error = "division by zero";
+              return -1;
+            }
+            if (right == -1) {
+              // the one case where dividing overflows
+              *left = op.code == EXPR_DIVIDE ? (__int128_t) (0 - (__uint128_t) *left) : 0;
+            }
+            else {
+              *left = op.code == EXPR_DIVIDE ? *left / right : *left % right;
+            }
+            break;
+          case EXPR_SHIFT_LEFT:
+          case EXPR_SHIFT_RIGHT:
+            if (right < 0) {
+              *error = "negative shift amount";
+              return -1;
+            }
+            *left = op.code == EXPR_SHIFT_LEFT ? shiftLeft(*left, right) : shiftRight(*left, right);
+            break;
+          case EXPR_AND: *left &= right; break;
+          case EXPR_OR: *left |= right; break;
+          case EXPR_XOR: *left ^= right; break;
+          case EXPR_EQUAL: *left = *left == right; break;
+          case EXPR_NOT_EQUAL: *left = *left != right; break;
+          case EXPR_LESS: *left = *left < right; break;
+          case EXPR_GREATER: *left = *left > right; break;
+          case EXPR_LESS_EQUAL: *left = *left <= right; break;
+          case EXPR_GREATER_EQUAL: *left = *left >= right; break;
+          case EXPR_LOGICAL_AND: *left = *left != 0 && right != 0; break;
+          case EXPR_LOGICAL_OR: *left = *left != 0 || right != 0; break;
+        }
+        break;
+    }
+  }
+  *output = depth > 0 ? stack[depth - 1] : 0;
+  return 0;
+}
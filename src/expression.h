@@ -0,0 +1,53 @@
+/*
+ * expression.h: compiles and evaluates preprocessor expressions
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+// operands an expression can refer to (A, B and C)
+#define EXPRESSION_OPERANDS 3
+
+// one step of a compiled expression, expressions are stored in postfix order and run on a small value stack
+struct ExpressionOp {
+  __uint8_t code;
+  __uint8_t argument;  // operand number, bit width, or which @BITS constant, depending on the code
+  __uint64_t value;    // for numbers
+};
+
+// compiled expressions get appended to one of these, so a whole translation file's expressions share one array
+struct ExpressionCode {
+  struct ExpressionOp* ops;
+  size_t count;
+  size_t capacity;
+};
+
+struct ExpressionInput {
+  __int128_t operands[EXPRESSION_OPERANDS];
+  __uint8_t known[EXPRESSION_OPERANDS];  // if this is zero then the operand isn't a number (ex. a register or a label)
+  __uint32_t bits;                       // @BITS, used by the width dependent modifiers and constants
+};
+
+int compileExpression(const char* text, size_t length, struct ExpressionCode* output, const char** error);
+
+int evaluateExpression(const struct ExpressionOp* ops, size_t count, const struct ExpressionInput* input, __int128_t* output, const char** error);
+
+__int128_t maskToBits(__int128_t value, __uint32_t bits);
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * arena.c: Bump allocator, everything allocated from an arena is released together
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+
+// enough for __int128_t, which is the strictest alignment anything in the toolchain needs
+#define ARENA_ALIGNMENT 16
+// block header is padded so the data after it is aligned too
+#define ARENA_HEADER ((sizeof(struct ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1))
+
+static size_t alignSize(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+static char* blockData(struct ArenaBlock* block) {
+  return (char*) block + ARENA_HEADER;
+}
+
+struct Arena newArena(size_t blockSize) {
+  struct Arena arena;
+  arena.current = NULL;
+  arena.blockSize = blockSize;
+  return arena;
+}
+
+static void addBlock(struct Arena* arena, size_t minimumSize) {
+  size_t size = arena->blockSize;
+  if (minimumSize > size) {
+    // oversized allocations get a block to themselves
+    size = minimumSize;
+  }
+  struct ArenaBlock* block = malloc(ARENA_HEADER + size);
+  if (block == NULL) {
+    fprintf(stderr, "Error: out of memory while allocating a %lu byte arena block.\n", size);
+    exit(-1);
+  }
+  block->previous = arena->current;
+  block->size = size;
+  block->used = 0;
+  arena->current = block;
+}
+
+void* arenaAlloc(struct Arena* arena, size_t size) {
+  // never returns NULL, running out of memory is a fatal error
+  size = alignSize(size);
+  if (arena->current == NULL || arena->current->size - arena->current->used < size) {
+    addBlock(arena, size);
+  }
+  void* output = blockData(arena->current) + arena->current->used;
+  arena->current->used += size;
+  return output;
+}
+
+void* arenaGrow(struct Arena* arena, void* pointer, size_t oldSize, size_t newSize) {
+  // resize an allocation, this happens in place if it was the last thing allocated and there's room left in its block
+  if (pointer == NULL) {
+    return arenaAlloc(arena, newSize);
+  }
+  struct ArenaBlock* block = arena->current;
+  size_t oldAligned = alignSize(oldSize);
+  size_t newAligned = alignSize(newSize);
+  if ((char*) pointer + oldAligned == blockData(block) + block->used && block->used - oldAligned + newAligned <= block->size) {
+    block->used = block->used - oldAligned + newAligned;
+    return pointer;
+  }
+  void* output = arenaAlloc(arena, newSize);
+  memcpy(output, pointer, oldSize < newSize ? oldSize : newSize);
+  return output;
+}
+
+char* arenaCopyString(struct Arena* arena, const char* string, size_t length) {
+  // copy length characters of string into the arena and null terminate them
+  char* output = arenaAlloc(arena, length + 1);
+  memcpy(output, string, length);
+  output[length] = '\0';
+  return output;
+}
+
+void arenaFree(struct Arena* arena) {
+  struct ArenaBlock* block = arena->current;
+  while (block != NULL) {
+    struct ArenaBlock* previous = block->previous;
+    free(block);
+    block = previous;
+  }
+  arena->current = NULL;
+}
+
+void* checkedCalloc(size_t count, size_t size, const char* task) {
+  // zeroed heap memory for count items (with one spare so zero counts still get a pointer), exits if there's none
+  // task finishes the error message, as in "out of memory while <task>"
+  void* pointer = calloc(count + 1, size);
+  if (pointer == NULL) {
+    fprintf(stderr, "Error: out of memory while %s.\n", task);
+    exit(-1);
+  }
+  return pointer;
+}
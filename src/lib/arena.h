@@ -0,0 +1,47 @@
+/*
+ * arena.h: Bump allocator, everything allocated from an arena is released together
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct ArenaBlock {
+  struct ArenaBlock* previous;
+  size_t size;
+  size_t used;
+};
+
+struct Arena {
+  struct ArenaBlock* current;
+  size_t blockSize;
+};
+
+struct Arena newArena(size_t blockSize);
+
+void* arenaAlloc(struct Arena* arena, size_t size);
+
+void* arenaGrow(struct Arena* arena, void* pointer, size_t oldSize, size_t newSize);
+
+char* arenaCopyString(struct Arena* arena, const char* string, size_t length);
+
+void arenaFree(struct Arena* arena);
+
+// not from an arena, free() it as usual
+void* checkedCalloc(size_t count, size_t size, const char* task);
+
+#endif
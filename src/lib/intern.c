@@ -0,0 +1,202 @@
+/*
+ * intern.c: String interning, maps every distinct spelling to a small integer atom
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "intern.h"
+#include "arena.h"
+
+#define INTERN_INITIAL_CAPACITY 256
+#define INTERN_ARENA_BLOCK_SIZE 65536
+
+static __uint64_t hashText(const char* text, size_t length) {
+  // 64 bit FNV-1a
+  __uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t index = 0;
+  while (index < length) {
+    hash ^= (unsigned char) text[index];
+    hash *= 0x100000001b3ULL;
+    index++;
+  }
+  if (hash == 0) {
+    hash = 1;
+  }
+  return hash;
+}
+
+static void* checkedRealloc(void* pointer, size_t size) {
+  void* output = realloc(pointer, size);
+  if (output == NULL) {
+    fprintf(stderr, "Error: out of memory while interning strings.\n");
+    exit(-1);
+  }
+  return output;
+}
+
+struct InternTable newInternTable() {
+  struct InternTable table;
+  table.arena = newArena(INTERN_ARENA_BLOCK_SIZE);
+  table.capacity = INTERN_INITIAL_CAPACITY;
+  table.strings = checkedRealloc(NULL, table.capacity * sizeof(char*));
+  table.lengths = checkedRealloc(NULL, table.capacity * sizeof(__uint32_t));
+  table.upper = checkedRealloc(NULL, table.capacity * sizeof(Atom));
+  // atom 0 is the empty "no atom" entry
+  table.strings[0] = "";
+  table.lengths[0] = 0;
+  table.upper[0] = 0;
+  table.count = 1;
+
+  table.slotCapacity = INTERN_INITIAL_CAPACITY * 2;
+  table.slots = calloc(table.slotCapacity, sizeof(Atom));
+  table.hashes = calloc(table.slotCapacity, sizeof(__uint64_t));
+  if (table.slots == NULL || table.hashes == NULL) {
+    fprintf(stderr, "Error: out of memory while interning strings.\n");
+    exit(-1);
+  }
+  return table;
+}
+
+static size_t findSlot(struct InternTable* table, const char* text, size_t length, __uint64_t hash) {
+  size_t mask = table->slotCapacity - 1;
+  size_t index = hash & mask;
+  while (table->slots[index] != 0) {
+    Atom atom = table->slots[index];
+    if (table->hashes[index] == hash && table->lengths[atom] == length && memcmp(table->strings[atom], text, length) == 0) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+static void growSlots(struct InternTable* table) {
+  Atom* oldSlots = table->slots;
+  __uint64_t* oldHashes = table->hashes;
+  size_t oldCapacity = table->slotCapacity;
+
+  table->slotCapacity *= 2;
+  table->slots = calloc(table->slotCapacity, sizeof(Atom));
+  table->hashes = calloc(table->slotCapacity, sizeof(__uint64_t));
+  if (table->slots == NULL || table->hashes == NULL) {
+    fprintf(stderr, "Error: out of memory while interning strings.\n");
+    exit(-1);
+  }
+  size_t mask = table->slotCapacity - 1;
+  size_t index = 0;
+  while (index < oldCapacity) {
+    if (oldSlots[index] != 0) {
+      size_t slot = oldHashes[index] & mask;
+      while (table->slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+      }
+      table->slots[slot] = oldSlots[index];
+      table->hashes[slot] = oldHashes[index];
+    }
+    index++;
+  }
+  free(oldSlots);
+  free(oldHashes);
+}
+
+Atom intern(struct InternTable* table, const char* text, size_t length) {
+  // get the atom for text, adding it to the table if this is the first time it's been seen
+  __uint64_t hash = hashText(text, length);
+  size_t slot = findSlot(table, text, length, hash);
+  if (table->slots[slot] != 0) {
+    return table->slots[slot];
+  }
+
+  if (table->count == table->capacity) {
+    table->capacity *= 2;
+    table->strings = checkedRealloc(table->strings, table->capacity * sizeof(char*));
+    table->lengths = checkedRealloc(table->lengths, table->capacity * sizeof(__uint32_t));
+    table->upper = checkedRealloc(table->upper, table->capacity * sizeof(Atom));
+  }
+  Atom atom = table->count;
+  table->strings[atom] = arenaCopyString(&table->arena, text, length);
+  table->lengths[atom] = length;
+  table->upper[atom] = 0;
+  table->count++;
+
+  table->slots[slot] = atom;
+  table->hashes[slot] = hash;
+  // keep the index at most half full
+  if (table->count * 2 > table->slotCapacity) {
+    growSlots(table);
+  }
+  return atom;
+}
+
+Atom findAtom(struct InternTable* table, const char* text, size_t length) {
+  // like intern(), but returns 0 instead of adding text if it isn't in the table yet
+  size_t slot = findSlot(table, text, length, hashText(text, length));
+  return table->slots[slot];
+}
+
+Atom upperAtom(struct InternTable* table, Atom atom) {
+  // get the atom for the uppercase version of a spelling, used for case insensitive keywords
+  // the result is remembered, so after the first call this is just an array lookup
+  if (table->upper[atom] != 0 || atom == 0) {
+    return table->upper[atom];
+  }
+  size_t length = table->lengths[atom];
+  char* spelling = table->strings[atom];
+  size_t index = 0;
+  while (index < length && !(spelling[index] >= 'a' && spelling[index] <= 'z')) {
+    index++;
+  }
+  Atom output = atom;
+  if (index < length) {
+    char* capitalized = malloc(length * sizeof(char));
+    memcpy(capitalized, spelling, length);
+    while (index < length) {
+      if (capitalized[index] >= 'a' && capitalized[index] <= 'z') {
+        capitalized[index] = capitalized[index] - 'a' + 'A';
+      }
+      index++;
+    }
+    output = intern(table, capitalized, length);
+    free(capitalized);
+  }
+  // intern() may have moved the lists, so index them again
+  table->upper[atom] = output;
+  table->upper[output] = output;
+  return output;
+}
+
+const char* atomString(struct InternTable* table, Atom atom) {
+  return table->strings[atom];
+}
+
+size_t atomLength(struct InternTable* table, Atom atom) {
+  return table->lengths[atom];
+}
+
+void freeInternTable(struct InternTable* table) {
+  free(table->strings);
+  free(table->lengths);
+  free(table->upper);
+  free(table->slots);
+  free(table->hashes);
+  arenaFree(&table->arena);
+  table->count = 0;
+  table->capacity = 0;
+  table->slotCapacity = 0;
+}
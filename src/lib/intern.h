@@ -0,0 +1,55 @@
+/*
+ * intern.h: String interning, maps every distinct spelling to a small integer atom
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+#include "arena.h"
+
+// atom 0 is never handed out, it means "no atom"
+typedef __uint32_t Atom;
+
+struct InternTable {
+  struct Arena arena;    // spellings
+  char** strings;        // atom -> null terminated spelling
+  __uint32_t* lengths;   // atom -> spelling length
+  Atom* upper;           // atom -> atom of the uppercase spelling, 0 until first asked for
+  size_t count;          // number of atoms handed out, including atom 0
+  size_t capacity;
+  Atom* slots;           // hash index, 0 marks an empty slot
+  __uint64_t* hashes;
+  size_t slotCapacity;   // always a power of two
+};
+
+struct InternTable newInternTable();
+
+Atom intern(struct InternTable* table, const char* text, size_t length);
+
+Atom findAtom(struct InternTable* table, const char* text, size_t length);
+
+Atom upperAtom(struct InternTable* table, Atom atom);
+
+const char* atomString(struct InternTable* table, Atom atom);
+
+size_t atomLength(struct InternTable* table, Atom atom);
+
+void freeInternTable(struct InternTable* table);
+
+#endif
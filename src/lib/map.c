@@ -21,88 +21,130 @@
 #include <stdio.h>
 #include <string.h>
 
-typedef struct Map {
-  char** keys;
-  char** values;
-  size_t length;
-  size_t size;
-} Map;
-
-// create a new map with empty lists (map constructor)
-struct Map empty_map() {
-  struct Map map;
-  map.size = sizeof(char*);
-  map.keys = malloc(map.size);
-  map.values = malloc(map.size);
-  map.length = 0;
-  return map;
+#include "map.h"
+
+// open addressing hash map with linear probing
+// capacity is always a power of two so the probe position is just hash & (capacity - 1),
+// and a hash of 0 marks an empty slot
+
+#define MAP_INITIAL_CAPACITY 16
+
+static __uint64_t hashKey(char* key) {
+  // 64 bit FNV-1a
+  __uint64_t hash = 0xcbf29ce484222325ULL;
+  while (*key != '\0') {
+    hash ^= (unsigned char) *key;
+    hash *= 0x100000001b3ULL;
+    key++;
+  }
+  if (hash == 0) {
+    hash = 1;
+  }
+  return hash;
 }
 
-// create a new map from two input strings (map constructor)
-/*
-struct Map full_map(char* keys, char* values) {
-  struct Map map;
-  if (strlen(keys) != strlen(values)) {
-    map.keys = 0;
-    map.values = 0;
-    return map;
+static int allocateSlots(struct Map* map, size_t capacity) {
+  map->keys = calloc(capacity, sizeof(char*));
+  map->values = calloc(capacity, sizeof(char*));
+  map->hashes = calloc(capacity, sizeof(__uint64_t));
+  if (map->keys == NULL || map->values == NULL || map->hashes == NULL) {
+    printf("Error while allocating memory for map!\n");
+    return -1;
   }
+  map->capacity = capacity;
+  return 0;
+}
 
-  map.keys = malloc((strlen(keys) + 1) * map->size);
-  map.values = malloc((strlen(values) + 1) * map->size);
+// find the slot holding key, or the empty slot it would go in
+static size_t findSlot(struct Map* map, char* key, __uint64_t hash) {
+  size_t mask = map->capacity - 1;
+  size_t index = hash & mask;
+  while (map->hashes[index] != 0) {
+    if (map->hashes[index] == hash && strcmp(key, map->keys[index]) == 0) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+  return index;
+}
 
-  size_t len = strlen(keys);
+static int growMap(struct Map* map) {
+  char** oldKeys = map->keys;
+  char** oldValues = map->values;
+  __uint64_t* oldHashes = map->hashes;
+  size_t oldCapacity = map->capacity;
 
+  if (allocateSlots(map, oldCapacity * 2) != 0) {
+    return -1;
+  }
   size_t index = 0;
-  while (index < len) {
-    map.keys[index] = keys[index];
-    map.values[index] = values[index];
+  while (index < oldCapacity) {
+    if (oldHashes[index] != 0) {
+      size_t slot = oldHashes[index] & (map->capacity - 1);
+      while (map->hashes[slot] != 0) {
+        slot = (slot + 1) & (map->capacity - 1);
+      }
+      map->keys[slot] = oldKeys[index];
+      map->values[slot] = oldValues[index];
+      map->hashes[slot] = oldHashes[index];
+    }
     index++;
   }
-  // null terminator will be copied over in the loop
-  return map;
+  free(oldKeys);
+  free(oldValues);
+  free(oldHashes);
+  return 0;
 }
-*/
 
+// create a new empty map (map constructor)
+struct Map empty_map() {
+  struct Map map;
+  map.length = 0;
+  if (allocateSlots(&map, MAP_INITIAL_CAPACITY) != 0) {
+    map.capacity = 0;
+  }
+  return map;
+}
 
 // get value (input key)
 int mapGet(struct Map* map, char* key, char** output) {
   // returns 0 on success
   // returns -1 if key-value pair does not exist in map
-  unsigned long index = 0;
-  while (index < map->length) {
-    int result = strcmp(key, map->keys[index]);
-    if (result == 0) {
-      *output = map->values[index];
-      return 0;
-    }
-    index++;
+  if (map->capacity == 0) {
+    return -1;
+  }
+  size_t slot = findSlot(map, key, hashKey(key));
+  if (map->hashes[slot] == 0) {
+    return -1;
   }
-  return -1;
+  *output = map->values[slot];
+  return 0;
 }
 
 // add key-value pair (input new key and new value)
 int mapAdd(struct Map* map, char* key, char* value) {
   // returns 0 on success
   // returns -1 if key-value pair already exists in map
-  char* temp;
-  if (mapGet(map, key, &temp) == 0) {
-    printf("Key \"%s\" already exists!\n", key);
-    return -1;
+  if (map->capacity == 0) {
+    if (allocateSlots(map, MAP_INITIAL_CAPACITY) != 0) {
+      return -1;
+    }
   }
-  
-  map->keys = realloc(map->keys, (map->length + 1) * map->size); // map_len + 1 accounts for the value to be added
-  if (map->keys == 0) {
-    printf("Error while reallocating memory for keys string!\n");
-    return -1;
+  // keep the load factor under 3/4 so probe sequences stay short
+  if ((map->length + 1) * 4 > map->capacity * 3) {
+    if (growMap(map) != 0) {
+      return -1;
+    }
   }
-  map->keys[map->length] = key; // add key to keys
-  map->values = realloc(map->values, (map->length + 1) * map->size);
-  if (map->keys == 0) {
-    printf("Error while reallocating memory for values string!\n");
+  __uint64_t hash = hashKey(key);
+  size_t slot = findSlot(map, key, hash);
+  if (map->hashes[slot] != 0) {
+    printf("Key \"%s\" already exists!\n", key);
     return -1;
   }
-  map->values[map->length] = value;
+  map->keys[slot] = key;
+  map->values[slot] = value;
+  map->hashes[slot] = hash;
   map->length++;
   return 0;
 }
@@ -111,62 +153,70 @@ int mapAdd(struct Map* map, char* key, char* value) {
 int mapUpdate(struct Map* map, char* key, char* value) {
   // returns 0 on success
   // returns -1 if key-value pair does not exist in map
-  unsigned long index = 0;
-  while (index < map->length) {
-    if (map->keys[index] == key) {
-      map->values[index] = value;
-      return 0;
-    }
-    index++;
+  if (map->capacity == 0) {
+    return -1;
   }
-  return -1;
+  size_t slot = findSlot(map, key, hashKey(key));
+  if (map->hashes[slot] == 0) {
+    return -1;
+  }
+  map->values[slot] = value;
+  return 0;
 }
 
 // remove key-value pair (input key to remove)
 int mapDelete(struct Map* map, char* key) {
   // returns 0 on success
   // returns -1 if key-value pair does not exist in map
-  unsigned long index = 0;
-  while (index < map->length) {
-    int result = strcmp(key, map->keys[index]);
-    if (result != 0) {
-      index++;
-      continue;
-    }
-    // overwrite the entry at index with the last entry in the map
-    map->keys[index] = map->keys[map->length];
-    map->values[index] = map->values[map->length];
-    // overwrite the duplicate entry at the end of the map with a null terminator
-    map->keys[map->length] = 0;
-    map->values[map->length] = 0;
-    // shrink allocated memory size for string
-    // original strlen will point to the last character of the original string, which is where the new null terminator will go,
-    // therefore no pointer math is needed for malloc
-    map->keys = realloc(map->keys, map->length * map->size);
-    if (map->keys == 0) {
-      printf("Error while reallocating memory for keys string!\n");
-      return -1;
-    }
-    map->values = realloc(map->values, map->length * map->size);
-    if (map->keys == 0) {
-      printf("Error while reallocating memory for values string!\n");
-      return -1;
+  if (map->capacity == 0) {
+    return -1;
+  }
+  size_t mask = map->capacity - 1;
+  size_t slot = findSlot(map, key, hashKey(key));
+  if (map->hashes[slot] == 0) {
+    return -1;
+  }
+  // backward shift deletion: pull later entries of the probe chain into the hole so no tombstones are needed
+  size_t next = (slot + 1) & mask;
+  while (map->hashes[next] != 0) {
+    size_t home = map->hashes[next] & mask;
+    // move the entry if the hole lies between its home slot and where it currently is
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      map->keys[slot] = map->keys[next];
+      map->values[slot] = map->values[next];
+      map->hashes[slot] = map->hashes[next];
+      slot = next;
     }
-    map->length--;
-    return 0;
+    next = (next + 1) & mask;
   }
-  return -1;
+  map->keys[slot] = NULL;
+  map->values[slot] = NULL;
+  map->hashes[slot] = 0;
+  map->length--;
+  return 0;
 }
 
 void mapKill(Map* map) {
   // free all memory associated with a map
   size_t index = 0;
-  while (index < map->length) {
-    free(map->keys[index]);
-    free(map->values[index]);
+  while (index < map->capacity) {
+    if (map->hashes[index] != 0) {
+      free(map->keys[index]);
+      free(map->values[index]);
+    }
     index++;
   }
+  mapFree(map);
+}
+
+void mapFree(Map* map) {
+  // free the map's own lists, but not the keys and values they point to
   free(map->keys);
   free(map->values);
+  free(map->hashes);
+  map->keys = NULL;
+  map->values = NULL;
+  map->hashes = NULL;
   map->length = 0;
+  map->capacity = 0;
 }
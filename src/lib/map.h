@@ -20,12 +20,15 @@
 #ifndef MAP_H
 #define MAP_H
 #include <stddef.h>
+#include <bits/types.h>
 
+// keys, values and hashes are parallel lists of capacity slots, a slot is empty when its hash is 0
 typedef struct Map {
   char** keys;
   char** values;
-  size_t length;
-  size_t size;
+  __uint64_t* hashes;
+  size_t length;    // number of key-value pairs
+  size_t capacity;  // number of slots, always a power of two
 } Map;
 
 struct Map empty_map();
@@ -42,4 +45,6 @@ int mapDelete(struct Map* map, char* key);
 
 void mapKill(Map* map);
 
+void mapFree(Map* map);
+
 #endif
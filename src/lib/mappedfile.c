@@ -0,0 +1,108 @@
+/*
+ * mappedfile.c: read-only memory mapped files, with a buffered fallback for pipes and other unmappable inputs
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mappedfile.h"
+
+static int readWholeFile(int fd, struct MappedFile* output) {
+  // fallback for files that can't be mapped, read in big blocks and double the buffer as needed
+  size_t capacity = 65536;
+  size_t length = 0;
+  char* buffer = malloc(capacity);
+  if (buffer == NULL) {
+    return -1;
+  }
+  while (1) {
+    if (length == capacity) {
+      capacity *= 2;
+      char* temp = realloc(buffer, capacity);
+      if (temp == NULL) {
+        free(buffer);
+        return -1;
+      }
+      buffer = temp;
+    }
+    ssize_t count = read(fd, buffer + length, capacity - length);
+    if (count < 0) {
+      free(buffer);
+      return -1;
+    }
+    if (count == 0) {
+      break;
+    }
+    length += count;
+  }
+  output->data = buffer;
+  output->length = length;
+  output->isMapped = 0;
+  return 0;
+}
+
+int mapFile(char* path, struct MappedFile* output) {
+  // returns 0 on success
+  // returns -1 if the file could not be opened or read, errno is left set by the failing call
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  // mmap can't map empty files or things like pipes, read those normally
+  if (!S_ISREG(info.st_mode) || info.st_size == 0) {
+    int result = readWholeFile(fd, output);
+    close(fd);
+    return result;
+  }
+
+  void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    int result = readWholeFile(fd, output);
+    close(fd);
+    return result;
+  }
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  // source is scanned front to back, let the kernel read ahead aggressively
+  madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+  output->data = data;
+  output->length = info.st_size;
+  output->isMapped = 1;
+  return 0;
+}
+
+void unmapFile(struct MappedFile* file) {
+  if (file->isMapped) {
+    munmap((void*) file->data, file->length);
+  }
+  else {
+    free((void*) file->data);
+  }
+  file->data = NULL;
+  file->length = 0;
+}
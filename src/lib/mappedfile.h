@@ -0,0 +1,33 @@
+/*
+ * mappedfile.h: read-only memory mapped files, with a buffered fallback for pipes and other unmappable inputs
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+
+struct MappedFile {
+  const char* data;  // file contents, NOT null terminated
+  size_t length;
+  unsigned char isMapped;  // if this is zero then data was read into a heap buffer instead
+};
+
+int mapFile(char* path, struct MappedFile* output);
+
+void unmapFile(struct MappedFile* file);
+
+#endif
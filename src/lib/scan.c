@@ -0,0 +1,182 @@
+/*
+ * scan.c: vectorized searches for the next interesting byte in a buffer, the widest version the cpu supports is picked at runtime
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+struct ByteSet newByteSet(const char* bytes) {
+  // build a set from a null terminated list of up to BYTESET_MAX bytes
+  struct ByteSet set;
+  size_t count = strlen(bytes);
+  if (count == 0 || count > BYTESET_MAX) {
+    fprintf(stderr, "Error: byte sets need between 1 and %d bytes, got %lu.\n", BYTESET_MAX, count);
+    exit(-1);
+  }
+  memset(set.table, 0, sizeof(set.table));
+  size_t index = 0;
+  while (index < BYTESET_MAX) {
+    unsigned char c = (unsigned char) (index < count ? bytes[index] : bytes[0]);
+    set.bytes[index] = c;
+    set.table[c] = 1;
+    index++;
+  }
+  return set;
+}
+
+// ##########################  SCALAR  ##########################
+
+static size_t scanAnyScalar(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  while (index < end && !set->table[(unsigned char) data[index]]) {
+    index++;
+  }
+  return index;
+}
+
+static size_t scanNotAnyScalar(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  while (index < end && set->table[(unsigned char) data[index]]) {
+    index++;
+  }
+  return index;
+}
+
+// ###########################  X86  ############################
+
+#ifdef SCAN_X86
+
+// invert flips the match mask, so the same loop finds the first byte in or not in the set
+__attribute__((target("sse2")))
+static inline size_t scanSSE2(const char* data, size_t index, size_t end, const struct ByteSet* set, unsigned int invert) {
+  __m128i bytes[BYTESET_MAX];
+  for (int byte = 0; byte < BYTESET_MAX; byte++) {
+    bytes[byte] = _mm_set1_epi8((char) set->bytes[byte]);
+  }
+  while (index + 16 <= end) {
+    __m128i block = _mm_loadu_si128((const __m128i*) (data + index));
+    __m128i hits = _mm_cmpeq_epi8(block, bytes[0]);
+    for (int byte = 1; byte < BYTESET_MAX; byte++) {
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, bytes[byte]));
+    }
+    unsigned int mask = ((unsigned int) _mm_movemask_epi8(hits) ^ invert) & 0xFFFF;
+    if (mask != 0) {
+      return index + __builtin_ctz(mask);
+    }
+    index += 16;
+  }
+  return invert ? scanNotAnyScalar(data, index, end, set) : scanAnyScalar(data, index, end, set);
+}
+
+__attribute__((target("avx2")))
+static inline size_t scanAVX2(const char* data, size_t index, size_t end, const struct ByteSet* set, unsigned int invert) {
+  __m256i bytes[BYTESET_MAX];
+  for (int byte = 0; byte < BYTESET_MAX; byte++) {
+    bytes[byte] = _mm256_set1_epi8((char) set->bytes[byte]);
+  }
+  while (index + 32 <= end) {
+    __m256i block = _mm256_loadu_si256((const __m256i*) (data + index));
+    __m256i hits = _mm256_cmpeq_epi8(block, bytes[0]);
+    for (int byte = 1; byte < BYTESET_MAX; byte++) {
+      hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, bytes[byte]));
+    }
+    unsigned int mask = (unsigned int) _mm256_movemask_epi8(hits) ^ invert;
+    if (mask != 0) {
+      return index + __builtin_ctz(mask);
+    }
+    index += 32;
+  }
+  return invert ? scanNotAnyScalar(data, index, end, set) : scanAnyScalar(data, index, end, set);
+}
+
+__attribute__((target("sse2")))
+static size_t scanAnySSE2(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  return scanSSE2(data, index, end, set, 0);
+}
+
+__attribute__((target("sse2")))
+static size_t scanNotAnySSE2(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  return scanSSE2(data, index, end, set, 0xFFFFFFFF);
+}
+
+__attribute__((target("avx2")))
+static size_t scanAnyAVX2(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  return scanAVX2(data, index, end, set, 0);
+}
+
+__attribute__((target("avx2")))
+static size_t scanNotAnyAVX2(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  return scanAVX2(data, index, end, set, 0xFFFFFFFF);
+}
+
+#endif
+
+// #########################  DISPATCH  #########################
+
+typedef size_t (*ScanFunction)(const char* data, size_t index, size_t end, const struct ByteSet* set);
+
+static size_t resolveScanAny(const char* data, size_t index, size_t end, const struct ByteSet* set);
+static size_t resolveScanNotAny(const char* data, size_t index, size_t end, const struct ByteSet* set);
+
+// both start out pointing at a resolver that picks the real scanner on first use
+// (several threads can race to resolve, they all store the same answer)
+static ScanFunction scanAnyFunction = resolveScanAny;
+static ScanFunction scanNotAnyFunction = resolveScanNotAny;
+
+static void pickScanners() {
+  ScanFunction any = scanAnyScalar;
+  ScanFunction notAny = scanNotAnyScalar;
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    any = scanAnyAVX2;
+    notAny = scanNotAnyAVX2;
+  }
+  else if (__builtin_cpu_supports("sse2")) {
+    any = scanAnySSE2;
+    notAny = scanNotAnySSE2;
+  }
+#endif
+  __atomic_store_n(&scanAnyFunction, any, __ATOMIC_RELAXED);
+  __atomic_store_n(&scanNotAnyFunction, notAny, __ATOMIC_RELAXED);
+}
+
+static size_t resolveScanAny(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  pickScanners();
+  return scanAnyVector(data, index, end, set);
+}
+
+static size_t resolveScanNotAny(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  pickScanners();
+  return scanNotAnyVector(data, index, end, set);
+}
+
+size_t scanAnyVector(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  // scanAny() for longer runs
+  return __atomic_load_n(&scanAnyFunction, __ATOMIC_RELAXED)(data, index, end, set);
+}
+
+size_t scanNotAnyVector(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  // scanNotAny() for longer runs
+  return __atomic_load_n(&scanNotAnyFunction, __ATOMIC_RELAXED)(data, index, end, set);
+}
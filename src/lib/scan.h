@@ -0,0 +1,66 @@
+/*
+ * scan.h: vectorized searches for the next interesting byte in a buffer
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+#define BYTESET_MAX 8
+
+// small set of bytes to search for, built once with newByteSet() and reused
+struct ByteSet {
+  unsigned char bytes[BYTESET_MAX];  // unused slots repeat the first byte so the vector compares can always test all of them
+  __uint8_t table[256];              // 1 for every byte in the set, used by the scalar scanner and for leftover bytes
+};
+
+struct ByteSet newByteSet(const char* bytes);
+
+size_t scanAnyVector(const char* data, size_t index, size_t end, const struct ByteSet* set);
+
+size_t scanNotAnyVector(const char* data, size_t index, size_t end, const struct ByteSet* set);
+
+// most runs in urcl are only a few bytes long, so the first few bytes are checked inline
+// before paying for a call into the vector scanner
+#define SCAN_INLINE_BYTES 8
+
+static inline size_t scanAny(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  // index of the first byte in [index, end) that is in set, or end if there isn't one
+  size_t stop = index + SCAN_INLINE_BYTES < end ? index + SCAN_INLINE_BYTES : end;
+  while (index < stop) {
+    if (set->table[(unsigned char) data[index]]) {
+      return index;
+    }
+    index++;
+  }
+  return index < end ? scanAnyVector(data, index, end, set) : end;
+}
+
+static inline size_t scanNotAny(const char* data, size_t index, size_t end, const struct ByteSet* set) {
+  // index of the first byte in [index, end) that is not in set, or end if there isn't one
+  size_t stop = index + SCAN_INLINE_BYTES < end ? index + SCAN_INLINE_BYTES : end;
+  while (index < stop) {
+    if (!set->table[(unsigned char) data[index]]) {
+      return index;
+    }
+    index++;
+  }
+  return index < end ? scanNotAnyVector(data, index, end, set) : end;
+}
+
+#endif
@@ -20,16 +20,129 @@
 #include <string.h>
 #include <stdio.h>
 #include "stack.h"
+#include "stringutils.h"
+
+// #######################  STRING BUILDER  #######################
+
+struct StringBuilder newStringBuilder(size_t capacity) {
+  // capacity doesn't include the null terminator
+  struct StringBuilder builder;
+  builder.capacity = capacity < 15 ? 15 : capacity;
+  builder.data = malloc((builder.capacity + 1) * sizeof(char));
+  builder.data[0] = '\0';
+  builder.length = 0;
+  return builder;
+}
 
-char* append(char* base, char c) {
-  __uint64_t length = strlen(base);
-  char* output = malloc((length + 2) * sizeof(char)); // 1 extra byte for new char and 1 extra for null terminator
-  strcpy(output, base);
-  output[length] = c;
-  output[length + 1] = '\0';
+void builderReserve(struct StringBuilder* builder, size_t extra) {
+  // make room for extra more characters, doubling so that repeated appends stay linear overall
+  if (builder->length + extra <= builder->capacity) {
+    return;
+  }
+  size_t newCapacity = builder->capacity * 2;
+  if (newCapacity < builder->length + extra) {
+    newCapacity = builder->length + extra;
+  }
+  builder->data = realloc(builder->data, (newCapacity + 1) * sizeof(char));
+  builder->capacity = newCapacity;
+}
+
+void builderAppend(struct StringBuilder* builder, const char* text, size_t length) {
+  builderReserve(builder, length);
+  memcpy(builder->data + builder->length, text, length);
+  builder->length += length;
+  builder->data[builder->length] = '\0';
+}
+
+void builderAppendChar(struct StringBuilder* builder, char c) {
+  builderReserve(builder, 1);
+  builder->data[builder->length] = c;
+  builder->length++;
+  builder->data[builder->length] = '\0';
+}
+
+void builderAppendUnsigned(struct StringBuilder* builder, __uint64_t value) {
+  // append value in decimal
+  char digits[20];
+  size_t digitCount = 0;
+  do {
+    digits[digitCount] = (char) (value % 10) + '0';
+    value /= 10;
+    digitCount++;
+  } while (value > 0);
+  builderReserve(builder, digitCount);
+  while (digitCount > 0) {
+    digitCount--;
+    builder->data[builder->length] = digits[digitCount];
+    builder->length++;
+  }
+  builder->data[builder->length] = '\0';
+}
+
+int builderReplace(struct StringBuilder* builder, size_t start, size_t end, const char* text, size_t length) {
+  // replace the characters from start up to but not including end with text, in place
+  // returns 0 on success
+  // returns -1 if the range is out of bounds
+  if (start > end || end > builder->length) {
+    return -1;
+  }
+  if (length > end - start) {
+    builderReserve(builder, length - (end - start));
+  }
+  // move the tail (and its null terminator) to where it ends up, then drop text into the gap
+  memmove(builder->data + start + length, builder->data + end, builder->length - end + 1);
+  memcpy(builder->data + start, text, length);
+  builder->length = builder->length - (end - start) + length;
+  return 0;
+}
+
+int builderInsert(struct StringBuilder* builder, size_t index, const char* text, size_t length) {
+  // returns 0 on success
+  // returns -1 if index is past the end of the string
+  return builderReplace(builder, index, index, text, length);
+}
+
+int builderDelete(struct StringBuilder* builder, size_t start, size_t end) {
+  // remove the characters from start up to but not including end
+  // returns 0 on success
+  // returns -1 if the range is out of bounds
+  return builderReplace(builder, start, end, "", 0);
+}
+
+char* builderFinish(struct StringBuilder* builder) {
+  // hand the finished string over to the caller, who frees it
+  char* output = builder->data;
+  builder->data = NULL;
+  builder->length = 0;
+  builder->capacity = 0;
   return output;
 }
 
+void freeStringBuilder(struct StringBuilder* builder) {
+  free(builder->data);
+  builder->data = NULL;
+  builder->length = 0;
+  builder->capacity = 0;
+}
+
+// #######################  STRING HELPERS  #######################
+
+// the helpers below return new strings and keep their old inclusive [start, end] ranges,
+// they're thin wrappers over the builder now so none of them copy more than once
+
+static struct StringBuilder builderFrom(const char* text, size_t extra) {
+  size_t length = strlen(text);
+  struct StringBuilder builder = newStringBuilder(length + extra);
+  builderAppend(&builder, text, length);
+  return builder;
+}
+
+char* append(char* base, char c) {
+  struct StringBuilder builder = builderFrom(base, 1);
+  builderAppendChar(&builder, c);
+  return builderFinish(&builder);
+}
+
 void appendInPlace(char** base, char c) {
   char* temp = append(*base, c);
   char* deleteThis = *base;
@@ -46,27 +159,9 @@ char* getSlice(char* base, size_t startIndex, size_t endIndex) {
   if (startIndex > endIndex) {
     return NULL;
   }
-
-  size_t index = 0;
-  char c = base[index];
-  char* output = malloc(1 * sizeof(char));
-  size_t outputIndex = 0;
-  output[0] = '\0';
-  while (c != 0) {
-    if (index >= startIndex) {
-      output = realloc(output, outputIndex + 2); // +1 for new char, +1 for null terminator
-      output[outputIndex] = c;
-      output[outputIndex + 1] = '\0';
-      outputIndex++;
-    }
-    if (index == endIndex) {
-      return output;
-    }
-
-    index++;
-    c = base[index];
-  }
-  return NULL;
+  struct StringBuilder builder = newStringBuilder(endIndex - startIndex + 1);
+  builderAppend(&builder, base + startIndex, endIndex - startIndex + 1);
+  return builderFinish(&builder);
 }
 
 char* deleteString(char* input, size_t start, size_t end) {
@@ -80,27 +175,9 @@ char* deleteString(char* input, size_t start, size_t end) {
   if (start > originalLen - 1 || end > originalLen - 1) { // index math
     return NULL;
   }
-
-  // calculate size of new buffer
-  size_t newSize = start + (originalLen - end);
-  // create new buffer
-  char* outputString = malloc(sizeof(char) * newSize);
-  // copy starting part to output
-  size_t index = 0;
-  while (index < start) {
-    outputString[index] = input[index];
-    index++;
-  }
-  // index now points to the first character to be skipped
-  while (index < newSize - 1) { // convert byte size to pointer
-    // prepare yourself im about to do some really funny pointer math
-    outputString[index] = input[index-start+end+1]; // instead of pointing to the first character outside of start section,
-    // index now points to the first character inside the end section (end pointer + 1)
-    index++;
-  }
-  // write null terminator
-  outputString[index] = 0;
-  return outputString;
+  struct StringBuilder builder = builderFrom(input, 0);
+  builderDelete(&builder, start, end + 1);
+  return builderFinish(&builder);
 }
 
 void deleteStringInPlace(char** base, size_t start, size_t end) {
@@ -128,43 +205,10 @@ char* replaceString(char* base, char* replacement, size_t start, size_t end) {
   if (start > originalLen - 1 || end > originalLen - 1) { // index math
     return NULL;
   }
-
-  // calculate size of new buffer
   size_t replaceLength = strlen(replacement);
-  size_t newSize = start + originalLen - end + replaceLength;
-  // create new buffer
-  char* outputString = malloc(sizeof(char) * newSize);
-
-  // copy starting part to output
-  size_t outputIndex = 0;
-  size_t partsIndex = 0;
-  while (outputIndex < start) {
-    char c = base[partsIndex];
-    outputString[outputIndex] = c;
-    partsIndex++;
-    outputIndex++;
-  }
-  // outputIndex now points to next free character in array
-  // copy replacement to output
-  partsIndex = 0;
-  while (partsIndex < replaceLength) {
-    char c = replacement[partsIndex];
-    outputString[outputIndex] = c;
-    partsIndex++;
-    outputIndex++;
-  }
-  // partsIndex now needs to point to the first character after the section of base to be deleted
-  // copy end of base to output
-  partsIndex = end + 1;
-  while (partsIndex < originalLen) {
-    char c = base[partsIndex];
-    outputString[outputIndex] = c;
-    outputIndex++;
-    partsIndex++;
-  }
-  // write null terminator
-  outputString[outputIndex] = 0;
-  return outputString;
+  struct StringBuilder builder = builderFrom(base, replaceLength);
+  builderReplace(&builder, start, end + 1, replacement, replaceLength);
+  return builderFinish(&builder);
 }
 
 void replaceStringInPlace(char** base, char* replacement, size_t start, size_t end) {
@@ -176,50 +220,16 @@ void replaceStringInPlace(char** base, char* replacement, size_t start, size_t e
 
 char* insertString(char* base, char* insert, size_t insertIndex) {
   // insert string into base string starting at index
-  // inserting is very similar to replacing, you just have a replacement selection of zero length (start == end)
 
   // sanity check inputs
   size_t originalLength = strlen(base);
   if (insertIndex > originalLength) {
     return NULL;
   }
-  
-  // calculate size of new buffer
   size_t insertLength = strlen(insert);
-  size_t newSize = originalLength + insertLength + 1;
-  // create new buffer
-  char* outputString = malloc(sizeof(char) * newSize);
-
-  // copy starting part to output
-  size_t outputIndex = 0;
-  size_t partsIndex = 0;
-  while (outputIndex < insertIndex) {
-    char c = base[partsIndex];
-    outputString[outputIndex] = c;
-    partsIndex++;
-    outputIndex++;
-  }
-  // outputIndex now points to next free character in array
-  // copy replacement to output
-  partsIndex = 0;
-  while (partsIndex < insertLength) {
-    char c = insert[partsIndex];
-    outputString[outputIndex] = c;
-    partsIndex++;
-    outputIndex++;
-  }
-  // partsIndex now needs to point to the first character after the section of base to be deleted
-  // copy end of base to output
-  partsIndex = insertIndex;
-  while (partsIndex < originalLength) {
-    char c = base[partsIndex];
-    outputString[outputIndex] = c;
-    outputIndex++;
-    partsIndex++;
-  }
-  // write null terminator
-  outputString[outputIndex] = 0;
-  return outputString;
+  struct StringBuilder builder = builderFrom(base, insertLength);
+  builderInsert(&builder, insertIndex, insert, insertLength);
+  return builderFinish(&builder);
 }
 
 void insertStringInPlace(char** base, char* insert, size_t index) {
@@ -279,54 +289,24 @@ char* reverseString(char* input) {
 }
 
 char* byteToAscii(unsigned char input) {
-  // TODO: reverse the string
-  char* output = malloc(2 * sizeof(char));
-  unsigned int outputLength = 1;
-
-  int index = -1;
-  char digit;
-  do {
-    index++;
-    digit = input % 10;
-    input = input / 10;
-    outputLength += 1;
-    output = realloc(output, outputLength * sizeof(char));
-    output[index] = digit + '0';
-  }
-  while (input > 0);
-  output[++index] = '\0';
-  char* temp = reverseString(output);
-  free(output);
-  return temp;
+  struct StringBuilder builder = newStringBuilder(3);
+  builderAppendUnsigned(&builder, input);
+  return builderFinish(&builder);
 }
 
 char* stringToIntString(char* input) {
   // convert string to space-seperated integer strings ("hello!" -> "104 101 108 108 111 33 0")
+  size_t length = strlen(input);
+  // at most 3 digits and a space per character
+  struct StringBuilder builder = newStringBuilder(length * 4 + 1);
   size_t index = 0;
-  size_t outputIndex = 0;
-  char c;
-  char* output = malloc(sizeof(char));
-  output[0] = '\0';
-  char* temp;
-  size_t oldLen;
-  do {
-    c = input[index];
-    temp = insertString(output, byteToAscii(c), outputIndex);
-    free(output);
-    output = temp;
-    temp = NULL;
-    // put space at end of string
-    oldLen = strlen(output);
-    output = realloc(output, (oldLen + 2) * sizeof(char));
-    output[oldLen] = ' ';
-    output[oldLen + 1] = '\0';
-    outputIndex = strlen(output);
+  while (index < length) {
+    builderAppendUnsigned(&builder, (unsigned char) input[index]);
+    builderAppendChar(&builder, ' ');
     index++;
-    
-  } while (c != '\0');
-  // remove trailing whitespace
-  output[strlen(output) - 1] = '\0';
-  return output;
+  }
+  builderAppendChar(&builder, '0');
+  return builderFinish(&builder);
 }
 
 void stringToIntStringInPlace(char** input) {
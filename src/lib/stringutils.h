@@ -19,6 +19,34 @@
 #ifndef STRINGUTILS_H
 #define STRINGUTILS_H
 #include <string.h>
+#include <bits/types.h>
+
+// growable string, always null terminated, capacity doesn't count the terminator
+struct StringBuilder {
+  char* data;
+  size_t length;
+  size_t capacity;
+};
+
+struct StringBuilder newStringBuilder(size_t capacity);
+
+void builderReserve(struct StringBuilder* builder, size_t extra);
+
+void builderAppend(struct StringBuilder* builder, const char* text, size_t length);
+
+void builderAppendChar(struct StringBuilder* builder, char c);
+
+void builderAppendUnsigned(struct StringBuilder* builder, __uint64_t value);
+
+int builderReplace(struct StringBuilder* builder, size_t start, size_t end, const char* text, size_t length);
+
+int builderInsert(struct StringBuilder* builder, size_t index, const char* text, size_t length);
+
+int builderDelete(struct StringBuilder* builder, size_t start, size_t end);
+
+char* builderFinish(struct StringBuilder* builder);
+
+void freeStringBuilder(struct StringBuilder* builder);
 
 char* append(char* base, char c);
 
@@ -0,0 +1,364 @@
+/*
+ * liveness.c: which registers hold values that are still needed, and removing code that isn't
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveness.h"
+#include "controlflow.h"
+#include "optimize.h"
+#include "opcodes.h"
+#include "codeobjects.h"
+#include "atoms.h"
+#include "lib/arena.h"
+
+// what out of memory errors say this file was doing
+#define OUT_OF_MEMORY_TASK "working out register liveness"
+
+// R0 always reads as zero, so it's never live and writing to it doesn't count
+
+size_t writtenRegister(struct Instruction* instruction) {
+  // returns NO_REGISTER if the instruction doesn't write a general purpose register
+  const struct OpcodeInfo* info = opcodeInfo(instruction->opcode);
+  if (info == NULL || !(info->flags & OP_WRITES_FIRST) || instruction->operands[0].type != TOKEN_REGISTER || instruction->operands[0].value <= 0) {
+    return NO_REGISTER;
+  }
+  return (size_t) instruction->operands[0].value;
+}
+
+__uint8_t readRegisters(struct Instruction* instruction, size_t* registers) {
+  // fills registers with the ones the instruction reads, returns how many
+  const struct OpcodeInfo* info = opcodeInfo(instruction->opcode);
+  if (info == NULL) {
+    return 0;
+  }
+  __uint8_t count = 0;
+  __uint8_t operandIndex = (info->flags & OP_WRITES_FIRST) ? 1 : 0;
+  while (operandIndex < instruction->operandCount) {
+    struct Operand* operand = &instruction->operands[operandIndex];
+    if (operand->type == TOKEN_REGISTER && operand->value > 0) {
+      registers[count] = (size_t) operand->value;
+      count++;
+    }
+    operandIndex++;
+  }
+  return count;
+}
+
+size_t highestRegister(struct Program* program) {
+  size_t highest = 0;
+  size_t index = program->first;
+  while (index != NO_INSTRUCTION) {
+    struct Instruction* instruction = &program->instructions[index];
+    __uint8_t operandIndex = 0;
+    while (operandIndex < instruction->operandCount) {
+      struct Operand* operand = &instruction->operands[operandIndex];
+      if (operand->type == TOKEN_REGISTER && operand->value > 0 && (size_t) operand->value > highest) {
+        highest = (size_t) operand->value;
+      }
+      operandIndex++;
+    }
+    index = instruction->next;
+  }
+  return highest;
+}
+
+static inline void setBit(__uint64_t* set, size_t bit) {
+  set[bit / 64] |= (__uint64_t) 1 << (bit % 64);
+}
+
+static inline void clearBit(__uint64_t* set, size_t bit) {
+  set[bit / 64] &= ~((__uint64_t) 1 << (bit % 64));
+}
+
+static inline int testBit(const __uint64_t* set, size_t bit) {
+  return (set[bit / 64] >> (bit % 64)) & 1;
+}
+
+static void addRegisters(__uint64_t* live, struct Instruction* instruction) {
+  // live = (live - written) + read
+  size_t written = writtenRegister(instruction);
+  if (written != NO_REGISTER) {
+    clearBit(live, written);
+  }
+  size_t registers[3];
+  __uint8_t count = readRegisters(instruction, registers);
+  while (count > 0) {
+    count--;
+    setBit(live, registers[count]);
+  }
+}
+
+static void queueBlock(size_t* worklist, __uint8_t* queued, size_t blockCount, size_t next, size_t* worklistCount, size_t block) {
+  // the worklist is used as a ring, every block is on it at most once so it never overflows
+  if (queued[block]) {
+    return;
+  }
+  queued[block] = 1;
+  size_t slot = next + *worklistCount;
+  worklist[slot >= blockCount ? slot - blockCount : slot] = block;
+  (*worklistCount)++;
+}
+
+struct Liveness computeLiveness(struct Program* program, struct ControlFlow* flow) {
+  // backward dataflow over the blocks, rerunning only blocks whose successors changed
+  struct Liveness liveness;
+  liveness.registerCount = highestRegister(program) + 1;
+  liveness.words = (liveness.registerCount + 63) / 64;
+  size_t words = liveness.words;
+  size_t blockCount = flow->blockCount;
+  liveness.liveIn = checkedCalloc(blockCount * words, sizeof(__uint64_t), OUT_OF_MEMORY_TASK);
+  liveness.liveOut = checkedCalloc(blockCount * words, sizeof(__uint64_t), OUT_OF_MEMORY_TASK);
+  // what each block reads before writing, and what it writes
+  __uint64_t* uses = checkedCalloc(blockCount * words, sizeof(__uint64_t), OUT_OF_MEMORY_TASK);
+  __uint64_t* defines = checkedCalloc(blockCount * words, sizeof(__uint64_t), OUT_OF_MEMORY_TASK);
+  size_t* worklist = checkedCalloc(blockCount, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  __uint8_t* queued = checkedCalloc(blockCount, sizeof(__uint8_t), OUT_OF_MEMORY_TASK);
+  // a RET can land after any CAL (or at any label whose address was pushed), those are its successors here
+  __uint8_t* returnsHere = checkedCalloc(blockCount, sizeof(__uint8_t), OUT_OF_MEMORY_TASK);
+  size_t* returning = checkedCalloc(blockCount, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  size_t returningCount = 0;
+  __uint64_t* returnLive = checkedCalloc(words, sizeof(__uint64_t), OUT_OF_MEMORY_TASK);  // live at any of those
+
+  size_t blockIndex = 0;
+  while (blockIndex < blockCount) {
+    struct Block* block = &flow->blocks[blockIndex];
+    __uint64_t* use = &uses[blockIndex * words];
+    __uint64_t* define = &defines[blockIndex * words];
+    size_t index = block->last;
+    while (1) {
+      struct Instruction* instruction = &program->instructions[index];
+      size_t written = writtenRegister(instruction);
+      if (written != NO_REGISTER) {
+        setBit(define, written);
+        clearBit(use, written);
+      }
+      size_t registers[3];
+      __uint8_t count = readRegisters(instruction, registers);
+      while (count > 0) {
+        count--;
+        setBit(use, registers[count]);
+      }
+      if (index == block->first) {
+        break;
+      }
+      index = instruction->previous;
+    }
+    // after a jump to somewhere unknown, any register could be read
+    if (block->flags & BLOCK_INDIRECT) {
+      memset(&liveness.liveOut[blockIndex * words], 0xff, words * sizeof(__uint64_t));
+    }
+    if (block->flags & BLOCK_RETURNS) {
+      returning[returningCount] = blockIndex;
+      returningCount++;
+    }
+    if (block->flags & BLOCK_ADDRESS_TAKEN) {
+      returnsHere[blockIndex] = 1;
+    }
+    if (opcodeInfo(program->instructions[block->last].opcode) != NULL && (opcodeInfo(program->instructions[block->last].opcode)->flags & OP_CALL) && blockIndex + 1 < blockCount) {
+      returnsHere[blockIndex + 1] = 1;
+    }
+    blockIndex++;
+  }
+
+  // later blocks first, so most blocks see their successors' final sets the first time around
+  size_t worklistCount = 0;
+  blockIndex = blockCount;
+  while (blockIndex > 0) {
+    blockIndex--;
+    worklist[worklistCount] = blockIndex;
+    queued[blockIndex] = 1;
+    worklistCount++;
+  }
+  size_t next = 0;
+  while (worklistCount > 0) {
+    blockIndex = worklist[next];
+    next = next + 1 == blockCount ? 0 : next + 1;
+    worklistCount--;
+    queued[blockIndex] = 0;
+    struct Block* block = &flow->blocks[blockIndex];
+    __uint64_t* in = &liveness.liveIn[blockIndex * words];
+    __uint64_t* out = &liveness.liveOut[blockIndex * words];
+    size_t edge = block->firstSuccessor;
+    while (edge < block->firstSuccessor + block->successorCount) {
+      __uint64_t* successorIn = &liveness.liveIn[flow->successors[edge] * words];
+      size_t word = 0;
+      while (word < words) {
+        out[word] |= successorIn[word];
+        word++;
+      }
+      edge++;
+    }
+    if (block->flags & BLOCK_RETURNS) {
+      size_t word = 0;
+      while (word < words) {
+        out[word] |= returnLive[word];
+        word++;
+      }
+    }
+    __uint8_t changed = 0;
+    size_t word = 0;
+    while (word < words) {
+      __uint64_t value = uses[blockIndex * words + word] | (out[word] & ~defines[blockIndex * words + word]);
+      if (value != in[word]) {
+        in[word] = value;
+        changed = 1;
+      }
+      word++;
+    }
+    if (!changed) {
+      continue;
+    }
+    edge = block->firstPredecessor;
+    while (edge < block->firstPredecessor + block->predecessorCount) {
+      queueBlock(worklist, queued, blockCount, next, &worklistCount, flow->predecessors[edge]);
+      edge++;
+    }
+    if (returnsHere[blockIndex]) {
+      // sets only ever grow, so the union can be kept up to date one block at a time
+      __uint8_t grew = 0;
+      size_t word = 0;
+      while (word < words) {
+        if ((in[word] & ~returnLive[word]) != 0) {
+          returnLive[word] |= in[word];
+          grew = 1;
+        }
+        word++;
+      }
+      size_t returnIndex = grew ? 0 : returningCount;
+      while (returnIndex < returningCount) {
+        queueBlock(worklist, queued, blockCount, next, &worklistCount, returning[returnIndex]);
+        returnIndex++;
+      }
+    }
+  }
+
+  free(uses);
+  free(defines);
+  free(worklist);
+  free(queued);
+  free(returnsHere);
+  free(returning);
+  free(returnLive);
+  return liveness;
+}
+
+void freeLiveness(struct Liveness* liveness) {
+  free(liveness->liveIn);
+  free(liveness->liveOut);
+  liveness->liveIn = NULL;
+  liveness->liveOut = NULL;
+}
+
+int removeUnreachableCode(struct Program* program) {
+  // remove instructions no path from the start (or from an indirect jump) can reach
+  // labels, data and headers in those blocks stay where they are
+  // returns 1 if anything was removed
+  struct ControlFlow flow = buildControlFlow(program);
+  __uint8_t* reached = checkedCalloc(flow.blockCount, sizeof(__uint8_t), OUT_OF_MEMORY_TASK);
+  size_t* stack = checkedCalloc(flow.blockCount, sizeof(size_t), OUT_OF_MEMORY_TASK);
+  size_t stackCount = 0;
+  size_t blockIndex = 0;
+  while (blockIndex < flow.blockCount) {
+    if (flow.blocks[blockIndex].flags & (BLOCK_ENTRY | BLOCK_ADDRESS_TAKEN)) {
+      reached[blockIndex] = 1;
+      stack[stackCount] = blockIndex;
+      stackCount++;
+    }
+    blockIndex++;
+  }
+  while (stackCount > 0) {
+    stackCount--;
+    struct Block* block = &flow.blocks[stack[stackCount]];
+    size_t edge = block->firstSuccessor;
+    while (edge < block->firstSuccessor + block->successorCount) {
+      size_t successor = flow.successors[edge];
+      if (!reached[successor]) {
+        reached[successor] = 1;
+        stack[stackCount] = successor;
+        stackCount++;
+      }
+      edge++;
+    }
+  }
+
+  int changed = 0;
+  blockIndex = 0;
+  while (blockIndex < flow.blockCount) {
+    if (!reached[blockIndex]) {
+      struct Block* block = &flow.blocks[blockIndex];
+      size_t index = block->first;
+      while (1) {
+        size_t next = program->instructions[index].next;
+        struct Instruction* instruction = &program->instructions[index];
+        if (instruction->opcode != ATOM_NONE && instruction->opcode != ATOM_NOP) {
+          removeInstruction(program, index);
+          changed = 1;
+        }
+        if (index == block->last) {
+          break;
+        }
+        index = next;
+      }
+    }
+    blockIndex++;
+  }
+  free(reached);
+  free(stack);
+  freeControlFlow(&flow);
+  return changed;
+}
+
+int removeDeadCode(struct Program* program) {
+  // remove instructions that only write a register nothing reads afterwards
+  // returns 1 if anything was removed
+  struct ControlFlow flow = buildControlFlow(program);
+  struct Liveness liveness = computeLiveness(program, &flow);
+  __uint64_t* live = checkedCalloc(liveness.words, sizeof(__uint64_t), OUT_OF_MEMORY_TASK);
+  int changed = 0;
+  size_t blockIndex = 0;
+  while (blockIndex < flow.blockCount) {
+    struct Block* block = &flow.blocks[blockIndex];
+    memcpy(live, &liveness.liveOut[blockIndex * liveness.words], liveness.words * sizeof(__uint64_t));
+    size_t index = block->last;
+    while (1) {
+      struct Instruction* instruction = &program->instructions[index];
+      size_t previous = instruction->previous;
+      __uint8_t isFirst = index == block->first;
+      size_t written = writtenRegister(instruction);
+      if (written != NO_REGISTER && hasNoSideEffects(instruction->opcode) && !testBit(live, written)) {
+        // its reads don't count, so whatever fed it can go too
+        removeInstruction(program, index);
+        changed = 1;
+      }
+      else {
+        addRegisters(live, instruction);
+      }
+      if (isFirst) {
+        break;
+      }
+      index = previous;
+    }
+    blockIndex++;
+  }
+  free(live);
+  freeLiveness(&liveness);
+  freeControlFlow(&flow);
+  return changed;
+}
@@ -0,0 +1,51 @@
+/*
+ * liveness.h: which registers hold values that are still needed, and removing code that isn't
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+#include "optimize.h"
+#include "controlflow.h"
+
+#define NO_REGISTER ((size_t) -1)
+
+// one bit per register for every block, registers whose value might still be read later are set
+struct Liveness {
+  size_t registerCount;  // highest register number used, plus one
+  size_t words;          // 64 bit words per set
+  __uint64_t* liveIn;    // blockCount * words, live at the start of each block
+  __uint64_t* liveOut;   // blockCount * words, live at the end of each block
+};
+
+size_t writtenRegister(struct Instruction* instruction);
+
+__uint8_t readRegisters(struct Instruction* instruction, size_t* registers);
+
+size_t highestRegister(struct Program* program);
+
+struct Liveness computeLiveness(struct Program* program, struct ControlFlow* flow);
+
+void freeLiveness(struct Liveness* liveness);
+
+int removeUnreachableCode(struct Program* program);
+
+int removeDeadCode(struct Program* program);
+
+#endif
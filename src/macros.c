@@ -0,0 +1,284 @@
+/*
+ * macros.c: expands @DEFINE macros
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macros.h"
+#include "codeobjects.h"
+#include "tokenize.h"
+#include "atoms.h"
+#include "lib/arena.h"
+#include "lib/intern.h"
+
+// @DEFINE <name> <body> makes every later use of name stand for body
+// a string body stands for the code inside it, which can be several tokens or several lines,
+// and bodies can use other macros, including ones that are only defined later on
+
+// only used inside expansions, splits the line the expansion lands in
+#define TOKEN_LINE_BREAK '\n'
+
+#define MACRO_UNRESOLVED 0
+#define MACRO_RESOLVING 1  // being expanded right now, running into it again means the macro refers back to itself
+#define MACRO_RESOLVED 2
+
+struct Macro {
+  size_t body;            // index of the body token in the code's token store plus one, 0 if not defined
+  __uint8_t state;
+  __uint64_t generation;  // define generation the expansion was worked out in
+  size_t firstToken;      // expansion, as a range of the expander's expansion store
+  size_t tokenCount;
+};
+
+struct Expander {
+  struct Code* code;
+  struct Macro* macros;     // indexed by atom
+  size_t macroCapacity;
+  __uint64_t generation;    // bumped by every @DEFINE, expansions from an older generation get worked out again
+  struct Code expansions;   // finished expansions, fully expanded and ready to be copied out (only the tokens are used)
+  struct Code output;       // tokens of the expanded program (only the tokens are used)
+  struct Line* lines;       // lines of the expanded program, in the code's arena
+  size_t lineCount;
+  size_t lineCapacity;
+  size_t lineStart;         // first output token of the line being built
+};
+
+static struct Macro* findMacro(struct Expander* expander, Atom atom) {
+  // returns NULL if atom isn't a macro
+  if (atom == ATOM_NONE || atom >= expander->macroCapacity || expander->macros[atom].body == 0) {
+    return NULL;
+  }
+  return &expander->macros[atom];
+}
+
+static void defineMacro(struct Expander* expander, Atom atom, size_t body) {
+  if (atom >= expander->macroCapacity) {
+    size_t capacity = expander->macroCapacity == 0 ? 256 : expander->macroCapacity;
+    while (capacity <= atom) {
+      capacity *= 2;
+    }
+    expander->macros = realloc(expander->macros, capacity * sizeof(struct Macro));
+    if (expander->macros == NULL) {
+      fprintf(stderr, "Error: out of memory while expanding macros.\n");
+      exit(-1);
+    }
+    memset(expander->macros + expander->macroCapacity, 0, (capacity - expander->macroCapacity) * sizeof(struct Macro));
+    expander->macroCapacity = capacity;
+  }
+  struct Macro* macro = &expander->macros[atom];
+  macro->body = body + 1;
+  macro->state = MACRO_UNRESOLVED;
+  expander->generation++;
+}
+
+static struct Code lexBody(struct Expander* expander, struct StringData* body) {
+  // tokenize the inside of a string body, string ids carry on from the program's so the strings
+  // can be moved over to it as they are
+  struct Code* code = expander->code;
+  struct Code bodyCode = newCode((const char*) body->bytes, body->length);
+  struct Lexer lexer = newLexer(&bodyCode, &atomTable, LEX_CODE, 1);
+  lexer.stringCount = code->stringMap.length;
+  lexRange(&lexer, 0, body->length, 1);
+
+  size_t stringIndex = code->stringMap.length + 1;
+  while (stringIndex <= lexer.stringCount) {
+    if (addString(code, stringIndex, copyString(&code->arena, getString(&bodyCode, stringIndex))) != 0) {
+      printf("Error while trying to add string %lu to map\n", stringIndex);
+      exit(-1);
+    }
+    stringIndex++;
+  }
+  return bodyCode;
+}
+
+static void resolveMacro(struct Expander* expander, Atom atom, __uint64_t lineNumber);
+
+static void appendBodyToken(struct Expander* expander, struct Token token) {
+  // copy a body token to the expansion store, or the expansion of the macro it names
+  struct Macro* macro = findMacro(expander, token.atom);
+  if (macro == NULL) {
+    addToken(&expander->expansions, token);
+    return;
+  }
+  size_t index = macro->firstToken;
+  while (index < macro->firstToken + macro->tokenCount) {
+    addToken(&expander->expansions, getToken(&expander->expansions, index));
+    index++;
+  }
+}
+
+static void resolveMacro(struct Expander* expander, Atom atom, __uint64_t lineNumber) {
+  // work out the full expansion of a macro, once per generation
+  // macros used in the body are resolved first so their expansions can be copied in one piece
+  struct Code* code = expander->code;
+  struct Macro* macro = &expander->macros[atom];
+  if (macro->state == MACRO_RESOLVED && macro->generation == expander->generation) {
+    return;
+  }
+  if (macro->state == MACRO_RESOLVING) {
+    fprintf(stderr, "Error at line %lu, @DEFINE \"%s\" expands back into itself.\n", lineNumber, atomString(&atomTable, atom));
+    exit(-1);
+  }
+  macro->state = MACRO_RESOLVING;
+
+  struct Token body = getToken(code, macro->body - 1);
+  struct StringData* string = body.type == TOKEN_STRING ? getString(code, body.value) : NULL;
+  if (string == NULL || string->isCharacter) {
+    // single token body
+    if (findMacro(expander, body.atom) != NULL) {
+      resolveMacro(expander, body.atom, lineNumber);
+    }
+    macro->firstToken = expander->expansions.tokens.count;
+    appendBodyToken(expander, body);
+  }
+  else {
+    struct Code bodyCode = lexBody(expander, string);
+    size_t tokenIndex = 0;
+    while (tokenIndex < bodyCode.tokens.count) {
+      Atom bodyAtom = bodyCode.tokens.atoms[tokenIndex];
+      if (findMacro(expander, bodyAtom) != NULL) {
+        resolveMacro(expander, bodyAtom, lineNumber);
+      }
+      tokenIndex++;
+    }
+    // body tokens point into the string, which moves into the generated text along with them
+    size_t base = addGeneratedText(code, (const char*) string->bytes, string->length);
+    macro->firstToken = expander->expansions.tokens.count;
+    size_t lineIndex = 0;
+    while (lineIndex < bodyCode.lineCount) {
+      if (lineIndex != 0) {
+        struct Token lineBreak = {TOKEN_LINE_BREAK, 0, 0, ATOM_NONE, 0};
+        addToken(&expander->expansions, lineBreak);
+      }
+      struct Line line = bodyCode.lines[lineIndex];
+      tokenIndex = line.firstToken;
+      while (tokenIndex < line.firstToken + line.tokenCount) {
+        struct Token token = getToken(&bodyCode, tokenIndex);
+        token.offset += base;
+        appendBodyToken(expander, token);
+        tokenIndex++;
+      }
+      lineIndex++;
+    }
+    freeCode(&bodyCode);
+  }
+  // the macros array doesn't move while resolving, only defineMacro() grows it
+  macro->tokenCount = expander->expansions.tokens.count - macro->firstToken;
+  macro->generation = expander->generation;
+  macro->state = MACRO_RESOLVED;
+}
+
+static void finishLine(struct Expander* expander, __uint64_t lineNumber) {
+  // close the output line being built, empty lines aren't stored
+  size_t tokenCount = expander->output.tokens.count - expander->lineStart;
+  if (tokenCount == 0) {
+    return;
+  }
+  struct Code* code = expander->code;
+  if (expander->lineCount == expander->lineCapacity) {
+    size_t capacity = expander->lineCapacity == 0 ? 64 : expander->lineCapacity * 2;
+    expander->lines = arenaGrow(&code->arena, expander->lines, expander->lineCapacity * sizeof(struct Line), capacity * sizeof(struct Line));
+    expander->lineCapacity = capacity;
+  }
+  struct Line line;
+  line.linenumber = lineNumber;
+  line.linetype = '\0';
+  line.firstToken = expander->lineStart;
+  line.tokenCount = tokenCount;
+  expander->lines[expander->lineCount] = line;
+  expander->lineCount++;
+  expander->lineStart = expander->output.tokens.count;
+}
+
+void expandDefines(struct Code* code) {
+  // replace every macro use with its expansion and drop the @DEFINE lines
+  // each macro is expanded once (until the next @DEFINE) and then copied, so the cost doesn't depend on how
+  // deep define chains go or on how many macros there are
+  Atom* atoms = code->tokens.atoms;
+  size_t lineIndex = 0;
+  while (lineIndex < code->lineCount && upperAtom(&atomTable, atoms[code->lines[lineIndex].firstToken]) != ATOM_MACRO_DEFINE) {
+    lineIndex++;
+  }
+  if (lineIndex == code->lineCount) {
+    // nothing to expand
+    return;
+  }
+
+  struct Expander expander;
+  memset(&expander, 0, sizeof(struct Expander));
+  expander.code = code;
+  expander.expansions = newCode(code->source, code->sourceLength);
+  expander.output = newCode(code->source, code->sourceLength);
+
+  lineIndex = 0;
+  while (lineIndex < code->lineCount) {
+    struct Line line = code->lines[lineIndex];
+    size_t first = line.firstToken;
+    lineIndex++;
+
+    if (upperAtom(&atomTable, code->tokens.atoms[first]) == ATOM_MACRO_DEFINE) {
+      if (line.tokenCount != 3) {
+        fprintf(stderr, "Error at line %lu, expected 2 arguments in @DEFINE statement, but got %lu.\n", line.linenumber, line.tokenCount - 1);
+        exit(-1);
+      }
+      if (code->tokens.atoms[first + 1] == ATOM_NONE) {
+        fprintf(stderr, "Error at line %lu, @DEFINE expected a name to define.\n", line.linenumber);
+        exit(-1);
+      }
+      defineMacro(&expander, code->tokens.atoms[first + 1], first + 2);
+      continue;
+    }
+
+    size_t tokenIndex = first;
+    while (tokenIndex < first + line.tokenCount) {
+      // code->tokens is only read from here on, expanded tokens all go to the output
+      Atom atom = code->tokens.atoms[tokenIndex];
+      struct Macro* macro = findMacro(&expander, atom);
+      if (macro == NULL) {
+        addToken(&expander.output, getToken(code, tokenIndex));
+        tokenIndex++;
+        continue;
+      }
+      resolveMacro(&expander, atom, line.linenumber);
+      size_t index = macro->firstToken;
+      while (index < macro->firstToken + macro->tokenCount) {
+        if (tokenType(&expander.expansions, index) == TOKEN_LINE_BREAK) {
+          finishLine(&expander, line.linenumber);
+        }
+        else {
+          addToken(&expander.output, getToken(&expander.expansions, index));
+        }
+        index++;
+      }
+      tokenIndex++;
+    }
+    finishLine(&expander, line.linenumber);
+  }
+
+  // swap the expanded tokens in, the old ones get freed along with the output code
+  struct TokenStore tokens = code->tokens;
+  code->tokens = expander.output.tokens;
+  expander.output.tokens = tokens;
+  code->lines = expander.lines;
+  code->lineCount = expander.lineCount;
+
+  freeCode(&expander.output);
+  freeCode(&expander.expansions);
+  free(expander.macros);
+}
@@ -27,17 +27,25 @@
 
 #include "lib/stringutils.h"
 #include "lib/map.h"
+#include "lib/mappedfile.h"
 
 #include "tokenize.h"
 #include "parse.h"
+#include "stream.h"
+#include "translations.h"
+#include "translationcache.h"
+#include "translate.h"
+#include "optimize.h"
+#include "opcodes.h"
+#include "allocate.h"
 #include "codeobjects.h"
+#include "atoms.h"
 
 
 extern void adainit();
 extern void adafinal();
 // extern int hello_world(char* statement, char* a, char* b, char* c);
 extern void hello_world();
-extern void token_testing(char* input);
 
 
 
@@ -52,18 +60,21 @@ void help() {
   puts("By Ada (Tape) adadispenser@gmail.com");
   puts("For reporting issues go to https://github.com/Tape-Dispenser/CleanURCL-Toolset/issues");
   puts("");
-  puts("urcltools : urcltools [-h] <input path> <-t path | -e 0-3> [-cuknv] [-p int] [-o path]");
+  puts("urcltools : urcltools [-h] <input path> <-t path | -e 0-3> [-bcuknsv] [-p int] [-j int] [-o path]");
   puts("  urcl translation toolset");
   puts("");
   puts("  Options:");
   puts("    -h           :  print this menu.");
+  puts("    -b           :  compile the translation file picked with -t into a binary cache next to it (<path>.cache) and exit. Later runs load the cache instead of the translation file as long as the file hasn't changed.");
   puts("    -c           :  stop at code cleaning step.");
   puts("    -t <path>    :  pick translation set for the transpiler to use. If no file is specified the program will return an error.");
   puts("    -e [0-3]     :  compile to emulator-ready bitcode with optional complexity level. (0 = corer, 1 = core, 2 = basic, 3 = complex, none = auto). If this option is specified translation file is ignored.");
   puts("    -p <integer> :  how many times to run code through the optimizer (if unspecified defaults to 20). If zero optimization is skipped.");
+  puts("    -j <integer> :  how many threads to tokenize with (if unspecified defaults to 1). If zero one thread per cpu is used.");
   puts("    -u           :  only allow urcl-compliant code features (parser will throw an error if code contains CleanURCL features).");
   puts("    -o <path>    :  declare output file path. If no output is declared it will default to $pwd/out.s"); 
   puts("    -k           :  keep temporary files.");
+  puts("    -s           :  stream the program through a window of lines at a time, so memory use doesn't grow with program size. Writes cleaned urcl with @DEFINEs applied, parsing and translating need the whole program so they are skipped.");
   puts("    -n           :  Append a null terminator to the end of every string immediate.");
   puts("    -v           :  verbose transpiling. Only works if translation file declares a comment style.");
 }
@@ -77,11 +88,14 @@ __uint8_t baseOnly = 0;          // if this is one then only allow base URCL fea
 __uint8_t keepTempFiles = 0;     // if this is one then do not delete temporary files created in the compilation process
 __uint8_t verboseTranspile = 0;  // if this is one then add comments to output assembly code (only if comments are defined in translation file)
 __uint8_t nullStrings = 0;       // if this is one then strings will have a null byte added to the end of them
+__uint8_t streamInput = 0;       // if this is one then the program is streamed through instead of being loaded all at once
+__uint8_t buildCache = 0;        // if this is one then only build the translation cache and exit
 
 
 // integers
 __uint8_t complexityLevel = 3;     // complex = 3, basic = 2, core = 1, corer = 0
-__uint8_t optimizationPasses = 0;  // once optimizer is added change this to 20
+__uint8_t optimizationPasses = 20; // upper limit on optimizer rounds, it normally stops by itself well before this
+unsigned int tokenizeThreads = 1;  // only inputs of a few megabytes or more actually get split between threads
 
 // strings
 char* translationPath;
@@ -117,8 +131,8 @@ void printInternal(struct Code code) {
     struct Line line = code.lines[lineIndex];
     __uint64_t tokenIndex = 0;
     while (tokenIndex < line.tokenCount) {
-      struct Token token = line.tokens[tokenIndex];
-      printf("%s ", token.string);
+      printToken(stdout, &code, getToken(&code, line.firstToken + tokenIndex));
+      printf(" ");
       tokenIndex++;
     }
     printf("\n");
@@ -131,20 +145,25 @@ void printInternal(struct Code code) {
 
 int main(int argc, char **argv) {
   adainit();
+  initAtoms();
+  initTokenizer();
   int option;
   char* urclPath;
   //processStatement("~A== BITS* (  2- B    @     h )", "52", "67", "12");
   hello_world();
-  token_testing("This string was sent from C and is being parsed by Ada!");
 
   // parse arguments
-  while ((option = getopt(argc, argv, ":hcuknvt:e:p:o:")) != -1) {
+  while ((option = getopt(argc, argv, ":hbcuknsvt:e:p:j:o:")) != -1) {
     
     switch (option) {
       case 'h': {
         help();
         exit(0);
       }
+      case 'b': {
+        buildCache = 1;
+        break;
+      }
       case 'c': {
         cleanOnly = 1;
         break;
@@ -161,6 +180,10 @@ int main(int argc, char **argv) {
         nullStrings = 1;
         break;
       }
+      case 's': {
+        streamInput = 1;
+        break;
+      }
       case 'v': {
         verboseTranspile = 1;
         break;
@@ -174,6 +197,13 @@ int main(int argc, char **argv) {
         optimizationPasses = (__uint8_t) stoi(optarg);
         break;
       }
+      case 'j': {
+        tokenizeThreads = (unsigned int) stoi(optarg);
+        if (tokenizeThreads == 0) {
+          tokenizeThreads = (unsigned int) sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        break;
+      }
       case 't': {
         translationPath = optarg;
         break;
@@ -192,65 +222,111 @@ int main(int argc, char **argv) {
       }
     }
   }
+  if (buildCache) {
+    if (translationPath == NULL) {
+      fprintf(stderr, "No translation file given, pick the one to cache with -t <path>.\n");
+      exit(-1);
+    }
+    if (compileTranslationCache(translationPath) != 0) {
+      fprintf(stderr, "Failed to build translation cache for \"%s\".\n", translationPath);
+      exit(-1);
+    }
+    freeAtoms();
+    adafinal();
+    return 0;
+  }
   if (argc - optind != 1) {
     printf("expected 1 file path input, got %u\n", argc-optind);
     exit(-1);
   }
 
-  // read input file into string
-  
   urclPath = argv[optind];
-  FILE* urclFile = NULL;
-  urclFile = fopen(urclPath, "r");
-  if (urclFile == NULL) {
-    printf("error no. %d while opening file \"%s\"\n", errno, urclPath);
-  }
-  int c;
-  char* codeText = malloc(1 * sizeof(char));
-  while ((c = fgetc(urclFile)) != EOF) {
-    appendInPlace(&codeText, c);
+
+  if (streamInput) {
+    // only the symbol table is kept between batches, everything else is freed as soon as it's written out
+    char* streamOutputPath = outputPath != NULL ? outputPath : "out.s";
+    FILE* streamOutput = fopen(streamOutputPath, "w");
+    if (streamOutput == NULL) {
+      printf("error no. %d while opening file \"%s\"\n", errno, streamOutputPath);
+      exit(-1);
+    }
+    if (streamFile(urclPath, streamOutput) != 0) {
+      printf("error no. %d while reading file \"%s\"\n", errno, urclPath);
+      exit(-1);
+    }
+    fclose(streamOutput);
+    freeAtoms();
+    adafinal();
+    return 0;
   }
-  fclose(urclFile);
 
-  /*
-  struct fy_document* translationYaml = fy_document_build_from_file(NULL, translationPath);
-  if (!translationYaml) {
-    fprintf(stderr, "Failed to build YAML document from file \"%s\". Are you sure it exists?", translationPath);
+  // map input file into memory, tokens will point directly into it
+  struct MappedFile urclFile;
+  if (mapFile(urclPath, &urclFile) != 0) {
+    printf("error no. %d while opening file \"%s\"\n", errno, urclPath);
     exit(-1);
   }
-  */
-
-  // printf("input address:  %p\n", code);
 
-  struct Line* internalCode;
+  // the translation file is only read once, everything after this works from the translation table
+  // (if the file has an up to date cache next to it, the cache is mapped in instead)
+  struct TranslationTable translations;
+  if (doTranslations) {
+    if (translationPath == NULL) {
+      fprintf(stderr, "No translation file given, pick one with -t <path> or compile to bitcode with -e.\n");
+      exit(-1);
+    }
+    if (openTranslations(translationPath, &translations) != 0) {
+      fprintf(stderr, "Failed to build YAML document from file \"%s\". Are you sure it exists?", translationPath);
+      exit(-1);
+    }
+  }
 
-  struct Code code = tokenize(codeText);
+  struct Code code = tokenizeParallel(urclFile.data, urclFile.length, tokenizeThreads);
   
   //printInternal(code);
 
-  //parse(&code, translationYaml);
-  
-  //printInternal(code);
+  if (!cleanOnly) {
+    parse(&code, doTranslations ? &translations : NULL, nullStrings);
 
+    if (optimizationPasses > 0) {
+      // without a translation file urcl's default 8 bit data bus is assumed, same as in parse()
+      // rewrites only write instructions the target has
+      __uint8_t available[ATOM_LAST_OPCODE + 1];
+      __uint64_t forms[ATOM_LAST_OPCODE + 1];
+      if (doTranslations) {
+        translationOpcodes(&translations, available, forms);
+      }
+      else {
+        complexityOpcodes(complexityLevel, available, forms);
+      }
+      optimize(&code, doTranslations ? translations.config.dataBus : 8, available, forms, optimizationPasses);
+    }
 
+    if (doTranslations) {
+      // fit the program onto the registers the target has, with optimization on they're also renumbered to use as few as possible
+      allocateRegisters(&code, translations.config.registerOrderCount, translations.config.dataBus, optimizationPasses > 0);
+    }
 
-  // free everything
-  // there's a double free in here somehwere
-  /*
-  __uint64_t lineIndex = 0;
-  while (lineIndex < code.lineCount) {
-    struct Line line = code.lines[lineIndex];
-    __uint64_t tokenIndex = 0;
-    while (tokenIndex < line.tokenCount) {
-      struct Token token = line.tokens[0];
-      free(token.string);
-      tokenIndex++;
+    if (doTranslations) {
+      char* translatedPath = outputPath != NULL ? outputPath : "out.s";
+      FILE* translatedFile = fopen(translatedPath, "w");
+      if (translatedFile == NULL) {
+        printf("error no. %d while opening file \"%s\"\n", errno, translatedPath);
+        exit(-1);
+      }
+      translateCode(&translations, &code, translatedFile, verboseTranspile);
+      fclose(translatedFile);
     }
-    free(line.tokens);
-    lineIndex++;
   }
-  free(code.lines);
-  */
+
+  // free everything
+  // all lines, tokens and strings live in the code's arena, so one call releases them
+  freeCode(&code);
+  unmapFile(&urclFile);
+  if (doTranslations) {
+    freeTranslations(&translations);
+  }
+  freeAtoms();
 
 
   // terminate everything
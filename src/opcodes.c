@@ -0,0 +1,254 @@
+/*
+ * opcodes.c: what each urcl instruction reads, writes and does
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "opcodes.h"
+#include "atoms.h"
+
+#define W OP_WRITES_FIRST
+
+// indexed by atom - ATOM_FIRST_OPCODE
+static const struct OpcodeInfo opcodeTable[ATOM_LAST_OPCODE - ATOM_FIRST_OPCODE + 1] = {
+  [ATOM_ADD - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_CORER},
+  [ATOM_RSH - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_CORER},
+  [ATOM_LOD - ATOM_FIRST_OPCODE] = {2, W | OP_MEMORY, COMPLEXITY_CORER},
+  [ATOM_STR - ATOM_FIRST_OPCODE] = {2, OP_MEMORY, COMPLEXITY_CORER},
+  [ATOM_BGE - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_CORER},
+  [ATOM_NOR - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_CORER},
+  [ATOM_SUB - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_CORE},
+  [ATOM_JMP - ATOM_FIRST_OPCODE] = {1, OP_JUMP, COMPLEXITY_CORE},
+  [ATOM_MOV - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_CORE},
+  [ATOM_NOP - ATOM_FIRST_OPCODE] = {0, 0, COMPLEXITY_CORE},
+  [ATOM_IMM - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_CORER},
+  [ATOM_LSH - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_BASIC},
+  [ATOM_INC - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_BASIC},
+  [ATOM_DEC - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_BASIC},
+  [ATOM_NEG - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_BASIC},
+  [ATOM_AND - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_BASIC},
+  [ATOM_OR - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_BASIC},
+  [ATOM_NOT - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_BASIC},
+  [ATOM_XNOR - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_BASIC},
+  [ATOM_XOR - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_BASIC},
+  [ATOM_NAND - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_BASIC},
+  [ATOM_BRL - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BRG - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BRE - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BNE - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BOD - ATOM_FIRST_OPCODE] = {2, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BEV - ATOM_FIRST_OPCODE] = {2, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BLE - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BRZ - ATOM_FIRST_OPCODE] = {2, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BNZ - ATOM_FIRST_OPCODE] = {2, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BRN - ATOM_FIRST_OPCODE] = {2, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BRP - ATOM_FIRST_OPCODE] = {2, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_PSH - ATOM_FIRST_OPCODE] = {1, OP_STACK | OP_MEMORY, COMPLEXITY_BASIC},
+  [ATOM_POP - ATOM_FIRST_OPCODE] = {1, W | OP_STACK | OP_MEMORY, COMPLEXITY_BASIC},
+  [ATOM_CAL - ATOM_FIRST_OPCODE] = {1, OP_CALL | OP_STACK | OP_MEMORY, COMPLEXITY_BASIC},
+  [ATOM_RET - ATOM_FIRST_OPCODE] = {0, OP_RETURN | OP_STACK | OP_MEMORY, COMPLEXITY_BASIC},
+  [ATOM_HLT - ATOM_FIRST_OPCODE] = {0, OP_HALT, COMPLEXITY_BASIC},
+  [ATOM_CPY - ATOM_FIRST_OPCODE] = {2, OP_MEMORY, COMPLEXITY_BASIC},
+  [ATOM_BRC - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_BNC - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_BASIC},
+  [ATOM_MLT - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_UMLT - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SUMLT - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_DIV - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SDIV - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_MOD - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_BSR - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_BSL - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SRS - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_COMPLEX},
+  [ATOM_BSS - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SBRL - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_COMPLEX},
+  [ATOM_SBRG - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_COMPLEX},
+  [ATOM_SBLE - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_COMPLEX},
+  [ATOM_SBGE - ATOM_FIRST_OPCODE] = {3, OP_BRANCH, COMPLEXITY_COMPLEX},
+  [ATOM_SETE - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SETNE - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SETG - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SETL - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SETGE - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SETLE - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SETC - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SETNC - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SSETG - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SSETL - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SSETLE - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_SSETGE - ATOM_FIRST_OPCODE] = {3, W, COMPLEXITY_COMPLEX},
+  [ATOM_ABS - ATOM_FIRST_OPCODE] = {2, W, COMPLEXITY_COMPLEX},
+  [ATOM_LLOD - ATOM_FIRST_OPCODE] = {3, W | OP_MEMORY, COMPLEXITY_COMPLEX},
+  [ATOM_LSTR - ATOM_FIRST_OPCODE] = {3, OP_MEMORY, COMPLEXITY_COMPLEX},
+  [ATOM_IN - ATOM_FIRST_OPCODE] = {2, W | OP_PORT, COMPLEXITY_BASIC},
+  [ATOM_OUT - ATOM_FIRST_OPCODE] = {2, OP_PORT, COMPLEXITY_BASIC},
+};
+
+#undef W
+
+const struct OpcodeInfo* opcodeInfo(Atom opcode) {
+  // returns NULL if opcode isn't an instruction
+  if (opcode < ATOM_FIRST_OPCODE || opcode > ATOM_LAST_OPCODE) {
+    return NULL;
+  }
+  return &opcodeTable[opcode - ATOM_FIRST_OPCODE];
+}
+
+void complexityOpcodes(__uint8_t complexity, __uint8_t* available, __uint64_t* forms) {
+  // flag the instructions a target of some COMPLEXITY_* level has, both lists need ATOM_LAST_OPCODE + 1 entries
+  // such a target takes any operands, so every form is there
+  memset(available, 0, ATOM_LAST_OPCODE + 1);
+  memset(forms, 0xff, (ATOM_LAST_OPCODE + 1) * sizeof(__uint64_t));
+  Atom opcode = ATOM_FIRST_OPCODE;
+  while (opcode <= ATOM_LAST_OPCODE) {
+    available[opcode] = opcodeTable[opcode - ATOM_FIRST_OPCODE].complexity <= complexity;
+    opcode++;
+  }
+}
+
+__uint8_t hasNoSideEffects(Atom opcode) {
+  // the instruction only writes its destination register, so it can go if nothing reads that
+  const struct OpcodeInfo* info = opcodeInfo(opcode);
+  return info != NULL && (info->flags & ~OP_WRITES_FIRST) == 0 && (info->flags & OP_WRITES_FIRST);
+}
+
+static __uint128_t maskBits(__uint32_t bits) {
+  return bits >= 128 ? ~(__uint128_t) 0 : ((__uint128_t) 1 << bits) - 1;
+}
+
+static __int128_t toSigned(__uint128_t value, __uint32_t bits) {
+  if (bits >= 128) {
+    return (__int128_t) value;
+  }
+  __uint32_t shift = 128 - bits;
+  return (__int128_t) (value << shift) >> shift;
+}
+
+int foldOpcode(Atom opcode, const __uint128_t* sources, __uint32_t bits, __uint128_t* output) {
+  // work out what an instruction that writes its first operand leaves there, given its other operands
+  // sources are the operands after the destination as unsigned bits wide values
+  // returns 0 on success
+  // returns -1 if the instruction can't be worked out ahead of time (ex. it reads memory, or divides by zero)
+  __uint128_t mask = maskBits(bits);
+  __uint128_t b = sources[0] & mask;
+  __uint128_t c = sources[1] & mask;
+  __int128_t signedB = toSigned(b, bits);
+  __int128_t signedC = toSigned(c, bits);
+  __uint128_t result;
+  switch (opcode) {
+    case ATOM_IMM:
+    case ATOM_MOV: result = b; break;
+    case ATOM_ADD: result = b + c; break;
+    case ATOM_SUB: result = b - c; break;
+    case ATOM_INC: result = b + 1; break;
+    case ATOM_DEC: result = b - 1; break;
+    case ATOM_NEG: result = 0 - b; break;
+    case ATOM_RSH: result = b >> 1; break;
+    case ATOM_LSH: result = b << 1; break;
+    case ATOM_SRS: result = (__uint128_t) (signedB >> 1); break;
+    case ATOM_AND: result = b & c; break;
+    case ATOM_OR: result = b | c; break;
+    case ATOM_XOR: result = b ^ c; break;
+    case ATOM_NOR: result = ~(b | c); break;
+    case ATOM_NAND: result = ~(b & c); break;
+    case ATOM_XNOR: result = ~(b ^ c); break;
+    case ATOM_NOT: result = ~b; break;
+    case ATOM_MLT: result = b * c; break;
+    case ATOM_UMLT:
+      if (bits > 64) {
+        return -1;
+      }
+      result = (b * c) >> bits;
+      break;
+    case ATOM_SUMLT:
+      if (bits > 64) {
+        return -1;
+      }
+      result = (__uint128_t) ((signedB * signedC) >> bits);
+      break;
+    case ATOM_DIV:
+    case ATOM_MOD:
+      if (c == 0) {
+        return -1;
+      }
+      result = opcode == ATOM_DIV ? b / c : b % c;
+      break;
+    case ATOM_SDIV:
+      if (c == 0 || (signedC == -1 && bits >= 128)) {
+        return -1;
+      }
+      result = (__uint128_t) (signedB / signedC);
+      break;
+    case ATOM_BSL: result = c >= bits ? 0 : b << c; break;
+    case ATOM_BSR: result = c >= bits ? 0 : b >> c; break;
+    case ATOM_BSS: result = (__uint128_t) (signedB >> (c >= bits ? bits - 1 : c)); break;
+    case ATOM_ABS: result = signedB < 0 ? 0 - b : b; break;
+    // comparisons set every bit for true
+    case ATOM_SETE: result = b == c ? mask : 0; break;
+    case ATOM_SETNE: result = b != c ? mask : 0; break;
+    case ATOM_SETG: result = b > c ? mask : 0; break;
+    case ATOM_SETL: result = b < c ? mask : 0; break;
+    case ATOM_SETGE: result = b >= c ? mask : 0; break;
+    case ATOM_SETLE: result = b <= c ? mask : 0; break;
+    case ATOM_SETC: result = b + c > mask ? mask : 0; break;
+    case ATOM_SETNC: result = b + c > mask ? 0 : mask; break;
+    case ATOM_SSETG: result = signedB > signedC ? mask : 0; break;
+    case ATOM_SSETL: result = signedB < signedC ? mask : 0; break;
+    case ATOM_SSETGE: result = signedB >= signedC ? mask : 0; break;
+    case ATOM_SSETLE: result = signedB <= signedC ? mask : 0; break;
+    default:
+      return -1;
+  }
+  *output = result & mask;
+  return 0;
+}
+
+int foldBranch(Atom opcode, const __uint128_t* sources, __uint32_t bits, __uint8_t* taken) {
+  // work out whether a conditional branch is taken, given the operands after its target
+  // returns 0 on success
+  // returns -1 if opcode isn't a conditional branch
+  __uint128_t mask = maskBits(bits);
+  __uint128_t b = sources[0] & mask;
+  __uint128_t c = sources[1] & mask;
+  __int128_t signedB = toSigned(b, bits);
+  __int128_t signedC = toSigned(c, bits);
+  __uint128_t sign = bits >= 128 ? (__uint128_t) 1 << 127 : (__uint128_t) 1 << (bits - 1);
+  switch (opcode) {
+    case ATOM_BGE: *taken = b >= c; break;
+    case ATOM_BRL: *taken = b < c; break;
+    case ATOM_BRG: *taken = b > c; break;
+    case ATOM_BRE: *taken = b == c; break;
+    case ATOM_BNE: *taken = b != c; break;
+    case ATOM_BLE: *taken = b <= c; break;
+    case ATOM_BOD: *taken = (b & 1) == 1; break;
+    case ATOM_BEV: *taken = (b & 1) == 0; break;
+    case ATOM_BRZ: *taken = b == 0; break;
+    case ATOM_BNZ: *taken = b != 0; break;
+    case ATOM_BRN: *taken = (b & sign) != 0; break;
+    case ATOM_BRP: *taken = (b & sign) == 0; break;
+    case ATOM_BRC: *taken = b + c > mask; break;
+    case ATOM_BNC: *taken = b + c <= mask; break;
+    case ATOM_SBRL: *taken = signedB < signedC; break;
+    case ATOM_SBRG: *taken = signedB > signedC; break;
+    case ATOM_SBLE: *taken = signedB <= signedC; break;
+    case ATOM_SBGE: *taken = signedB >= signedC; break;
+    default:
+      return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * opcodes.h: what each urcl instruction reads, writes and does
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <bits/types.h>
+
+#include "lib/intern.h"
+#include "atoms.h"
+
+// opcode flags
+#define OP_WRITES_FIRST 0x01   // the first operand is a register the instruction writes to
+#define OP_BRANCH 0x02         // conditional branch, the first operand is the target
+#define OP_JUMP 0x04           // unconditional jump, the first operand is the target
+#define OP_CALL 0x08           // jumps to the first operand and pushes the return address
+#define OP_RETURN 0x10         // pops an address and jumps to it
+#define OP_HALT 0x20
+#define OP_MEMORY 0x40         // reads or writes ram
+#define OP_STACK 0x80          // pushes or pops
+#define OP_PORT 0x100          // reads or writes a port
+
+// instruction sets a target can have, each has everything the ones below it do
+#define COMPLEXITY_CORER 0     // ADD RSH LOD STR BGE NOR IMM
+#define COMPLEXITY_CORE 1      // + SUB JMP MOV NOP
+#define COMPLEXITY_BASIC 2     // + LSH INC DEC NEG AND OR NOT ..., the rest of the branches, stack and ports
+#define COMPLEXITY_COMPLEX 3   // + MLT DIV MOD BSL BSR BSS, SET.., UMLT SDIV ...
+
+struct OpcodeInfo {
+  __uint8_t operandCount;
+  __uint16_t flags;
+  __uint8_t complexity;  // lowest COMPLEXITY_* level that has the instruction
+};
+
+const struct OpcodeInfo* opcodeInfo(Atom opcode);
+
+void complexityOpcodes(__uint8_t complexity, __uint8_t* available, __uint64_t* forms);
+
+__uint8_t hasNoSideEffects(Atom opcode);
+
+int foldOpcode(Atom opcode, const __uint128_t* sources, __uint32_t bits, __uint128_t* output);
+
+int foldBranch(Atom opcode, const __uint128_t* sources, __uint32_t bits, __uint8_t* taken);
+
+#endif
@@ -0,0 +1,543 @@
+/*
+ * optimize.c: rewrites urcl instructions into cheaper ones until nothing changes
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "optimize.h"
+#include "opcodes.h"
+#include "peephole.h"
+#include "liveness.h"
+#include "constants.h"
+#include "strength.h"
+#include "codeobjects.h"
+#include "atoms.h"
+#include "translations.h"
+#include "lib/arena.h"
+#include "lib/stringutils.h"
+
+static void markRelativeTargets(struct Program* program) {
+  // ~ operands count instructions from their own, so find which instruction each one lands on
+  // (nothing is added or removed while there are ~ operands around, so these stay put)
+  size_t* byOrdinal = checkedCalloc(program->count, sizeof(size_t), "reading program for the optimizer");
+  program->relativeTargets = checkedCalloc(program->count, sizeof(__uint8_t), "reading program for the optimizer");
+  size_t ordinalCount = 0;
+  size_t index = 0;
+  while (index < program->count) {
+    if (program->instructions[index].opcode != ATOM_NONE) {
+      byOrdinal[ordinalCount] = index;
+      ordinalCount++;
+    }
+    index++;
+  }
+  size_t ordinal = 0;
+  while (ordinal < ordinalCount) {
+    struct Instruction* instruction = &program->instructions[byOrdinal[ordinal]];
+    __uint8_t operandIndex = 0;
+    while (operandIndex < instruction->operandCount) {
+      struct Operand* operand = &instruction->operands[operandIndex];
+      __int128_t target = (__int128_t) ordinal + operand->value;
+      if (operand->type == TOKEN_RELATIVE && target >= 0 && target < (__int128_t) ordinalCount) {
+        program->relativeTargets[byOrdinal[target]] = 1;
+      }
+      operandIndex++;
+    }
+    ordinal++;
+  }
+  free(byOrdinal);
+}
+
+struct Program buildProgram(struct Code* code, __uint32_t bits) {
+  // read every instruction line into a form rules can rewrite in place
+  struct Program program;
+  memset(&program, 0, sizeof(struct Program));
+  program.code = code;
+  program.bits = bits;
+  memset(program.available, 1, sizeof(program.available));
+  memset(program.forms, 0xff, sizeof(program.forms));
+  program.count = code->lineCount;
+  program.capacity = program.count + 1;
+  program.first = program.count > 0 ? 0 : NO_INSTRUCTION;
+  program.reach = 1;
+  program.instructions = malloc(program.capacity * sizeof(struct Instruction));
+  program.current = malloc(program.capacity * sizeof(size_t));
+  program.pending = malloc(program.capacity * sizeof(size_t));
+  if (program.instructions == NULL || program.current == NULL || program.pending == NULL) {
+    fprintf(stderr, "Error: out of memory while reading program for the optimizer.\n");
+    exit(-1);
+  }
+
+  size_t previous = NO_INSTRUCTION;
+  size_t lineIndex = 0;
+  while (lineIndex < code->lineCount) {
+    struct Line line = code->lines[lineIndex];
+    struct Instruction* instruction = &program.instructions[lineIndex];
+    memset(instruction, 0, sizeof(struct Instruction));
+    instruction->line = lineIndex;
+    instruction->previous = previous;
+    instruction->next = NO_INSTRUCTION;
+    if (previous != NO_INSTRUCTION) {
+      program.instructions[previous].next = lineIndex;
+    }
+    previous = lineIndex;
+
+    size_t operandIndex = 0;
+    while (operandIndex + 1 < line.tokenCount) {
+      if (tokenType(code, line.firstToken + 1 + operandIndex) == TOKEN_RELATIVE) {
+        program.hasRelative = 1;
+      }
+      operandIndex++;
+    }
+
+    // anything that isn't an instruction with the right number of operands is left exactly as written
+    Atom opcode = line.tokenCount > 0 ? upperAtom(&atomTable, code->tokens.atoms[line.firstToken]) : ATOM_NONE;
+    const struct OpcodeInfo* info = opcodeInfo(opcode);
+    if (info == NULL || info->operandCount != line.tokenCount - 1) {
+      lineIndex++;
+      continue;
+    }
+    instruction->opcode = opcode;
+    instruction->operandCount = info->operandCount;
+    operandIndex = 0;
+    while (operandIndex < info->operandCount) {
+      size_t tokenIndex = line.firstToken + 1 + operandIndex;
+      struct Operand* operand = &instruction->operands[operandIndex];
+      operand->type = tokenType(code, tokenIndex);
+      operand->atom = code->tokens.atoms[tokenIndex];
+      operand->value = tokenValue(code, tokenIndex);
+      operand->token = tokenIndex;
+      operandIndex++;
+    }
+    lineIndex++;
+  }
+  if (program.hasRelative) {
+    markRelativeTargets(&program);
+  }
+  return program;
+}
+
+static size_t operandText(struct Program* program, struct Operand* operand, struct StringBuilder* text) {
+  // spell out an operand the optimizer made, returns its generated text offset
+  builderDelete(text, 0, text->length);
+  if (operand->type == TOKEN_REGISTER) {
+    builderAppendChar(text, 'R');
+  }
+  else if (operand->type == TOKEN_MEMORY) {
+    builderAppendChar(text, 'M');
+  }
+  __uint128_t value = (__uint128_t) operand->value;
+  if (value > ~(__uint64_t) 0) {
+    char digits[40];
+    size_t digitCount = 0;
+    while (value > 0) {
+      digits[digitCount] = (char) (value % 10) + '0';
+      value /= 10;
+      digitCount++;
+    }
+    while (digitCount > 0) {
+      digitCount--;
+      builderAppendChar(text, digits[digitCount]);
+    }
+  }
+  else {
+    builderAppendUnsigned(text, (__uint64_t) value);
+  }
+  return addGeneratedText(program->code, text->data, text->length);
+}
+
+void writeProgram(struct Program* program) {
+  // rebuild the code's tokens and lines, lines nothing touched are copied over as they are
+  struct Code* code = program->code;
+  struct Code output = newCode(code->source, code->sourceLength);
+  struct Line* lines = arenaAlloc(&code->arena, (program->count + 1) * sizeof(struct Line));
+  size_t lineCount = 0;
+  struct StringBuilder text = newStringBuilder(24);
+
+  size_t index = program->first;
+  while (index != NO_INSTRUCTION) {
+    struct Instruction* instruction = &program->instructions[index];
+    struct Line line = code->lines[instruction->line];
+    index = instruction->next;
+    size_t firstToken = output.tokens.count;
+    if (!instruction->changed) {
+      size_t tokenIndex = line.firstToken;
+      while (tokenIndex < line.firstToken + line.tokenCount) {
+        addToken(&output, getToken(code, tokenIndex));
+        tokenIndex++;
+      }
+    }
+    else {
+      Atom opcode = instruction->opcode;
+      if (program->opcodeText[opcode] == 0) {
+        program->opcodeText[opcode] = addGeneratedText(code, atomString(&atomTable, opcode), atomLength(&atomTable, opcode));
+      }
+      struct Token token = {TOKEN_NAME, program->opcodeText[opcode], atomLength(&atomTable, opcode), opcode, 0};
+      addToken(&output, token);
+      __uint8_t operandIndex = 0;
+      while (operandIndex < instruction->operandCount) {
+        struct Operand* operand = &instruction->operands[operandIndex];
+        if (operand->token != NEW_TOKEN) {
+          addToken(&output, getToken(code, operand->token));
+        }
+        else {
+          token.type = operand->type;
+          token.atom = operand->atom;
+          token.value = operand->value;
+          token.offset = operandText(program, operand, &text);
+          token.length = text.length;
+          addToken(&output, token);
+        }
+        operandIndex++;
+      }
+    }
+    line.firstToken = firstToken;
+    line.tokenCount = output.tokens.count - firstToken;
+    lines[lineCount] = line;
+    lineCount++;
+  }
+  freeStringBuilder(&text);
+
+  // swap the new tokens in, the old ones get freed along with the output code
+  struct TokenStore tokens = code->tokens;
+  code->tokens = output.tokens;
+  output.tokens = tokens;
+  code->lines = lines;
+  code->lineCount = lineCount;
+  freeCode(&output);
+}
+
+void freeProgram(struct Program* program) {
+  free(program->instructions);
+  free(program->current);
+  free(program->pending);
+  free(program->relativeTargets);
+  program->instructions = NULL;
+  program->current = NULL;
+  program->pending = NULL;
+  program->relativeTargets = NULL;
+  program->count = 0;
+}
+
+static size_t newInstruction(struct Program* program, size_t line) {
+  // add an unlinked NOP to the instruction list, returns its index
+  if (program->count == program->capacity) {
+    program->capacity *= 2;
+    program->instructions = realloc(program->instructions, program->capacity * sizeof(struct Instruction));
+    program->current = realloc(program->current, program->capacity * sizeof(size_t));
+    program->pending = realloc(program->pending, program->capacity * sizeof(size_t));
+    if (program->instructions == NULL || program->current == NULL || program->pending == NULL) {
+      fprintf(stderr, "Error: out of memory while optimizing.\n");
+      exit(-1);
+    }
+  }
+  size_t index = program->count;
+  program->count++;
+  struct Instruction* instruction = &program->instructions[index];
+  memset(instruction, 0, sizeof(struct Instruction));
+  instruction->opcode = ATOM_NOP;
+  instruction->line = line;
+  return index;
+}
+
+size_t insertInstruction(struct Program* program, size_t after) {
+  // add an empty instruction after another one, returns its index
+  // (this can move the instruction list, so don't hold on to pointers into it)
+  // new instructions report errors at the line of the one they're next to
+  size_t index = newInstruction(program, program->instructions[after].line);
+  struct Instruction* instruction = &program->instructions[index];
+  instruction->previous = after;
+  instruction->next = program->instructions[after].next;
+  if (instruction->next != NO_INSTRUCTION) {
+    program->instructions[instruction->next].previous = index;
+  }
+  program->instructions[after].next = index;
+  return index;
+}
+
+size_t insertInstructionBefore(struct Program* program, size_t before) {
+  // like insertInstruction(), but the new instruction goes in front of before
+  size_t index = newInstruction(program, program->instructions[before].line);
+  struct Instruction* instruction = &program->instructions[index];
+  instruction->next = before;
+  instruction->previous = program->instructions[before].previous;
+  if (instruction->previous != NO_INSTRUCTION) {
+    program->instructions[instruction->previous].next = index;
+  }
+  else {
+    program->first = index;
+  }
+  program->instructions[before].previous = index;
+  return index;
+}
+
+void queueInstruction(struct Program* program, size_t index) {
+  // look at an instruction again next round (at most once per round)
+  if (index == NO_INSTRUCTION) {
+    return;
+  }
+  struct Instruction* instruction = &program->instructions[index];
+  if (instruction->deleted || instruction->opcode == ATOM_NONE || instruction->queued == program->round + 1) {
+    return;
+  }
+  instruction->queued = program->round + 1;
+  program->pending[program->pendingCount] = index;
+  program->pendingCount++;
+}
+
+static void queueNeighbours(struct Program* program, size_t index) {
+  // rules can match runs of instructions, so anything within reach might see a different run now
+  size_t step = 0;
+  size_t previous = program->instructions[index].previous;
+  size_t next = program->instructions[index].next;
+  while (step < program->reach) {
+    if (previous != NO_INSTRUCTION) {
+      queueInstruction(program, previous);
+      previous = program->instructions[previous].previous;
+    }
+    if (next != NO_INSTRUCTION) {
+      queueInstruction(program, next);
+      next = program->instructions[next].next;
+    }
+    step++;
+  }
+}
+
+void changeInstruction(struct Program* program, size_t index) {
+  // mark an instruction as rewritten, it and its neighbours might now match rules they didn't before
+  struct Instruction* instruction = &program->instructions[index];
+  instruction->changed = 1;
+  queueInstruction(program, index);
+  queueNeighbours(program, index);
+}
+
+void removeInstruction(struct Program* program, size_t index) {
+  struct Instruction* instruction = &program->instructions[index];
+  if (program->hasRelative) {
+    // relative jumps count instructions, so keep the slot
+    if (instruction->opcode != ATOM_NOP) {
+      instruction->opcode = ATOM_NOP;
+      instruction->operandCount = 0;
+      changeInstruction(program, index);
+    }
+    return;
+  }
+  // the instructions on either side are now next to each other
+  queueNeighbours(program, index);
+  instruction->deleted = 1;
+  if (instruction->previous != NO_INSTRUCTION) {
+    program->instructions[instruction->previous].next = instruction->next;
+  }
+  else {
+    program->first = instruction->next;
+  }
+  if (instruction->next != NO_INSTRUCTION) {
+    program->instructions[instruction->next].previous = instruction->previous;
+  }
+}
+
+__uint8_t formAvailable(struct Program* program, Atom opcode, const struct Operand* operands, __uint8_t operandCount) {
+  // returns 1 if the target has the instruction with these kinds of operands, sorted the same way translate does
+  __uint8_t kinds[MAX_OPERANDS];
+  __uint8_t operandIndex = 0;
+  while (operandIndex < operandCount) {
+    const struct Operand* operand = &operands[operandIndex];
+    Atom name = operand->type == TOKEN_NAME ? upperAtom(&atomTable, operand->atom) : ATOM_NONE;
+    kinds[operandIndex] = operand->type == TOKEN_REGISTER || name == ATOM_SP || name == ATOM_PC ? OPERAND_REGISTER : OPERAND_IMMEDIATE;
+    operandIndex++;
+  }
+  return program->available[opcode] && ((program->forms[opcode] >> packSignature(kinds, operandCount)) & 1);
+}
+
+// #########################  RULES  #########################
+
+int constantOperand(struct Operand* operand, __uint128_t* output) {
+  // returns 0 if the operand always reads as the same number
+  if (operand->type == TOKEN_IMMEDIATE) {
+    *output = (__uint128_t) operand->value;
+    return 0;
+  }
+  if (operand->type == TOKEN_REGISTER && operand->value == 0) {
+    // R0 always reads as zero
+    *output = 0;
+    return 0;
+  }
+  return -1;
+}
+
+int sameOperand(struct Operand* a, struct Operand* b) {
+  // returns 1 if both operands always mean the same thing
+  if (a->type != b->type) {
+    return 0;
+  }
+  if (a->type == TOKEN_NAME || a->type == TOKEN_LABEL || a->type == TOKEN_MACRO || a->type == TOKEN_PORT) {
+    return upperAtom(&atomTable, a->atom) == upperAtom(&atomTable, b->atom);
+  }
+  return a->type != TOKEN_NONE && a->value == b->value;
+}
+
+int isConstant(struct Operand* operand, __uint128_t value, __uint32_t bits) {
+  // returns 1 if the operand always reads as value
+  __uint128_t constant;
+  if (constantOperand(operand, &constant) != 0) {
+    return 0;
+  }
+  __uint128_t mask = bits >= 128 ? ~(__uint128_t) 0 : ((__uint128_t) 1 << bits) - 1;
+  return (constant & mask) == (value & mask);
+}
+
+static void setImmediate(struct Program* program, size_t index, __uint128_t value) {
+  struct Instruction* instruction = &program->instructions[index];
+  instruction->opcode = ATOM_IMM;
+  instruction->operandCount = 2;
+  struct Operand immediate = {TOKEN_IMMEDIATE, ATOM_NONE, (__int128_t) value, NEW_TOKEN};
+  instruction->operands[1] = immediate;
+  changeInstruction(program, index);
+}
+
+static int foldConstants(struct Program* program, size_t index) {
+  // an instruction that only reads constants becomes an IMM of its result
+  struct Instruction* instruction = &program->instructions[index];
+  const struct OpcodeInfo* info = opcodeInfo(instruction->opcode);
+  if (instruction->opcode == ATOM_IMM || !(info->flags & OP_WRITES_FIRST) || instruction->operands[0].type != TOKEN_REGISTER) {
+    return 0;
+  }
+  __uint128_t sources[2] = {0, 0};
+  __uint8_t operandIndex = 1;
+  while (operandIndex < instruction->operandCount) {
+    if (constantOperand(&instruction->operands[operandIndex], &sources[operandIndex - 1]) != 0) {
+      return 0;
+    }
+    operandIndex++;
+  }
+  __uint128_t result;
+  if (foldOpcode(instruction->opcode, sources, program->bits, &result) != 0) {
+    return 0;
+  }
+  setImmediate(program, index, result);
+  return 1;
+}
+
+static int matchRules(struct Program* program, size_t index) {
+  // peephole rules, see peephole.c
+  return program->peephole != NULL && matchPeephole(program->peephole, program, index);
+}
+
+static int removeUselessWrites(struct Program* program, size_t index) {
+  // writes to R0 are thrown away, and so is a MOV of a register to itself
+  struct Instruction* instruction = &program->instructions[index];
+  struct Operand* operands = instruction->operands;
+  if (!hasNoSideEffects(instruction->opcode) || operands[0].type != TOKEN_REGISTER) {
+    return 0;
+  }
+  if (operands[0].value == 0 || (instruction->opcode == ATOM_MOV && operands[1].type == TOKEN_REGISTER && operands[1].value == operands[0].value)) {
+    removeInstruction(program, index);
+    return 1;
+  }
+  return 0;
+}
+
+static const OptimizationRule rules[] = {
+  removeUselessWrites,
+  foldConstants,
+  matchRules,
+  reduceStrength,
+};
+
+#define RULE_COUNT (sizeof(rules) / sizeof(rules[0]))
+
+// passes over the whole program, run whenever the worklist runs dry
+// each returns 1 if it changed anything, and queues what it changed like a rule would
+static int (*const globalPasses[])(struct Program* program) = {
+  propagateConstants,
+  removeUnreachableCode,
+  removeDeadCode,
+};
+
+#define GLOBAL_PASS_COUNT (sizeof(globalPasses) / sizeof(globalPasses[0]))
+
+// #########################  ENGINE  #########################
+
+size_t optimizeProgram(struct Program* program, size_t maxRounds) {
+  // run the rules over a worklist until no rule changes anything, or maxRounds rounds have run
+  // the first round looks at every instruction, after that only at ones a rewrite could have affected
+  // once the rules run out of things to do, the global passes get a go (which counts as a round), and if they
+  // changed anything the rules pick up from there
+  // returns the number of rounds run
+  program->round = 0;
+  program->pendingCount = 0;
+  size_t index = 0;
+  while (index < program->count) {
+    queueInstruction(program, index);
+    index++;
+  }
+
+  while (program->round < maxRounds) {
+    if (program->pendingCount == 0) {
+      program->round++;
+      int changed = 0;
+      size_t passIndex = 0;
+      while (passIndex < GLOBAL_PASS_COUNT) {
+        changed |= globalPasses[passIndex](program);
+        passIndex++;
+      }
+      if (!changed) {
+        break;
+      }
+      continue;
+    }
+    size_t* swap = program->current;
+    program->current = program->pending;
+    program->currentCount = program->pendingCount;
+    program->pending = swap;
+    program->pendingCount = 0;
+    program->round++;
+
+    size_t itemIndex = 0;
+    while (itemIndex < program->currentCount) {
+      size_t instructionIndex = program->current[itemIndex];
+      size_t ruleIndex = 0;
+      // a rule that fires queues the instruction again, so the rest of the rules see the new version next round
+      while (ruleIndex < RULE_COUNT && !program->instructions[instructionIndex].deleted && program->instructions[instructionIndex].opcode != ATOM_NONE) {
+        if (rules[ruleIndex](program, instructionIndex)) {
+          break;
+        }
+        ruleIndex++;
+      }
+      itemIndex++;
+    }
+  }
+  return program->round;
+}
+
+void optimize(struct Code* code, __uint32_t bits, const __uint8_t* available, const __uint64_t* forms, size_t maxRounds) {
+  struct Peephole peephole = newPeephole();
+  loadDefaultRules(&peephole);
+  buildPeephole(&peephole);
+  struct Program program = buildProgram(code, bits);
+  memcpy(program.available, available, sizeof(program.available));
+  memcpy(program.forms, forms, sizeof(program.forms));
+  program.peephole = &peephole;
+  if (peephole.longestPattern > 1) {
+    program.reach = peephole.longestPattern - 1;
+  }
+  optimizeProgram(&program, maxRounds);
+  writeProgram(&program);
+  freeProgram(&program);
+  freePeephole(&peephole);
+}
@@ -0,0 +1,103 @@
+/*
+ * optimize.h: rewrites urcl instructions into cheaper ones until nothing changes
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <bits/types.h>
+
+#include "codeobjects.h"
+#include "atoms.h"
+
+#define NO_INSTRUCTION ((size_t) -1)
+#define NEW_TOKEN ((size_t) -1)
+
+struct Operand {
+  char type;        // token type (TOKEN_REGISTER, TOKEN_IMMEDIATE, ...)
+  Atom atom;
+  __int128_t value;
+  size_t token;     // token the operand was read from, NEW_TOKEN if the optimizer made it
+};
+
+struct Instruction {
+  Atom opcode;          // ATOM_NONE for lines the optimizer doesn't touch (labels, headers, DW, ...)
+  __uint8_t operandCount;
+  struct Operand operands[3];
+  size_t line;          // index of the line this was read from
+  __uint8_t deleted;
+  __uint8_t changed;    // written back from the fields above instead of copying the line
+  size_t queued;        // last round this was put on the worklist for
+  size_t previous;      // neighbouring instructions that aren't deleted, NO_INSTRUCTION at either end
+  size_t next;
+};
+
+struct Peephole;
+
+struct Program {
+  struct Code* code;
+  struct Instruction* instructions;
+  size_t count;
+  size_t capacity;
+  size_t first;           // instructions are written back in linked order starting here
+  __uint32_t bits;
+  __uint8_t available[ATOM_LAST_OPCODE + 1];  // 1 for instructions the target has, rewrites only write those
+  __uint64_t forms[ATOM_LAST_OPCODE + 1];     // bit n set for each operand signature n (see packSignature()) the target has
+  __uint8_t hasRelative;  // ~+n operands count instructions, so deleted ones have to become NOPs
+  __uint8_t* relativeTargets;  // 1 for instructions a ~+n operand lands on, NULL without any
+  struct Peephole* peephole;  // rules matched against runs of instructions, NULL to skip them
+  size_t reach;           // how far back and forward a rewrite can change what rules match
+  // instructions to look at this round and the next one
+  size_t round;
+  size_t* current;
+  size_t currentCount;
+  size_t* pending;
+  size_t pendingCount;
+  size_t opcodeText[ATOM_LAST_OPCODE + 1];  // generated text offset of each opcode's spelling, 0 until needed
+};
+
+// a rule looks at one instruction and returns 1 if it rewrote anything
+typedef int (*OptimizationRule)(struct Program* program, size_t index);
+
+struct Program buildProgram(struct Code* code, __uint32_t bits);
+
+void writeProgram(struct Program* program);
+
+void freeProgram(struct Program* program);
+
+int constantOperand(struct Operand* operand, __uint128_t* output);
+
+int sameOperand(struct Operand* a, struct Operand* b);
+
+int isConstant(struct Operand* operand, __uint128_t value, __uint32_t bits);
+
+size_t insertInstruction(struct Program* program, size_t after);
+
+size_t insertInstructionBefore(struct Program* program, size_t before);
+
+void queueInstruction(struct Program* program, size_t index);
+
+void changeInstruction(struct Program* program, size_t index);
+
+void removeInstruction(struct Program* program, size_t index);
+
+size_t optimizeProgram(struct Program* program, size_t maxRounds);
+
+__uint8_t formAvailable(struct Program* program, Atom opcode, const struct Operand* operands, __uint8_t operandCount);
+
+void optimize(struct Code* code, __uint32_t bits, const __uint8_t* available, const __uint64_t* forms, size_t maxRounds);
+
+#endif
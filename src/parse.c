@@ -26,95 +26,148 @@
 #include <string.h>
 #include <errno.h>
 
-#include <libfyaml.h>
-
 #include "tokenize.h"
 #include "codeobjects.h"
+#include "atoms.h"
+#include "translations.h"
+#include "macros.h"
+#include "expression.h"
+#include "statements.h"
 #include "lib/map.h"
 #include "lib/stringutils.h"
 
-void parse(struct Code* input, struct fy_document* translations) {
+static void calculateStatements(struct Code* code, __uint32_t dataBits) {
+  // replace every @{...} token with the immediate it works out to
+  size_t count = 0;
+  size_t capacity = 0;
+  struct StatementView* statements = NULL;
+  size_t* indices = NULL;
+  size_t index = 0;
+  while (index < code->tokens.count) {
+    size_t length = code->tokens.lengths[index];
+    const char* text = codeText(code, code->tokens.offsets[index]);
+    if (tokenType(code, index) == TOKEN_MACRO && length >= 3 && text[1] == '{' && text[length - 1] == '}') {
+      if (count == capacity) {
+        capacity = capacity == 0 ? 64 : capacity * 2;
+        statements = realloc(statements, capacity * sizeof(struct StatementView));
+        indices = realloc(indices, capacity * sizeof(size_t));
+        if (statements == NULL || indices == NULL) {
+          fprintf(stderr, "Error: out of memory while working out statements.\n");
+          exit(-1);
+        }
+      }
+      statements[count].text = text + 2;
+      statements[count].length = length - 3;
+      indices[count] = index;
+      count++;
+    }
+    index++;
+  }
+  if (count == 0) {
+    return;
+  }
+
+  struct ExpressionInput input;
+  memset(&input, 0, sizeof(struct ExpressionInput));
+  input.bits = dataBits;
+  struct StatementResult* results = malloc(count * sizeof(struct StatementResult));
+  if (evaluateStatements(statements, count, &input, results) != 0) {
+    // report the first one that failed, by line
+    size_t lineIndex = 0;
+    size_t statementIndex = 0;
+    while (results[statementIndex].error == NULL) {
+      statementIndex++;
+    }
+    while (lineIndex + 1 < code->lineCount && code->lines[lineIndex + 1].firstToken <= indices[statementIndex]) {
+      lineIndex++;
+    }
+    fprintf(stderr, "Error at line %lu, can't work out \"@{%.*s}\": %s.\n", code->lines[lineIndex].linenumber, (int) statements[statementIndex].length, statements[statementIndex].text, results[statementIndex].error);
+    exit(-1);
+  }
+
+  // each token's text becomes its number, so later steps can write it out as is
+  struct StringBuilder number = newStringBuilder(24);
+  size_t statementIndex = 0;
+  while (statementIndex < count) {
+    builderDelete(&number, 0, number.length);
+    builderAppendUnsigned(&number, (__uint64_t) results[statementIndex].value);
+    struct Token immediate = getToken(code, indices[statementIndex]);
+    immediate.type = TOKEN_IMMEDIATE;
+    immediate.atom = ATOM_NONE;
+    immediate.value = results[statementIndex].value;
+    immediate.offset = addGeneratedText(code, number.data, number.length);
+    immediate.length = number.length;
+    setToken(code, indices[statementIndex], immediate);
+    statementIndex++;
+  }
+  freeStringBuilder(&number);
+  free(results);
+  free(statements);
+  free(indices);
+}
+
+void parse(struct Code* input, struct TranslationTable* translations, __uint8_t nullStrings) {
   struct Code code = *input;
   size_t lineIndex = 0;
   size_t tokenIndex;
-  Map defineMap = empty_map();
-
   __uint128_t dataBitsMacro = 8;
   __uint128_t addressBitsMacro = 8;
   __uint128_t registerMacro = 8;
   __uint128_t ramWordsMacro = 256;
-  uint8_t runRam = 0;
+  __uint8_t runRam = 0;
+
+  // without a translation file (ex. when compiling to bitcode) urcl's own defaults are used
+  if (translations != NULL) {
+    dataBitsMacro = translations->config.dataBus;
+  }
+
+  // step one: replace all @DEFINE macros
+  // (done up front, since a macro can expand into several lines)
+  expandDefines(&code);
+
+  // step two: calculate preprocessor statements, ex. @{BITS*2}
+  // (also done up front, every statement in the program is worked out in one batch)
+  calculateStatements(&code, (__uint32_t) dataBitsMacro);
 
   while (lineIndex < code.lineCount) {
     struct Line line = code.lines[lineIndex];
+    size_t first = line.firstToken;
     tokenIndex = 0;
     while (tokenIndex < line.tokenCount) {
-      struct Token token = line.tokens[tokenIndex];
-      token.type = '\0';
-      token.value = 0;
-
-      printf("Token: \"%s\"\n", token.string);
-
-      // step one: replace all @DEFINE macros
-      
-      // if token is in define list, replace it
-      char* temp;
-      int returnCode = mapGet(&defineMap, token.string, &temp);
-      if (returnCode == 0 && token.string != temp) {
-        printf("Found token \"%s\" to be replaced with \"%s\"\n", token.string, temp);
-        free(token.string);
-        token.string = strdup(temp);
-      }
-      // if token is the first token in a line, capitalize it, and test if it is a define macro
-      if (tokenIndex == 0) {
-        char* capitalized = capitalize(token.string);
-        if (strcmp(capitalized, "@DEFINE") == 0) {
-          // add macro to define map
-          printf("Detected macro at marker %s.\n", line.tokens[line.tokenCount - 1].string);
-          if (line.tokenCount != 4) {
-            fprintf(stderr, "Error at line %s, expected 2 arguments in @DEFINE statement, but got %lu.\n", line.tokens[line.tokenCount - 1].string, line.tokenCount);
+      size_t index = first + tokenIndex;
+
+      // step 3: convert character literals to immediates
+      // (strings stay as string tokens, the data section built below gives each one an address)
+      if (tokenType(&code, index) == TOKEN_STRING) {
+        struct StringData* string = getString(&code, tokenValue(&code, index));
+        if (string->isCharacter) {
+          if (string->length != 1) {
+            fprintf(stderr, "Error at line %lu, character literals must hold exactly one character.\n", line.linenumber);
             exit(-1);
           }
-          printf("Should replace \"%s\" with \"%s\"\n", line.tokens[1].string, line.tokens[2].string);
-          mapAdd(&defineMap, line.tokens[1].string, line.tokens[2].string);
+          struct Token character = getToken(&code, index);
+          character.type = TOKEN_IMMEDIATE;
+          character.value = string->bytes[0];
+          setToken(&code, index, character);
         }
-        free(capitalized);
-      }
-      
-      // TODO step two: calculate defined constants
-      // this will require defining the layout for how a translation file looks, as well as parsing data from translation file,
-      // ideally parse that data into some sort of struct containing maps
-
-      int count;
-      // count = fy_document_scanf(fyd, "/invoice %u /bill-to/given %1023s", &invoice_num, given);
-      count = fy_document_scanf(translations, "/config/cpu/data-bus %u", &dataBitsMacro);
-      if (count == 0) {
-        dataBitsMacro = 8;
       }
-      else if (count > 1) {
-        fprintf(stderr, "Error in provided translation file, expected 0 or 1 definitions of \"/config/cpu/data-bus\", got %u.", count);
-      }
-
-      // step 3: convert strings to immediates
 
       // step 4: replace all strings and constants with decimal immediates
 
-      // step 5: convert hex, bin, and octal imms to decimal
-
-      // step 6: calculate token types
+      // (hex, bin, and octal imms and token types are already worked out by the tokenizer)
 
-      // step 7: store token information in the Code structure
+      // step 5: store token information in the Code structure
 
 
-
-      // write token back to line
-      line.tokens[tokenIndex] = token;
       tokenIndex++;
     }
-    // write line back to lines
-    code.lines[lineIndex] = line;
     lineIndex++;
   }
+
+  // identical strings share one copy in the data section, and strings that end another string point into it
+  buildDataSection(&code.data, &code, (__uint8_t) dataBitsMacro, nullStrings);
+  placeDataSection(&code);
+
   // write back working code copy to main function's code
   *input = code;
   return;
@@ -21,7 +21,8 @@
 #define PARSE_H
 
 #include "codeobjects.h"
+#include "translations.h"
 
-struct Line* parse(struct Code* code, struct fy_document* translations);
+void parse(struct Code* code, struct TranslationTable* translations, __uint8_t nullStrings);
 
 #endif
\ No newline at end of file
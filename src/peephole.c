@@ -0,0 +1,591 @@
+/*
+ * peephole.c: rewrite rules for short runs of instructions, matched through a decision tree
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "peephole.h"
+#include "optimize.h"
+#include "opcodes.h"
+#include "codeobjects.h"
+#include "atoms.h"
+
+#define NO_NODE ((size_t) -1)
+
+// rules are written like instructions, separated by ';'
+// in patterns: A matches any operand, rA only a register, iA only an immediate, a number anything that always reads
+// as that number, and R<n> only that register, using a name twice means both operands have to be the same
+// replacements use the names from the pattern, numbers and R<n>, an empty replacement deletes the matched instructions
+// patterns are tried in this order, and the first one that matches wins
+static const char* defaultRules[][2] = {
+  // moves that don't do anything
+  {"MOV A A", ""},
+  {"MOV rA rB; MOV B A", "MOV A B"},
+  {"PSH A; POP rB", "MOV B A"},
+
+  // operations that leave one operand as it is
+  {"ADD A B 0", "MOV A B"},
+  {"ADD A 0 B", "MOV A B"},
+  {"SUB A B 0", "MOV A B"},
+  {"OR A B 0", "MOV A B"},
+  {"OR A 0 B", "MOV A B"},
+  {"XOR A B 0", "MOV A B"},
+  {"XOR A 0 B", "MOV A B"},
+  {"BSL A B 0", "MOV A B"},
+  {"BSR A B 0", "MOV A B"},
+  {"BSS A B 0", "MOV A B"},
+  {"MLT A B 1", "MOV A B"},
+  {"MLT A 1 B", "MOV A B"},
+  {"DIV A B 1", "MOV A B"},
+  {"SDIV A B 1", "MOV A B"},
+
+  // operations that always give zero
+  {"MLT A B 0", "IMM A 0"},
+  {"MLT A 0 B", "IMM A 0"},
+  {"AND A B 0", "IMM A 0"},
+  {"AND A 0 B", "IMM A 0"},
+  {"SUB A B B", "IMM A 0"},
+  {"XOR A B B", "IMM A 0"},
+
+  // use an immediate directly instead of going through a register
+  // (the IMM stays, it's dropped later if nothing else reads the register)
+  {"IMM rT iX; MOV A rT", "IMM T X; IMM A X"},
+  {"IMM rT iX; ADD A B rT", "IMM T X; ADD A B X"},
+  {"IMM rT iX; ADD A rT B", "IMM T X; ADD A X B"},
+  {"IMM rT iX; SUB A B rT", "IMM T X; SUB A B X"},
+  {"IMM rT iX; SUB A rT B", "IMM T X; SUB A X B"},
+  {"IMM rT iX; AND A B rT", "IMM T X; AND A B X"},
+  {"IMM rT iX; AND A rT B", "IMM T X; AND A X B"},
+  {"IMM rT iX; OR A B rT", "IMM T X; OR A B X"},
+  {"IMM rT iX; OR A rT B", "IMM T X; OR A X B"},
+  {"IMM rT iX; XOR A B rT", "IMM T X; XOR A B X"},
+  {"IMM rT iX; XOR A rT B", "IMM T X; XOR A X B"},
+  {"IMM rT iX; MLT A B rT", "IMM T X; MLT A B X"},
+  {"IMM rT iX; MLT A rT B", "IMM T X; MLT A X B"},
+};
+
+struct Peephole newPeephole() {
+  struct Peephole peephole;
+  memset(&peephole, 0, sizeof(struct Peephole));
+  return peephole;
+}
+
+static void* growList(void* list, size_t count, size_t elementSize) {
+  // lists here only ever grow one entry at a time, so doubling when count hits a power of two is enough
+  if (count != 0 && (count < 16 || (count & (count - 1)) != 0)) {
+    return list;
+  }
+  list = realloc(list, (count == 0 ? 16 : count * 2) * elementSize);
+  if (list == NULL) {
+    fprintf(stderr, "Error: out of memory while building peephole rules.\n");
+    exit(-1);
+  }
+  return list;
+}
+
+struct RuleNames {
+  const char* names[PEEPHOLE_MAX_VARIABLES];
+  size_t lengths[PEEPHOLE_MAX_VARIABLES];
+  __uint8_t count;
+};
+
+static int isNumber(const char* text, size_t length) {
+  size_t index = text[0] == '-' && length > 1 ? 1 : 0;
+  while (index < length) {
+    if (text[index] < '0' || text[index] > '9') {
+      return 0;
+    }
+    index++;
+  }
+  return 1;
+}
+
+static __int128_t readNumber(const char* text, size_t length) {
+  __int128_t value = 0;
+  size_t index = text[0] == '-' ? 1 : 0;
+  while (index < length) {
+    value = value * 10 + (text[index] - '0');
+    index++;
+  }
+  return text[0] == '-' ? -value : value;
+}
+
+static int findName(struct RuleNames* names, const char* text, size_t length) {
+  // returns the variable's index, or -1 if it isn't named in the pattern
+  __uint8_t index = 0;
+  while (index < names->count) {
+    if (names->lengths[index] == length && memcmp(names->names[index], text, length) == 0) {
+      return index;
+    }
+    index++;
+  }
+  return -1;
+}
+
+static int readOperand(struct RuleNames* names, const char* text, size_t length, __uint8_t isPattern, struct PeepholeOperand* output) {
+  // returns 0 on success
+  output->variable = 0;
+  output->value = 0;
+  if (isNumber(text, length)) {
+    output->form = PEEPHOLE_NUMBER;
+    output->value = readNumber(text, length);
+    return 0;
+  }
+  if (length > 1 && text[0] == 'R' && isNumber(text + 1, length - 1)) {
+    output->form = PEEPHOLE_FIXED;
+    output->value = readNumber(text + 1, length - 1);
+    return 0;
+  }
+  output->form = PEEPHOLE_ANY;
+  if (isPattern && length > 1 && (text[0] == 'r' || text[0] == 'i')) {
+    output->form = text[0] == 'r' ? PEEPHOLE_REGISTER : PEEPHOLE_IMMEDIATE;
+    text++;
+    length--;
+  }
+  int variable = findName(names, text, length);
+  if (variable < 0) {
+    if (!isPattern || names->count == PEEPHOLE_MAX_VARIABLES) {
+      return -1;
+    }
+    variable = names->count;
+    names->names[variable] = text;
+    names->lengths[variable] = length;
+    names->count++;
+  }
+  output->variable = (__uint8_t) variable;
+  return 0;
+}
+
+static int readInstructions(struct Peephole* peephole, struct RuleNames* names, const char* text, __uint8_t isPattern, size_t* count) {
+  // append the instructions in text to the rule instruction list
+  // returns 0 on success
+  *count = 0;
+  const char* cursor = text;
+  while (*cursor != '\0') {
+    while (*cursor == ' ' || *cursor == ';') {
+      cursor++;
+    }
+    if (*cursor == '\0') {
+      break;
+    }
+    struct PeepholeInstruction instruction;
+    memset(&instruction, 0, sizeof(struct PeepholeInstruction));
+    __uint8_t wordCount = 0;
+    while (*cursor != '\0' && *cursor != ';') {
+      const char* word = cursor;
+      while (*cursor != '\0' && *cursor != ';' && *cursor != ' ') {
+        cursor++;
+      }
+      size_t length = (size_t) (cursor - word);
+      if (wordCount == 0) {
+        instruction.opcode = upperAtom(&atomTable, intern(&atomTable, word, length));
+        if (opcodeInfo(instruction.opcode) == NULL) {
+          return -1;
+        }
+      }
+      else {
+        if (wordCount > 3 || readOperand(names, word, length, isPattern, &instruction.operands[wordCount - 1]) != 0) {
+          return -1;
+        }
+      }
+      wordCount++;
+      while (*cursor == ' ') {
+        cursor++;
+      }
+    }
+    instruction.operandCount = wordCount - 1;
+    if (instruction.operandCount != opcodeInfo(instruction.opcode)->operandCount || *count == PEEPHOLE_MAX_INSTRUCTIONS) {
+      return -1;
+    }
+    peephole->instructions = growList(peephole->instructions, peephole->instructionCount, sizeof(struct PeepholeInstruction));
+    peephole->instructions[peephole->instructionCount] = instruction;
+    peephole->instructionCount++;
+    (*count)++;
+  }
+  return 0;
+}
+
+int addPeepholeRule(struct Peephole* peephole, const char* pattern, const char* replacement) {
+  // returns 0 on success
+  // call buildPeephole() once every rule has been added
+  struct RuleNames names;
+  names.count = 0;
+  struct PeepholeRule rule;
+  rule.pattern = pattern;
+  rule.firstPattern = peephole->instructionCount;
+  if (readInstructions(peephole, &names, pattern, 1, &rule.patternCount) != 0 || rule.patternCount == 0) {
+    peephole->instructionCount = rule.firstPattern;
+    return -1;
+  }
+  rule.firstReplacement = peephole->instructionCount;
+  if (readInstructions(peephole, &names, replacement, 0, &rule.replacementCount) != 0) {
+    peephole->instructionCount = rule.firstPattern;
+    return -1;
+  }
+  peephole->rules = growList(peephole->rules, peephole->ruleCount, sizeof(struct PeepholeRule));
+  peephole->rules[peephole->ruleCount] = rule;
+  peephole->ruleCount++;
+  if (rule.patternCount > peephole->longestPattern) {
+    peephole->longestPattern = rule.patternCount;
+  }
+  return 0;
+}
+
+// #########################  DECISION TREE  #########################
+
+struct AcceptPair {
+  size_t node;
+  size_t rule;
+};
+
+struct TreeBuilder {
+  struct Peephole* peephole;
+  struct AcceptPair* pairs;
+  size_t pairCount;
+};
+
+static size_t newNode(struct Peephole* peephole) {
+  peephole->nodes = growList(peephole->nodes, peephole->nodeCount, sizeof(struct PeepholeNode));
+  struct PeepholeNode* node = &peephole->nodes[peephole->nodeCount];
+  node->kinds[KIND_REGISTER] = NO_NODE;
+  node->kinds[KIND_IMMEDIATE] = NO_NODE;
+  node->kinds[KIND_OTHER] = NO_NODE;
+  node->opcodes = NO_NODE;
+  node->firstAccept = 0;
+  node->acceptCount = 0;
+  peephole->nodeCount++;
+  return peephole->nodeCount - 1;
+}
+
+static size_t opcodeEdge(struct Peephole* peephole, size_t node, Atom opcode) {
+  // get (or make) the state reached by reading opcode in the given state
+  if (peephole->nodes[node].opcodes == NO_NODE) {
+    size_t first = peephole->opcodeEdgeCount;
+    size_t index = 0;
+    while (index <= ATOM_LAST_OPCODE) {
+      peephole->opcodeEdges = growList(peephole->opcodeEdges, peephole->opcodeEdgeCount, sizeof(size_t));
+      peephole->opcodeEdges[peephole->opcodeEdgeCount] = NO_NODE;
+      peephole->opcodeEdgeCount++;
+      index++;
+    }
+    peephole->nodes[node].opcodes = first;
+  }
+  size_t edge = peephole->nodes[node].opcodes + opcode;
+  if (peephole->opcodeEdges[edge] == NO_NODE) {
+    size_t child = newNode(peephole);
+    peephole->opcodeEdges[edge] = child;
+  }
+  return peephole->opcodeEdges[edge];
+}
+
+static size_t kindEdge(struct Peephole* peephole, size_t node, __uint8_t kind) {
+  if (peephole->nodes[node].kinds[kind] == NO_NODE) {
+    size_t child = newNode(peephole);
+    peephole->nodes[node].kinds[kind] = child;
+  }
+  return peephole->nodes[node].kinds[kind];
+}
+
+static void insertRule(struct TreeBuilder* builder, size_t node, size_t ruleIndex, size_t instructionIndex, __uint8_t operandIndex) {
+  // add every path of operand kinds the rule's pattern can match to the tree
+  struct Peephole* peephole = builder->peephole;
+  struct PeepholeRule* rule = &peephole->rules[ruleIndex];
+  if (instructionIndex == rule->patternCount) {
+    builder->pairs = growList(builder->pairs, builder->pairCount, sizeof(struct AcceptPair));
+    builder->pairs[builder->pairCount].node = node;
+    builder->pairs[builder->pairCount].rule = ruleIndex;
+    builder->pairCount++;
+    return;
+  }
+  struct PeepholeInstruction* instruction = &peephole->instructions[rule->firstPattern + instructionIndex];
+  if (operandIndex == 0) {
+    node = opcodeEdge(peephole, node, instruction->opcode);
+  }
+  if (operandIndex == instruction->operandCount) {
+    insertRule(builder, node, ruleIndex, instructionIndex + 1, 0);
+    return;
+  }
+  struct PeepholeOperand* operand = &instruction->operands[operandIndex];
+  // kinds an operand of this form can have
+  __uint8_t kinds[KIND_COUNT] = {0, 0, 0};
+  switch (operand->form) {
+    case PEEPHOLE_ANY: kinds[KIND_REGISTER] = 1; kinds[KIND_IMMEDIATE] = 1; kinds[KIND_OTHER] = 1; break;
+    case PEEPHOLE_REGISTER:
+    case PEEPHOLE_FIXED: kinds[KIND_REGISTER] = 1; break;
+    case PEEPHOLE_IMMEDIATE: kinds[KIND_IMMEDIATE] = 1; break;
+    case PEEPHOLE_NUMBER: kinds[KIND_IMMEDIATE] = 1; kinds[KIND_REGISTER] = operand->value == 0; break;
+  }
+  __uint8_t kind = 0;
+  while (kind < KIND_COUNT) {
+    if (kinds[kind]) {
+      insertRule(builder, kindEdge(peephole, node, kind), ruleIndex, instructionIndex, operandIndex + 1);
+    }
+    kind++;
+  }
+}
+
+static int comparePairs(const void* a, const void* b) {
+  const struct AcceptPair* first = a;
+  const struct AcceptPair* second = b;
+  if (first->node != second->node) {
+    return first->node < second->node ? -1 : 1;
+  }
+  return first->rule < second->rule ? -1 : first->rule > second->rule;
+}
+
+void buildPeephole(struct Peephole* peephole) {
+  // compile the rules into a tree that's walked one opcode or operand kind at a time,
+  // so matching an instruction costs the same however many rules there are
+  struct TreeBuilder builder;
+  builder.peephole = peephole;
+  builder.pairs = NULL;
+  builder.pairCount = 0;
+  newNode(peephole);
+  size_t ruleIndex = 0;
+  while (ruleIndex < peephole->ruleCount) {
+    insertRule(&builder, 0, ruleIndex, 0, 0);
+    ruleIndex++;
+  }
+
+  // group the rules each state accepts, keeping them in rule order
+  qsort(builder.pairs, builder.pairCount, sizeof(struct AcceptPair), comparePairs);
+  peephole->accepts = malloc((builder.pairCount + 1) * sizeof(size_t));
+  if (peephole->accepts == NULL) {
+    fprintf(stderr, "Error: out of memory while building peephole rules.\n");
+    exit(-1);
+  }
+  size_t pairIndex = 0;
+  while (pairIndex < builder.pairCount) {
+    struct PeepholeNode* node = &peephole->nodes[builder.pairs[pairIndex].node];
+    if (node->acceptCount == 0) {
+      node->firstAccept = pairIndex;
+    }
+    peephole->accepts[pairIndex] = builder.pairs[pairIndex].rule;
+    node->acceptCount++;
+    pairIndex++;
+  }
+  peephole->acceptCount = builder.pairCount;
+  free(builder.pairs);
+}
+
+void loadDefaultRules(struct Peephole* peephole) {
+  size_t index = 0;
+  while (index < sizeof(defaultRules) / sizeof(defaultRules[0])) {
+    if (addPeepholeRule(peephole, defaultRules[index][0], defaultRules[index][1]) != 0) {
+      fprintf(stderr, "Error: peephole rule \"%s\" -> \"%s\" is invalid.\n", defaultRules[index][0], defaultRules[index][1]);
+      exit(-1);
+    }
+    index++;
+  }
+}
+
+// #########################  MATCHING  #########################
+
+static __uint8_t operandKind(struct Operand* operand) {
+  if (operand->type == TOKEN_REGISTER) {
+    return KIND_REGISTER;
+  }
+  if (operand->type == TOKEN_IMMEDIATE) {
+    return KIND_IMMEDIATE;
+  }
+  return KIND_OTHER;
+}
+
+static int checkRule(struct Peephole* peephole, struct Program* program, size_t ruleIndex, const size_t* window, struct Operand* bound) {
+  // check what the tree can't, repeated names and numbers, filling in what each name matched
+  // returns 1 if the rule matches
+  struct PeepholeRule* rule = &peephole->rules[ruleIndex];
+  __uint8_t isBound[PEEPHOLE_MAX_VARIABLES];
+  memset(isBound, 0, sizeof(isBound));
+  size_t instructionIndex = 0;
+  while (instructionIndex < rule->patternCount) {
+    struct PeepholeInstruction* pattern = &peephole->instructions[rule->firstPattern + instructionIndex];
+    struct Instruction* instruction = &program->instructions[window[instructionIndex]];
+    __uint8_t operandIndex = 0;
+    while (operandIndex < pattern->operandCount) {
+      struct PeepholeOperand* expected = &pattern->operands[operandIndex];
+      struct Operand* operand = &instruction->operands[operandIndex];
+      switch (expected->form) {
+        case PEEPHOLE_NUMBER:
+          if (!isConstant(operand, (__uint128_t) expected->value, program->bits)) {
+            return 0;
+          }
+          break;
+        case PEEPHOLE_FIXED:
+          if (operand->value != expected->value) {
+            return 0;
+          }
+          break;
+        default:
+          if (isBound[expected->variable]) {
+            if (!sameOperand(&bound[expected->variable], operand)) {
+              return 0;
+            }
+          }
+          else {
+            bound[expected->variable] = *operand;
+            isBound[expected->variable] = 1;
+          }
+      }
+      operandIndex++;
+    }
+    instructionIndex++;
+  }
+  return 1;
+}
+
+static int sameInstruction(struct Instruction* instruction, struct Instruction* replacement) {
+  if (instruction->opcode != replacement->opcode || instruction->operandCount != replacement->operandCount) {
+    return 0;
+  }
+  __uint8_t operandIndex = 0;
+  while (operandIndex < instruction->operandCount) {
+    if (!sameOperand(&instruction->operands[operandIndex], &replacement->operands[operandIndex]) || instruction->operands[operandIndex].token != replacement->operands[operandIndex].token) {
+      return 0;
+    }
+    operandIndex++;
+  }
+  return 1;
+}
+
+static void applyRule(struct Peephole* peephole, struct Program* program, size_t ruleIndex, const size_t* window, struct Operand* bound) {
+  struct PeepholeRule* rule = &peephole->rules[ruleIndex];
+  size_t position = window[rule->patternCount - 1];
+  size_t index = 0;
+  while (index < rule->replacementCount) {
+    struct PeepholeInstruction* replacement = &peephole->instructions[rule->firstReplacement + index];
+    struct Instruction built;
+    built.opcode = replacement->opcode;
+    built.operandCount = replacement->operandCount;
+    __uint8_t operandIndex = 0;
+    while (operandIndex < replacement->operandCount) {
+      struct PeepholeOperand* operand = &replacement->operands[operandIndex];
+      struct Operand* output = &built.operands[operandIndex];
+      if (operand->form == PEEPHOLE_NUMBER || operand->form == PEEPHOLE_FIXED) {
+        output->type = operand->form == PEEPHOLE_NUMBER ? TOKEN_IMMEDIATE : TOKEN_REGISTER;
+        output->atom = ATOM_NONE;
+        output->value = operand->value;
+        output->token = NEW_TOKEN;
+      }
+      else {
+        *output = bound[operand->variable];
+      }
+      operandIndex++;
+    }
+
+    size_t target;
+    if (index < rule->patternCount) {
+      target = window[index];
+      if (sameInstruction(&program->instructions[target], &built)) {
+        index++;
+        continue;
+      }
+    }
+    else {
+      target = insertInstruction(program, position);
+      position = target;
+    }
+    struct Instruction* instruction = &program->instructions[target];
+    instruction->opcode = built.opcode;
+    instruction->operandCount = built.operandCount;
+    memcpy(instruction->operands, built.operands, sizeof(built.operands));
+    changeInstruction(program, target);
+    index++;
+  }
+  while (index < rule->patternCount) {
+    removeInstruction(program, window[index]);
+    index++;
+  }
+}
+
+static __uint8_t replacementAvailable(struct Peephole* peephole, struct Program* program, struct PeepholeRule* rule) {
+  // returns 1 if the target has every instruction the rule writes
+  size_t index = 0;
+  while (index < rule->replacementCount) {
+    if (!program->available[peephole->instructions[rule->firstReplacement + index].opcode]) {
+      return 0;
+    }
+    index++;
+  }
+  return 1;
+}
+
+int matchPeephole(struct Peephole* peephole, struct Program* program, size_t index) {
+  // try every rule whose pattern starts at this instruction, by walking the tree along the instructions that follow
+  // returns 1 if a rule was applied
+  size_t window[PEEPHOLE_MAX_INSTRUCTIONS];
+  size_t best = NO_NODE;
+  size_t node = 0;
+  size_t depth = 0;
+  size_t current = index;
+  while (current != NO_INSTRUCTION && depth < peephole->longestPattern) {
+    struct Instruction* instruction = &program->instructions[current];
+    if (instruction->opcode == ATOM_NONE || peephole->nodes[node].opcodes == NO_NODE) {
+      break;
+    }
+    // a ~ target can be jumped to on its own, just like a label
+    if (depth > 0 && program->relativeTargets != NULL && program->relativeTargets[current]) {
+      break;
+    }
+    node = peephole->opcodeEdges[peephole->nodes[node].opcodes + instruction->opcode];
+    __uint8_t operandIndex = 0;
+    while (node != NO_NODE && operandIndex < instruction->operandCount) {
+      node = peephole->nodes[node].kinds[operandKind(&instruction->operands[operandIndex])];
+      operandIndex++;
+    }
+    if (node == NO_NODE) {
+      break;
+    }
+    window[depth] = current;
+    depth++;
+
+    // rules ending here are in rule order, so the first one that passes is the only one worth keeping
+    struct PeepholeNode* state = &peephole->nodes[node];
+    struct Operand scratch[PEEPHOLE_MAX_VARIABLES];
+    size_t acceptIndex = 0;
+    while (acceptIndex < state->acceptCount && peephole->accepts[state->firstAccept + acceptIndex] < best) {
+      size_t ruleIndex = peephole->accepts[state->firstAccept + acceptIndex];
+      struct PeepholeRule* rule = &peephole->rules[ruleIndex];
+      // rules that add instructions would shift ~ offsets, and the target has to have what the rule writes
+      __uint8_t fits = (!program->hasRelative || rule->replacementCount <= rule->patternCount) && replacementAvailable(peephole, program, rule);
+      if (fits && checkRule(peephole, program, ruleIndex, window, scratch)) {
+        best = ruleIndex;
+        break;
+      }
+      acceptIndex++;
+    }
+    current = instruction->next;
+  }
+  if (best == NO_NODE) {
+    return 0;
+  }
+  struct Operand bound[PEEPHOLE_MAX_VARIABLES];
+  checkRule(peephole, program, best, window, bound);
+  applyRule(peephole, program, best, window, bound);
+  return 1;
+}
+
+void freePeephole(struct Peephole* peephole) {
+  free(peephole->rules);
+  free(peephole->instructions);
+  free(peephole->nodes);
+  free(peephole->opcodeEdges);
+  free(peephole->accepts);
+  memset(peephole, 0, sizeof(struct Peephole));
+}
@@ -0,0 +1,98 @@
+/*
+ * peephole.h: rewrite rules for short runs of instructions, matched through a decision tree
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+#include "lib/intern.h"
+
+#define PEEPHOLE_MAX_INSTRUCTIONS 4
+#define PEEPHOLE_MAX_VARIABLES 8
+
+// operand forms, the first three bind a variable when they appear in a pattern
+#define PEEPHOLE_ANY 0         // A: any operand
+#define PEEPHOLE_REGISTER 1    // rA: a register
+#define PEEPHOLE_IMMEDIATE 2   // iA: an immediate
+#define PEEPHOLE_NUMBER 3      // 5: anything that always reads as that number (so 0 matches R0 too)
+#define PEEPHOLE_FIXED 4       // R5: that register
+
+// operand kinds the decision tree branches on
+#define KIND_REGISTER 0
+#define KIND_IMMEDIATE 1
+#define KIND_OTHER 2
+#define KIND_COUNT 3
+
+struct PeepholeOperand {
+  __uint8_t form;
+  __uint8_t variable;
+  __int128_t value;
+};
+
+struct PeepholeInstruction {
+  Atom opcode;
+  __uint8_t operandCount;
+  struct PeepholeOperand operands[3];
+};
+
+struct PeepholeRule {
+  const char* pattern;   // rule text, for error messages
+  size_t firstPattern;   // instructions in the pattern and what they get replaced with, in the rule instruction list
+  size_t patternCount;
+  size_t firstReplacement;
+  size_t replacementCount;
+};
+
+// one state of the decision tree, reached after reading some opcodes and operand kinds
+struct PeepholeNode {
+  size_t kinds[KIND_COUNT];  // next state for each kind of the next operand
+  size_t opcodes;            // start of this state's opcode table in the opcode edge list, if a whole instruction was read
+  size_t firstAccept;        // rules whose pattern ends here, in rule order
+  size_t acceptCount;
+};
+
+struct Peephole {
+  struct PeepholeRule* rules;
+  size_t ruleCount;
+  struct PeepholeInstruction* instructions;
+  size_t instructionCount;
+  struct PeepholeNode* nodes;
+  size_t nodeCount;
+  size_t* opcodeEdges;       // ATOM_LAST_OPCODE + 1 entries for each state with an opcode table
+  size_t opcodeEdgeCount;
+  size_t* accepts;           // rule indices, see PeepholeNode
+  size_t acceptCount;
+  size_t longestPattern;
+};
+
+struct Program;
+
+struct Peephole newPeephole();
+
+int addPeepholeRule(struct Peephole* peephole, const char* pattern, const char* replacement);
+
+void buildPeephole(struct Peephole* peephole);
+
+void loadDefaultRules(struct Peephole* peephole);
+
+int matchPeephole(struct Peephole* peephole, struct Program* program, size_t index);
+
+void freePeephole(struct Peephole* peephole);
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * statements.c: works out the @{...} preprocessor statements of a program in one batch
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "statements.h"
+#include "expression.h"
+#include "lib/intern.h"
+
+// statements don't depend on anything but @BITS, so each distinct statement is compiled and run once
+// and every copy of it gets the same result
+
+int evaluateStatements(const struct StatementView* statements, size_t count, const struct ExpressionInput* input, struct StatementResult* results) {
+  // work out every statement in the batch, results has one entry per statement
+  // returns 0 on success
+  // returns -1 if any statement couldn't be worked out, the failing ones have their error set
+  struct InternTable texts = newInternTable();  // atom n is distinct statement n - 1
+  struct StatementResult* distinct = NULL;
+  size_t distinctCount = 0;
+  size_t distinctCapacity = 0;
+  struct ExpressionCode code = {NULL, 0, 0};
+  int status = 0;
+
+  size_t index = 0;
+  while (index < count) {
+    Atom atom = intern(&texts, statements[index].text, statements[index].length);
+    if (atom > distinctCount) {
+      if (distinctCount == distinctCapacity) {
+        distinctCapacity = distinctCapacity == 0 ? 64 : distinctCapacity * 2;
+        distinct = realloc(distinct, distinctCapacity * sizeof(struct StatementResult));
+        if (distinct == NULL) {
+          fprintf(stderr, "Error: out of memory while working out statements.\n");
+          exit(-1);
+        }
+      }
+      struct StatementResult result;
+      result.value = 0;
+      result.error = NULL;
+      code.count = 0;
+      if (compileExpression(statements[index].text, statements[index].length, &code, &result.error) == 0
+          && evaluateExpression(code.ops, code.count, input, &result.value, &result.error) == 0) {
+        result.value = maskToBits(result.value, input->bits);
+      }
+      distinct[distinctCount] = result;
+      distinctCount++;
+    }
+    results[index] = distinct[atom - 1];
+    if (results[index].error != NULL) {
+      status = -1;
+    }
+    index++;
+  }
+
+  free(code.ops);
+  free(distinct);
+  freeInternTable(&texts);
+  return status;
+}
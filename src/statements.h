@@ -0,0 +1,40 @@
+/*
+ * statements.h: works out the @{...} preprocessor statements of a program in one batch
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef STATEMENTS_H
+#define STATEMENTS_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+#include "expression.h"
+
+// a statement as handed to evaluateStatements() in one batch: a view into text owned by the caller,
+// NOT null terminated, so nothing has to be copied or scanned for a terminator
+struct StatementView {
+  const char* text;
+  size_t length;
+};
+
+struct StatementResult {
+  __int128_t value;   // masked to @BITS
+  const char* error;  // NULL if the statement worked out
+};
+
+int evaluateStatements(const struct StatementView* statements, size_t count, const struct ExpressionInput* input, struct StatementResult* results);
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * stream.c: streaming front end, runs programs through the toolchain a window of lines at a time so
+ *           memory use depends on the longest line rather than the size of the program
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+
+#include "lib/arena.h"
+#include "lib/intern.h"
+#include "codeobjects.h"
+#include "tokenize.h"
+#include "atoms.h"
+#include "macros.h"
+#include "stream.h"
+
+// ##########################  WINDOWS  ##########################
+
+int openStream(char* path, struct Stream* output) {
+  // returns 0 on success
+  // returns -1 if the file could not be opened, errno is left set by open()
+  output->file = open(path, O_RDONLY);
+  if (output->file < 0) {
+    return -1;
+  }
+  posix_fadvise(output->file, 0, 0, POSIX_FADV_SEQUENTIAL);
+  output->windowSize = STREAM_WINDOW_SIZE;
+  output->window = malloc(output->windowSize);
+  output->windowLength = 0;
+  output->consumed = 0;
+  output->endOfFile = 0;
+  output->state = LEX_CODE;
+  output->lineNumber = 1;
+  output->hasCode = 0;
+  return 0;
+}
+
+static int fillWindow(struct Stream* stream) {
+  // read until the window is full or the file runs out
+  // returns 0 on success, -1 on read errors
+  while (!stream->endOfFile && stream->windowLength < stream->windowSize) {
+    ssize_t count = read(stream->file, stream->window + stream->windowLength, stream->windowSize - stream->windowLength);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (count == 0) {
+      stream->endOfFile = 1;
+    }
+    stream->windowLength += count;
+  }
+  return 0;
+}
+
+int nextBatch(struct Stream* stream) {
+  // tokenize the next batch of whole lines into stream->code, the previous batch is freed
+  // returns 1 if there is a batch, 0 at the end of the file, and -1 on read errors
+  if (stream->hasCode) {
+    freeCode(&stream->code);
+    stream->hasCode = 0;
+    memmove(stream->window, stream->window + stream->consumed, stream->windowLength - stream->consumed);
+    stream->windowLength -= stream->consumed;
+    stream->consumed = 0;
+  }
+
+  while (1) {
+    if (fillWindow(stream) != 0) {
+      return -1;
+    }
+    if (stream->endOfFile && stream->windowLength == 0) {
+      return 0;
+    }
+
+    stream->code = newCode(stream->window, stream->windowLength);
+    struct Lexer lexer = newLexer(&stream->code, &atomTable, stream->state, stream->lineNumber);
+    if (stream->endOfFile) {
+      // last window, lex everything that's left as normal
+      lexRange(&lexer, 0, stream->windowLength, 1);
+      stream->consumed = stream->windowLength;
+      stream->state = lexer.state;
+      stream->lineNumber = lexer.lineNumber;
+      stream->hasCode = 1;
+      return 1;
+    }
+
+    // lex up to the last newline, errors aren't fatal since a string might just carry on into the next window
+    lexer.fatalErrors = 0;
+    const char* lastNewline = memrchr(stream->window, '\n', stream->windowLength);
+    if (lastNewline != NULL) {
+      lexRange(&lexer, 0, lastNewline - stream->window + 1, 0);
+    }
+    if (lexer.lineEndIndex != 0) {
+      // drop the tokens of the unfinished line, they get lexed again at the start of the next window
+      stream->code.tokens.count = lexer.lineStart;
+      stream->consumed = lexer.lineEndIndex;
+      stream->state = lexer.lineEndState;
+      stream->lineNumber = lexer.lineNumber;
+      stream->hasCode = 1;
+      return 1;
+    }
+
+    // not even one line fits in the window
+    freeCode(&stream->code);
+    stream->windowSize *= 2;
+    stream->window = realloc(stream->window, stream->windowSize);
+  }
+}
+
+void closeStream(struct Stream* stream) {
+  if (stream->hasCode) {
+    freeCode(&stream->code);
+  }
+  free(stream->window);
+  close(stream->file);
+  stream->window = NULL;
+}
+
+// ########################  SYMBOL TABLE  ########################
+
+struct SymbolTable newSymbolTable() {
+  struct SymbolTable table;
+  table.defines = newCode(NULL, 0);
+  table.labels = NULL;
+  table.capacity = 0;
+  table.references = NULL;
+  table.referenceCount = 0;
+  table.referenceCapacity = 0;
+  table.address = 0;
+  return table;
+}
+
+static void growSymbolTable(struct SymbolTable* table) {
+  // make room for every atom interned so far
+  if (table->capacity >= atomTable.count) {
+    return;
+  }
+  size_t newCapacity = table->capacity == 0 ? 1024 : table->capacity;
+  while (newCapacity < atomTable.count) {
+    newCapacity *= 2;
+  }
+  table->labels = realloc(table->labels, newCapacity * sizeof(__uint64_t));
+  if (table->labels == NULL) {
+    fprintf(stderr, "Error: out of memory while streaming.\n");
+    exit(-1);
+  }
+  memset(table->labels + table->capacity, 0, (newCapacity - table->capacity) * sizeof(__uint64_t));
+  table->capacity = newCapacity;
+}
+
+static void addReference(struct SymbolTable* table, Atom label, __uint64_t linenumber) {
+  if (table->referenceCount == table->referenceCapacity) {
+    table->referenceCapacity = table->referenceCapacity == 0 ? 256 : table->referenceCapacity * 2;
+    table->references = realloc(table->references, table->referenceCapacity * sizeof(struct LabelReference));
+    if (table->references == NULL) {
+      fprintf(stderr, "Error: out of memory while streaming.\n");
+      exit(-1);
+    }
+  }
+  struct LabelReference reference;
+  reference.label = label;
+  reference.linenumber = linenumber;
+  table->references[table->referenceCount] = reference;
+  table->referenceCount++;
+}
+
+static size_t copyToken(struct Code* to, struct Code* from, size_t index) {
+  // copy a token along with its text (and its string, which gets a new id in to), returns its index in to
+  struct Token token = getToken(from, index);
+  token.offset = addGeneratedText(to, codeText(from, token.offset), token.length);
+  if ((token.type & ~TOKEN_WIDE) == TOKEN_STRING) {
+    __uint64_t id = to->stringMap.length + 1;
+    if (addString(to, id, copyString(&to->arena, getString(from, token.value))) != 0) {
+      printf("Error while trying to add string %lu to map\n", id);
+      exit(-1);
+    }
+    token.value = id;
+  }
+  return addToken(to, token);
+}
+
+static void expandBatch(struct SymbolTable* table, struct Code* code) {
+  // expand @DEFINEs with expandDefines(), which only knows about the code it's given, so the defines of
+  // earlier batches are copied in as lines in front of this one, and this batch's defines are kept for the next
+  size_t lineCount = table->defines.lineCount + code->lineCount;
+  struct Line* lines = arenaAlloc(&code->arena, lineCount * sizeof(struct Line));
+  size_t lineIndex = 0;
+  while (lineIndex < table->defines.lineCount) {
+    struct Line line = table->defines.lines[lineIndex];
+    struct Line copy = line;
+    size_t tokenIndex = 0;
+    while (tokenIndex < line.tokenCount) {
+      size_t index = copyToken(code, &table->defines, line.firstToken + tokenIndex);
+      if (tokenIndex == 0) {
+        copy.firstToken = index;
+      }
+      tokenIndex++;
+    }
+    lines[lineIndex] = copy;
+    lineIndex++;
+  }
+  memcpy(lines + table->defines.lineCount, code->lines, code->lineCount * sizeof(struct Line));
+
+  lineIndex = 0;
+  while (lineIndex < code->lineCount) {
+    struct Line line = code->lines[lineIndex];
+    if (upperAtom(&atomTable, code->tokens.atoms[line.firstToken]) == ATOM_MACRO_DEFINE) {
+      struct Code* defines = &table->defines;
+      if (defines->lineCount % 64 == 0) {
+        defines->lines = arenaGrow(&defines->arena, defines->lines, defines->lineCount * sizeof(struct Line), (defines->lineCount + 64) * sizeof(struct Line));
+      }
+      struct Line copy = line;
+      size_t tokenIndex = 0;
+      while (tokenIndex < line.tokenCount) {
+        size_t index = copyToken(defines, code, line.firstToken + tokenIndex);
+        if (tokenIndex == 0) {
+          copy.firstToken = index;
+        }
+        tokenIndex++;
+      }
+      defines->lines[defines->lineCount] = copy;
+      defines->lineCount++;
+    }
+    lineIndex++;
+  }
+
+  code->lines = lines;
+  code->lineCount = lineCount;
+  expandDefines(code);
+}
+
+void emitLines(struct SymbolTable* table, struct Code* code, FILE* output) {
+  // write a batch of lines out as cleaned urcl, applying @DEFINEs and recording labels as it goes
+  expandBatch(table, code);
+  growSymbolTable(table);
+  Atom* atoms = code->tokens.atoms;
+  size_t lineIndex = 0;
+  while (lineIndex < code->lineCount) {
+    struct Line line = code->lines[lineIndex];
+    size_t first = line.firstToken;
+    Atom opcode = upperAtom(&atomTable, atoms[first]);
+
+    if (line.tokenCount == 1 && code->tokens.types[first] == TOKEN_LABEL) {
+      if (table->labels[atoms[first]] != 0) {
+        fprintf(stderr, "Error at line %lu, label \"%s\" is defined more than once.\n", line.linenumber, atomString(&atomTable, atoms[first]));
+        exit(-1);
+      }
+      table->labels[atoms[first]] = table->address + 1;
+    }
+    else if ((opcode >= ATOM_FIRST_OPCODE && opcode <= ATOM_LAST_OPCODE) || opcode == ATOM_DW) {
+      table->address++;
+    }
+
+    size_t tokenIndex = 0;
+    while (tokenIndex < line.tokenCount) {
+      size_t index = first + tokenIndex;
+      if (tokenIndex != 0) {
+        fputc(' ', output);
+        // labels used before they are defined get checked once the whole program has gone past
+        if ((code->tokens.types[index] & ~TOKEN_WIDE) == TOKEN_LABEL && table->labels[atoms[index]] == 0) {
+          addReference(table, atoms[index], line.linenumber);
+        }
+      }
+      fwrite(codeText(code, code->tokens.offsets[index]), sizeof(char), code->tokens.lengths[index], output);
+      tokenIndex++;
+    }
+    fputc('\n', output);
+    lineIndex++;
+  }
+}
+
+int checkLabels(struct SymbolTable* table) {
+  // returns 0 on success
+  // returns -1 if a label was used but never defined
+  size_t referenceIndex = 0;
+  while (referenceIndex < table->referenceCount) {
+    struct LabelReference* reference = &table->references[referenceIndex];
+    if (table->labels[reference->label] == 0) {
+      fprintf(stderr, "Error at line %lu, label \"%s\" is never defined.\n", reference->linenumber, atomString(&atomTable, reference->label));
+      return -1;
+    }
+    referenceIndex++;
+  }
+  return 0;
+}
+
+void freeSymbolTable(struct SymbolTable* table) {
+  freeCode(&table->defines);
+  free(table->labels);
+  free(table->references);
+}
+
+// ##########################  PIPELINE  ##########################
+
+int streamFile(char* path, FILE* output) {
+  // run a whole file through tokenizing and cleaning one batch at a time, only the symbol table is kept between batches
+  // returns 0 on success
+  // returns -1 if the file could not be read, errno is left set by the failing call
+  struct Stream stream;
+  if (openStream(path, &stream) != 0) {
+    return -1;
+  }
+  struct SymbolTable table = newSymbolTable();
+  int result;
+  while ((result = nextBatch(&stream)) == 1) {
+    emitLines(&table, &stream.code, output);
+  }
+  closeStream(&stream);
+  if (result == 0 && checkLabels(&table) != 0) {
+    exit(-1);
+  }
+  freeSymbolTable(&table);
+  return result;
+}
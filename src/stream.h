@@ -0,0 +1,77 @@
+/*
+ * stream.h: streaming front end, runs programs through the toolchain a window of lines at a time
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+#include <bits/types.h>
+
+#include "codeobjects.h"
+#include "lib/intern.h"
+
+// starting window size, windows only grow past this for single lines that don't fit
+#define STREAM_WINDOW_SIZE (1 << 20)
+
+// reads a file a window at a time and hands it out as batches of whole lines
+struct Stream {
+  int file;
+  char* window;           // unfinished tail of the last batch followed by newly read input
+  size_t windowSize;
+  size_t windowLength;
+  size_t consumed;        // bytes at the start of the window that belong to the current batch
+  __uint8_t endOfFile;
+  __uint8_t state;        // lexer state at the start of the window
+  __uint64_t lineNumber;  // source line the window starts on
+  struct Code code;       // current batch, its source points into the window
+  __uint8_t hasCode;
+};
+
+// a use of a label that wasn't defined yet when it was emitted, checked once the whole program has gone past
+struct LabelReference {
+  Atom label;
+  __uint64_t linenumber;
+};
+
+// everything that has to outlive a single batch
+struct SymbolTable {
+  struct Code defines;     // every @DEFINE line so far, replayed in front of each batch before it's expanded
+  __uint64_t* labels;      // address of each label plus one, 0 if not defined yet, indexed by atom
+  size_t capacity;
+  struct LabelReference* references;
+  size_t referenceCount;
+  size_t referenceCapacity;
+  __uint64_t address;      // number of instructions and data words emitted so far
+};
+
+int openStream(char* path, struct Stream* output);
+
+int nextBatch(struct Stream* stream);
+
+void closeStream(struct Stream* stream);
+
+struct SymbolTable newSymbolTable();
+
+void emitLines(struct SymbolTable* table, struct Code* code, FILE* output);
+
+int checkLabels(struct SymbolTable* table);
+
+void freeSymbolTable(struct SymbolTable* table);
+
+int streamFile(char* path, FILE* output);
+
+#endif
@@ -0,0 +1,328 @@
+/*
+ * strength.c: rewrites multiplies and divides by constants into cheaper instructions
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strength.h"
+#include "optimize.h"
+#include "opcodes.h"
+#include "codeobjects.h"
+#include "atoms.h"
+
+// the magic number search works in 2 * bits + 1 bit numbers, and UMLT only folds up to 64 bits
+#define MAGIC_MAX_BITS 63
+
+#define NOT_POWER ((__uint32_t) -1)
+
+struct Reduction {
+  struct Program* program;
+  size_t at;              // last instruction written, the first one written replaces the original
+  __uint8_t started;
+  struct Operand dest;
+  struct Operand source;  // the register operand, the other one is the constant
+  __uint128_t constant;
+  __uint32_t power;       // constant is 1 << power, NOT_POWER if it isn't a power of two
+};
+
+static struct Operand immediate(__uint128_t value) {
+  struct Operand operand = {TOKEN_IMMEDIATE, ATOM_NONE, (__int128_t) value, NEW_TOKEN};
+  return operand;
+}
+
+static struct Operand zeroRegister(void) {
+  struct Operand operand = {TOKEN_REGISTER, ATOM_NONE, 0, NEW_TOKEN};
+  return operand;
+}
+
+static void emit(struct Reduction* reduction, Atom opcode, struct Operand a, struct Operand b, struct Operand c) {
+  // write the next instruction of the sequence
+  struct Program* program = reduction->program;
+  if (reduction->started) {
+    reduction->at = insertInstruction(program, reduction->at);
+  }
+  reduction->started = 1;
+  struct Instruction* instruction = &program->instructions[reduction->at];
+  instruction->opcode = opcode;
+  instruction->operandCount = opcodeInfo(opcode)->operandCount;
+  instruction->operands[0] = a;
+  instruction->operands[1] = b;
+  instruction->operands[2] = c;
+  changeInstruction(program, reduction->at);
+}
+
+static __uint8_t has(struct Reduction* reduction, Atom opcode) {
+  return reduction->program->available[opcode];
+}
+
+static void emitShiftLeft(struct Reduction* reduction, struct Operand a, struct Operand b) {
+  if (has(reduction, ATOM_LSH)) {
+    emit(reduction, ATOM_LSH, a, b, zeroRegister());
+  }
+  else {
+    emit(reduction, ATOM_ADD, a, b, b);
+  }
+}
+
+static void emitMove(struct Reduction* reduction, struct Operand a, struct Operand b) {
+  if (has(reduction, ATOM_MOV)) {
+    emit(reduction, ATOM_MOV, a, b, zeroRegister());
+  }
+  else {
+    emit(reduction, ATOM_ADD, a, b, zeroRegister());
+  }
+}
+
+static int fits(struct Reduction* reduction, size_t steps) {
+  // returns 1 if the original instruction can become steps instructions
+  // (relative jumps count instructions, so with them around only one for one swaps are made)
+  return steps == 1 || !reduction->program->hasRelative;
+}
+
+static int findMagic(__uint128_t divisor, __uint32_t bits, __uint128_t* multiplier, __uint32_t* shift) {
+  // find a multiplier that fits in bits so x / divisor == (x * multiplier) >> (bits + shift) for every bits wide x
+  // rounding the multiplier up is off by at most error / divisor * x / 2^p, which never reaches the next
+  // multiple of the divisor as long as error <= 2^(p - bits)
+  // returns 0 on success
+  __uint128_t limit = (__uint128_t) 1 << bits;
+  __uint32_t p = bits;
+  while (p < 2 * bits) {
+    __uint128_t power = (__uint128_t) 1 << p;
+    __uint128_t candidate = (power + divisor - 1) / divisor;
+    if (candidate >= limit) {
+      return -1;
+    }
+    if (candidate * divisor - power <= (__uint128_t) 1 << (p - bits)) {
+      *multiplier = candidate;
+      *shift = p - bits;
+      return 0;
+    }
+    p++;
+  }
+  return -1;
+}
+
+static int reduceMultiply(struct Reduction* reduction) {
+  // MLT by 2^n is n left shifts, by anything else shifts and adds the source in bit by bit (Horner's method)
+  // targets with a real MLT only get the single BSL
+  // (moves and shifts fall back to ADD, so that's all the long forms need)
+  struct Program* program = reduction->program;
+  __uint32_t power = reduction->power;
+  if (power != NOT_POWER) {
+    if (power == 0) {
+      return 0;
+    }
+    if (has(reduction, ATOM_BSL)) {
+      emit(reduction, ATOM_BSL, reduction->dest, reduction->source, immediate(power));
+      return 1;
+    }
+    if ((!has(reduction, ATOM_LSH) && !has(reduction, ATOM_ADD)) || !fits(reduction, power)) {
+      return 0;
+    }
+    emitShiftLeft(reduction, reduction->dest, reduction->source);
+    while (power > 1) {
+      emitShiftLeft(reduction, reduction->dest, reduction->dest);
+      power--;
+    }
+    return 1;
+  }
+  // the source is added back in after the destination has been written, so they can't be the same register
+  if (has(reduction, ATOM_MLT) || !has(reduction, ATOM_ADD) || reduction->dest.value == reduction->source.value) {
+    return 0;
+  }
+  __uint32_t top = 0;
+  __uint32_t setBits = 0;
+  __uint32_t bit = 0;
+  while (bit < program->bits) {
+    if ((reduction->constant >> bit) & 1) {
+      top = bit;
+      setBits++;
+    }
+    bit++;
+  }
+  if (!fits(reduction, top + setBits)) {
+    return 0;
+  }
+  emitMove(reduction, reduction->dest, reduction->source);
+  bit = top;
+  while (bit > 0) {
+    bit--;
+    emitShiftLeft(reduction, reduction->dest, reduction->dest);
+    if ((reduction->constant >> bit) & 1) {
+      emit(reduction, ATOM_ADD, reduction->dest, reduction->dest, reduction->source);
+    }
+  }
+  return 1;
+}
+
+static int reduceHighMultiply(struct Reduction* reduction) {
+  // the high half of x * 2^n is x shifted right by bits - n
+  struct Program* program = reduction->program;
+  if (reduction->power == NOT_POWER) {
+    return 0;
+  }
+  if (reduction->power == 0) {
+    if (!has(reduction, ATOM_IMM)) {
+      return 0;
+    }
+    emit(reduction, ATOM_IMM, reduction->dest, immediate(0), zeroRegister());
+    return 1;
+  }
+  __uint32_t shift = program->bits - reduction->power;
+  if (has(reduction, ATOM_BSR)) {
+    emit(reduction, ATOM_BSR, reduction->dest, reduction->source, immediate(shift));
+    return 1;
+  }
+  if (!has(reduction, ATOM_RSH) || !fits(reduction, shift)) {
+    return 0;
+  }
+  emit(reduction, ATOM_RSH, reduction->dest, reduction->source, zeroRegister());
+  while (shift > 1) {
+    emit(reduction, ATOM_RSH, reduction->dest, reduction->dest, zeroRegister());
+    shift--;
+  }
+  return 1;
+}
+
+static int reduceDivide(struct Reduction* reduction) {
+  // DIV by 2^n is n right shifts, with UMLT anything else is a multiply by the divisor's reciprocal
+  struct Program* program = reduction->program;
+  __uint32_t power = reduction->power;
+  if (power == 0) {
+    return 0;
+  }
+  if (power != NOT_POWER) {
+    if (has(reduction, ATOM_BSR)) {
+      emit(reduction, ATOM_BSR, reduction->dest, reduction->source, immediate(power));
+      return 1;
+    }
+    if (!has(reduction, ATOM_RSH) || !fits(reduction, power)) {
+      return 0;
+    }
+    emit(reduction, ATOM_RSH, reduction->dest, reduction->source, zeroRegister());
+    while (power > 1) {
+      emit(reduction, ATOM_RSH, reduction->dest, reduction->dest, zeroRegister());
+      power--;
+    }
+    return 1;
+  }
+  __uint128_t multiplier;
+  __uint32_t shift;
+  if (!has(reduction, ATOM_UMLT) || program->bits > MAGIC_MAX_BITS || findMagic(reduction->constant, program->bits, &multiplier, &shift) != 0) {
+    return 0;
+  }
+  if ((shift > 0 && !has(reduction, ATOM_BSR)) || !fits(reduction, shift > 0 ? 2 : 1)) {
+    return 0;
+  }
+  emit(reduction, ATOM_UMLT, reduction->dest, reduction->source, immediate(multiplier));
+  if (shift > 0) {
+    emit(reduction, ATOM_BSR, reduction->dest, reduction->dest, immediate(shift));
+  }
+  return 1;
+}
+
+static int reduceSignedDivide(struct Reduction* reduction) {
+  // SDIV by 2^n rounds towards zero, so negative numbers get 2^n - 1 added before the arithmetic shift
+  // the bias is built in the destination, which is why it can't be the source
+  struct Program* program = reduction->program;
+  __uint32_t power = reduction->power;
+  if (!has(reduction, ATOM_BSS) || !has(reduction, ATOM_BSR) || !has(reduction, ATOM_ADD) || power == NOT_POWER || power == 0 || power + 1 >= program->bits) {
+    return 0;
+  }
+  if (reduction->dest.value == reduction->source.value || !fits(reduction, 4)) {
+    return 0;
+  }
+  emit(reduction, ATOM_BSS, reduction->dest, reduction->source, immediate(program->bits - 1));
+  emit(reduction, ATOM_BSR, reduction->dest, reduction->dest, immediate(program->bits - power));
+  emit(reduction, ATOM_ADD, reduction->dest, reduction->dest, reduction->source);
+  emit(reduction, ATOM_BSS, reduction->dest, reduction->dest, immediate(power));
+  return 1;
+}
+
+static int reduceModulo(struct Reduction* reduction) {
+  // MOD by 2^n keeps the low n bits, targets without AND do it as NOR(NOR(x, x), ~mask)
+  struct Program* program = reduction->program;
+  if (reduction->power == NOT_POWER) {
+    return 0;
+  }
+  __uint128_t mask = reduction->constant - 1;
+  if (has(reduction, ATOM_AND)) {
+    emit(reduction, ATOM_AND, reduction->dest, reduction->source, immediate(mask));
+    return 1;
+  }
+  if (!has(reduction, ATOM_NOR) || !fits(reduction, 2)) {
+    return 0;
+  }
+  __uint128_t width = program->bits >= 128 ? ~(__uint128_t) 0 : ((__uint128_t) 1 << program->bits) - 1;
+  emit(reduction, ATOM_NOR, reduction->dest, reduction->source, reduction->source);
+  emit(reduction, ATOM_NOR, reduction->dest, reduction->dest, immediate(~mask & width));
+  return 1;
+}
+
+int reduceStrength(struct Program* program, size_t index) {
+  // multiplies and divides by a constant become shifts, adds and masks the target has
+  // which ones depends on the instructions the target has, see Program.available
+  // returns 1 if the instruction was rewritten
+  struct Instruction* instruction = &program->instructions[index];
+  Atom opcode = instruction->opcode;
+  if (opcode != ATOM_MLT && opcode != ATOM_UMLT && opcode != ATOM_DIV && opcode != ATOM_SDIV && opcode != ATOM_MOD) {
+    return 0;
+  }
+  struct Operand* operands = instruction->operands;
+  if (operands[0].type != TOKEN_REGISTER) {
+    return 0;
+  }
+  struct Reduction reduction;
+  memset(&reduction, 0, sizeof(struct Reduction));
+  reduction.program = program;
+  reduction.at = index;
+  reduction.dest = operands[0];
+  if (operands[1].type == TOKEN_REGISTER && operands[1].value != 0 && constantOperand(&operands[2], &reduction.constant) == 0) {
+    reduction.source = operands[1];
+  }
+  else if ((opcode == ATOM_MLT || opcode == ATOM_UMLT) && operands[2].type == TOKEN_REGISTER && operands[2].value != 0 && constantOperand(&operands[1], &reduction.constant) == 0) {
+    // multiplies don't care about operand order
+    reduction.source = operands[2];
+  }
+  else {
+    return 0;
+  }
+  if (program->bits < 128) {
+    reduction.constant &= ((__uint128_t) 1 << program->bits) - 1;
+  }
+  if (reduction.constant == 0) {
+    // the zero rules deal with multiplies, and dividing by zero is left for the target to decide
+    return 0;
+  }
+  reduction.power = NOT_POWER;
+  if ((reduction.constant & (reduction.constant - 1)) == 0) {
+    reduction.power = 0;
+    while ((reduction.constant >> reduction.power) != 1) {
+      reduction.power++;
+    }
+  }
+
+  switch (opcode) {
+    case ATOM_MLT: return reduceMultiply(&reduction);
+    case ATOM_UMLT: return reduceHighMultiply(&reduction);
+    case ATOM_DIV: return reduceDivide(&reduction);
+    case ATOM_SDIV: return reduceSignedDivide(&reduction);
+    default: return reduceModulo(&reduction);
+  }
+}
@@ -22,9 +22,15 @@
 #include <getopt.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "lib/stringutils.h"
 #include "lib/map.h"
+#include "lib/arena.h"
+#include "lib/intern.h"
+#include "lib/scan.h"
 #include "codeobjects.h"
+#include "atoms.h"
+#include "tokenize.h"
 
 // #############################   CODE  #############################
 
@@ -34,361 +40,707 @@ struct TokenizedOutput {
   size_t lineCount;
 };
 
-char* stringToArray(char* input) {
-  char* output = malloc((strlen(input) + 1) * sizeof(char));
-  strcpy(output, input);
-  // convert string literal to an array of integers represented in ascii
-
-  unsigned char isString = 1;
+// byte sets are built by initTokenizer()
+static struct ByteSet backslash;
 
-// step 1: drop quote marks and calculate string length
-  if (output[0] == '\'') {
-    isString = 0;
-  }
-  deleteStringInPlace(&output, 0, 0);
-  size_t endIndex = strlen(output) - 1;
-  deleteStringInPlace(&output, endIndex, endIndex);
-  // endIndex is the string length
-  //printf("String length: %lu\n", endIndex);
-
-// step 2: replace escape sequences with actual characters
-  size_t stringIndex = 0;
-  char c;
-  char prev = 0;
-  
-  while (stringIndex < strlen(output)) {
-    c = output[stringIndex];
-
-    if (prev == '\\') {
-      char* replacement;
-      char escapeCode[3];
-      escapeCode[0] = '\\';
-      escapeCode[1] = c;
-      escapeCode[2] = '\0';
-
-      if (replaceEscapeCode(&replacement, escapeCode) == 0) {
-        printf("replacing escape code \"%s\"\n", escapeCode);
-        replaceStringInPlace(&output, replacement, stringIndex - 1, stringIndex);
-        stringIndex--;
-      }
+struct StringData* decodeLiteral(struct Arena* arena, const char* literal, size_t length) {
+  // turn a quoted string or character literal into its bytes in one pass, escapes included
+  // the decoded bytes are never longer than the literal, so the output is allocated once up front
+  struct StringData* output = arenaAlloc(arena, sizeof(struct StringData) + length);
+  output->isCharacter = literal[0] == '\'';
+  size_t outputLength = 0;
+  size_t index = 1;
+  size_t end = length - 1;  // closing quote
+  while (index < end) {
+    // copy everything up to the next backslash in one go
+    size_t runEnd = scanAny(literal, index, end, &backslash);
+    memcpy(output->bytes + outputLength, literal + index, runEnd - index);
+    outputLength += runEnd - index;
+    index = runEnd;
+    if (index >= end) {
+      break;
+    }
+    if (index + 1 >= end) {
+      // backslash right before the closing quote is kept as is
+      output->bytes[outputLength] = '\\';
+      outputLength++;
+      break;
     }
-    stringIndex++;
-    prev = c;
-  } 
+    char escaped;
+    switch (literal[index + 1]) {
+      case '\\': escaped = '\\'; break;
+      case '/': escaped = '/'; break;
+      case '"': escaped = '"'; break;
+      case '\'': escaped = '\''; break;
+      case '0': escaped = '\0'; break;
+      case 'b': escaped = '\b'; break;
+      case 'f': escaped = '\f'; break;
+      case 'n': escaped = '\n'; break;
+      case 'r': escaped = '\r'; break;
+      case 't': escaped = '\t'; break;
+      case 'v': escaped = '\v'; break;
+      default:
+        printf("Warning: Unrecognized escape code \"\\%c\"\n", literal[index + 1]);
+        // keep unrecognized escapes as they were written
+        output->bytes[outputLength] = '\\';
+        outputLength++;
+        index++;
+        continue;
+    }
+    output->bytes[outputLength] = escaped;
+    outputLength++;
+    index += 2;
+  }
+  output->length = outputLength;
+  return output;
+}
 
-// step 3: pass to stringToAscii()
-  if (isString) {
-    stringToIntStringInPlace(&output);
-    // add square brackets around list of immediates
-    insertStringInPlace(&output, "[", 0);
-    insertStringInPlace(&output, "]", strlen(output));
+char* stringToArray(char* input) {
+  // convert string literal to an array of integers represented in ascii, only used for printing
+  // ex. "hi\n" -> "[104 105 10 0]", 'a' -> "97"
+  struct Arena arena = newArena(strlen(input) + sizeof(struct StringData) + 16);
+  struct StringData* string = decodeLiteral(&arena, input, strlen(input));
+  struct StringBuilder output = newStringBuilder(string->length * 4 + 3);
+  if (!string->isCharacter) {
+    builderAppendChar(&output, '[');
+    size_t index = 0;
+    while (index < string->length) {
+      builderAppendUnsigned(&output, string->bytes[index]);
+      builderAppendChar(&output, ' ');
+      index++;
+    }
+    builderAppend(&output, "0]", 2);
   }
-  else {
-    char* temp = byteToAscii(output[0]);
-    free(output);
-    output = temp;
-    temp = NULL;
+  else if (string->length > 0) {
+    builderAppendUnsigned(&output, string->bytes[0]);
   }
-  return output;
+  arenaFree(&arena);
+  return builderFinish(&output);
 }
 
+static struct ByteSet whitespace;
+
 char* stripWhitespace(char* input) {
   // remove all excess whitespace from a line of urcl code
   // ex. "   ADD      R1 r2            R3   " -> "ADD R1 r2 R3"
+  // whole runs of text and whitespace are found at once and copied across, rather than deleting one run at a time
+  size_t length = strlen(input);
+  struct StringBuilder output = newStringBuilder(length);
+  size_t index = scanNotAny(input, 0, length, &whitespace);
+  while (index < length) {
+    size_t textEnd = scanAny(input, index, length, &whitespace);
+    if (output.length != 0) {
+      builderAppendChar(&output, ' ');
+    }
+    builderAppend(&output, input + index, textEnd - index);
+    index = scanNotAny(input, textEnd, length, &whitespace);
+  }
+  return builderFinish(&output);
+}
+
+static struct Token makeToken(char type, size_t offset, size_t length, __int128_t value) {
+  struct Token token;
+  token.type = type;
+  token.offset = offset;
+  token.length = length;
+  token.atom = ATOM_NONE;
+  token.value = value;
+  return token;
+}
+
+static int isDigits(const char* text, size_t length) {
+  if (length == 0) {
+    return 0;
+  }
   size_t index = 0;
-  size_t whiteStart = 0;
-  size_t whiteEnd = 0;
-  int hasToken = 0;
-  int inWhitespace = 0;
-
-  char* workingCopy;
-  workingCopy = malloc((strlen(input) + 1) * sizeof(char));
-  strcpy(workingCopy, input);
-
-  char c = workingCopy[index];
-  while (c != '\0') {
-    if (inWhitespace) {
-      if (isWhitespace(c)) {
-        whiteEnd = index;
-        index++;
-        c = workingCopy[index];
-        continue;
-      }
-      inWhitespace = 0;
-      if (hasToken) {
-        replaceStringInPlace(&workingCopy, " ", whiteStart, whiteEnd);
-        index = whiteStart + 1;
-      }
-      else { 
-        deleteStringInPlace(&workingCopy, whiteStart, whiteEnd);
-        index = whiteStart;
-      }
-      c = workingCopy[index];
-      continue;
-    } 
+  while (index < length) {
+    if (text[index] < '0' || text[index] > '9') {
+      return 0;
+    }
+    index++;
+  }
+  return 1;
+}
+
+// register numbers past this aren't registers, every per-register table is indexed by them
+#define MAX_REGISTER 0xffffffff
+
+static int parseNumber(const char* text, size_t length, __int128_t* output) {
+  // parse a decimal, hex (0x), binary (0b) or octal (0o) number with an optional sign
+  // unsigned numbers can use all 128 bits, negative ones go down to -2^127
+  // returns 0 on success
+  // returns -1 if text isn't a number or doesn't fit
+  size_t index = 0;
+  __uint8_t negative = 0;
+  if (length > 0 && (text[0] == '-' || text[0] == '+')) {
+    negative = text[0] == '-';
+    index++;
+  }
+  unsigned int base = 10;
+  if (length - index > 2 && text[index] == '0') {
+    switch (text[index + 1]) {
+      case 'x':
+      case 'X':
+        base = 16;
+        break;
+      case 'b':
+      case 'B':
+        base = 2;
+        break;
+      case 'o':
+      case 'O':
+        base = 8;
+        break;
+    }
+    if (base != 10) {
+      index += 2;
+    }
+  }
+  if (index == length) {
+    return -1;
+  }
+  __uint128_t limit = negative ? (__uint128_t) 1 << 127 : ~(__uint128_t) 0;
+  __uint128_t value = 0;
+  while (index < length) {
+    char c = text[index];
+    unsigned int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    }
     else {
-      if (isWhitespace(c)) {
-        inWhitespace = 1;
-        whiteStart = index;
-        whiteEnd = index;
+      return -1;
+    }
+    if (digit >= base || value > (limit - digit) / base) {
+      return -1;
+    }
+    value = value * base + digit;
+    index++;
+  }
+  *output = (__int128_t) (negative ? 0 - value : value);
+  return 0;
+}
+
+static struct Token classifyToken(struct InternTable* atoms, const char* source, size_t offset, size_t length) {
+  // work out what kind of token a piece of source text is, interning anything that's a name
+  const char* text = source + offset;
+  struct Token token = makeToken(TOKEN_NONE, offset, length, 0);
+  char first = text[0];
+  switch (first) {
+    case '.':
+      token.type = TOKEN_LABEL;
+      token.atom = intern(atoms, text, length);
+      return token;
+    case '@':
+      token.type = TOKEN_MACRO;
+      token.atom = intern(atoms, text, length);
+      return token;
+    case '%':
+      token.type = TOKEN_PORT;
+      token.atom = intern(atoms, text, length);
+      return token;
+    case '~':
+      if (parseNumber(text + 1, length - 1, &token.value) == 0) {
+        token.type = TOKEN_RELATIVE;
+      }
+      return token;
+    case '#':
+      if (parseNumber(text + 1, length - 1, &token.value) == 0) {
+        token.type = TOKEN_MEMORY;
       }
-      else {
-        hasToken = 1;
+      return token;
+    case '$':
+      if (isDigits(text + 1, length - 1) && parseNumber(text + 1, length - 1, &token.value) == 0 && token.value <= MAX_REGISTER) {
+        token.type = TOKEN_REGISTER;
       }
+      return token;
+  }
+  if ((first == 'R' || first == 'r') && isDigits(text + 1, length - 1)) {
+    if (parseNumber(text + 1, length - 1, &token.value) == 0 && token.value <= MAX_REGISTER) {
+      token.type = TOKEN_REGISTER;
     }
-    index++;
-    c = workingCopy[index];
+    return token;
+  }
+  if ((first == 'M' || first == 'm') && isDigits(text + 1, length - 1)) {
+    if (parseNumber(text + 1, length - 1, &token.value) == 0) {
+      token.type = TOKEN_MEMORY;
+    }
+    return token;
+  }
+  if ((first >= '0' && first <= '9') || first == '-' || first == '+') {
+    if (parseNumber(text, length, &token.value) == 0) {
+      token.type = TOKEN_IMMEDIATE;
+    }
+    return token;
+  }
+  if ((first >= 'a' && first <= 'z') || (first >= 'A' && first <= 'Z') || first == '_') {
+    token.type = TOKEN_NAME;
+    token.atom = intern(atoms, text, length);
+  }
+  return token;
+}
+
+struct Lexer newLexer(struct Code* code, struct InternTable* atoms, __uint8_t state, __uint64_t lineNumber) {
+  // set up a lexer that adds what it finds to code, starting in the given state at the start of a line
+  struct Lexer lexer;
+  lexer.code = code;
+  lexer.atoms = atoms;
+  lexer.state = state;
+  lexer.quote = '\0';
+  lexer.inToken = 0;
+  lexer.inStatement = 0;
+  lexer.atLineStart = 1;
+  lexer.fatalErrors = 1;
+  lexer.failed = 0;
+  lexer.tokenStart = 0;
+  lexer.stringStart = 0;
+  lexer.lineStart = code->tokens.count;
+  lexer.lineEndIndex = 0;
+  lexer.lineEndState = state;
+  lexer.lineCapacity = code->lineCount;
+  lexer.lineNumber = lineNumber;
+  lexer.stringNewlines = 0;
+  lexer.stringCount = code->stringMap.length;
+  return lexer;
+}
+
+static void addLine(struct Lexer* lexer) {
+  struct Code* code = lexer->code;
+  if (code->lineCount == lexer->lineCapacity) {
+    size_t newCapacity = lexer->lineCapacity == 0 ? 64 : lexer->lineCapacity * 2;
+    code->lines = arenaGrow(&code->arena, code->lines, lexer->lineCapacity * sizeof(struct Line), newCapacity * sizeof(struct Line));
+    lexer->lineCapacity = newCapacity;
   }
-  return workingCopy;
+  struct Line line;
+  line.linenumber = lexer->lineNumber;
+  line.linetype = '\0';
+  line.firstToken = lexer->lineStart;
+  line.tokenCount = code->tokens.count - lexer->lineStart;
+  code->lines[code->lineCount] = line;
+  code->lineCount++;
 }
 
-struct Code tokenize(char* inputCode) {
-// step one:   replace all strings with a replacement key (ex. &S1, &S2, &S3, etc.), and remove all types of comments
-  int inString = 0;
-  int inMultiline = 0;
-  int inComment = 0;
-  char* currentString;
-  size_t stringCount = 0;
-  size_t tokenStart;
-  size_t tokenEnd;
-  Map stringMap = empty_map();
+static void addStringToken(struct Lexer* lexer, size_t start, size_t end) {
+  // decode the literal into the string map, the token itself just records the string id (&S1, &S2, &S3, etc.)
+  struct Code* code = lexer->code;
+  lexer->stringCount++;
+  size_t stringLength = end - start + 1;
+  struct StringData* string = decodeLiteral(&code->arena, code->source + start, stringLength);
+  if (addString(code, lexer->stringCount, string) != 0) {
+    printf("Error while trying to add string %lu to map\n", lexer->stringCount);
+    exit(-1);
+  }
+  addToken(code, makeToken(TOKEN_STRING, start, stringLength, lexer->stringCount));
+}
 
-  size_t index = 0;
-  char c = inputCode[index];
-  while (c != 0) {
-    c = inputCode[index];
-    if (inString == 1) {
-      appendInPlace(&currentString, c);
-      if (c != '"' && c != '\'') {
-        index++;
-        continue;
+// bytes that need a closer look in each lexer state, everything else can be skipped in bulk
+static struct ByteSet tokenStops;
+static struct ByteSet blanks;
+static struct ByteSet statementStops;
+static struct ByteSet doubleQuoteStops;
+static struct ByteSet singleQuoteStops;
+static struct ByteSet commentStops;
+static struct ByteSet multilineStops;
+
+void initTokenizer() {
+  // has to run before anything is tokenized, the sets are only read after this so threads can share them
+  backslash = newByteSet("\\");
+  whitespace = newByteSet(" \n\t\r");
+  tokenStops = newByteSet(" \t\r\n\"'/");
+  blanks = newByteSet(" \t\r");
+  statementStops = newByteSet("}\n");
+  doubleQuoteStops = newByteSet("\"\\\n");
+  singleQuoteStops = newByteSet("'\\\n");
+  commentStops = newByteSet("\n");
+  multilineStops = newByteSet("*\n");
+}
+
+static inline size_t skipPlain(struct Lexer* lexer, const char* source, size_t index, size_t limit) {
+  // jump over bytes that can't change the lexer's state: the rest of a token, blanks between tokens,
+  // or the body of a string or comment
+  switch (lexer->state) {
+    case LEX_CODE:
+      if (lexer->inStatement) {
+        return scanAny(source, index, limit, &statementStops);
       }
-      char prev = inputCode[index - 1];
-      if (prev == '\\') {
-        index++;
-        continue;
+      if (lexer->inToken) {
+        return scanAny(source, index, limit, &tokenStops);
       }
-      inString = 0;
-      tokenEnd = index;
-      // add string to map and replace with the string id (&S1, &S2, &S3, etc.)
-      stringCount++;
-      char* stringID = malloc(23 * sizeof(char)); // string ID is 20 max digits from a u64 + 2 for &S + 1 for null terminator
-      sprintf(stringID, "&S%lu", stringCount);
-      int returnCode = mapAdd(&stringMap, stringID, currentString);
-      if (returnCode != 0) {
-        printf("Error while trying to add string \"%s\" to map, with key \"%s\"\n", currentString, stringID);
-        exit(-1);
+      return scanNotAny(source, index, limit, &blanks);
+    case LEX_STRING:
+      return scanAny(source, index, limit, lexer->quote == '"' ? &doubleQuoteStops : &singleQuoteStops);
+    case LEX_COMMENT:
+      return scanAny(source, index, limit, &commentStops);
+    case LEX_MULTILINE:
+      return scanAny(source, index, limit, &multilineStops);
+  }
+  return index;
+}
+
+size_t lexRange(struct Lexer* lexer, size_t index, size_t end, __uint8_t overrun) {
+  // lex source from index up to end, returns the index lexing stopped at
+  // if overrun is set, lexing carries on past end until the current line is finished (ex. a string with a newline in it),
+  // otherwise it stops exactly at end
+  // the end of the source acts as a final newline, the source itself doesn't need one
+  const char* source = lexer->code->source;
+  size_t sourceLength = lexer->code->sourceLength;
+  size_t limit = overrun ? sourceLength : end;  // bulk skips must not run past this
+
+  while (index <= sourceLength) {
+    if (index >= end && (lexer->atLineStart || (index < sourceLength && !overrun))) {
+      break;
+    }
+    if (index < limit) {
+      size_t skipped = skipPlain(lexer, source, index, limit);
+      if (skipped != index) {
+        index = skipped;
+        lexer->atLineStart = 0;
+        continue;
       }
-      
-      // replace string in inputCode with string identifier
-      replaceStringInPlace(&inputCode, stringID, tokenStart, tokenEnd);
-      index = tokenStart + strlen(stringID);
-      // change currentString to a new pointer
-      // currentString needs to be freed on program exit, not here!!!
-      char* temp = malloc(23 * sizeof(char));
-      currentString = temp;
-    } 
-    else if (inMultiline == 1) {
-      char prev = inputCode[index - 1];
-      if (c == '/' && prev == '*') {
-        inMultiline = 0;
-        tokenEnd = index;
-        // delete comment
-        // if multiline contains a newline i need to replace the comment with a newline
-        size_t tokenIndex = tokenStart;
-        size_t newLines = 0;
-        while (tokenIndex <= tokenEnd) {
-          if (inputCode[tokenIndex] == '\n') {
-            newLines++;
-          }
-          tokenIndex++;
+    }
+    char c = index < sourceLength ? source[index] : '\0';
+    char next = index + 1 < sourceLength ? source[index + 1] : '\0';
+    __uint8_t atEnd = index == sourceLength;
+    size_t tokenEnd = index;  // comments can move index forward before the token is finished
+    __uint8_t endToken = 0;
+    __uint8_t endLine = 0;
+
+    switch (lexer->state) {
+      case LEX_CODE:
+        if (atEnd || c == '\n') {
+          // an unclosed statement ends with its line, parse() reports it
+          endToken = 1;
+          endLine = 1;
+          lexer->inStatement = 0;
         }
-        if (newLines >= 1) {
-          char* replacement = malloc((newLines + 1) * sizeof(char));
-          size_t replacementIndex = 0;
-          while (newLines > 0) {
-            replacement[replacementIndex] = '\n';
-            replacementIndex++;
-            newLines--;
+        else if (lexer->inStatement) {
+          if (c == '}') {
+            lexer->inStatement = 0;
           }
-          replacement[replacementIndex] = '\0';
-          replaceStringInPlace(&inputCode, replacement, tokenStart, tokenEnd);
-          free(replacement);
-          index = tokenStart;
-        } else {
-          deleteStringInPlace(&inputCode, tokenStart, tokenEnd);
-          index = tokenStart;
         }
-        index = tokenStart;
-        continue; // no need to increment index, it already points to the character immediately after the (now deleted) comment
-      }
-    } else if (inComment == 1) {
-      if (c == '\n') { // detect the end of the line
-        inComment = 0;
-        tokenEnd = index - 1;  // -1 in order to not remove newlines before adding line markers
-        // delete comment
-        replaceStringInPlace(&inputCode, " ", tokenStart, tokenEnd);
-        index = tokenStart;
-      }
-    } else {
-      switch (c) {
-        case '"':
-        case '\'':
-          inString = 1;
-          currentString = malloc(2 * sizeof(char));
-          currentString[0] = '\0';
-          appendInPlace(&currentString, c);
-          tokenStart = index;
-          break;
-        case '*':
-          if (index == 0) {
-            break; // make sure we don't do an illegal memory access
-          }
-          if (inputCode[index-1] != '/') {
-            break;
-          }
-          inMultiline = 1;
-          tokenStart = index - 1; // make sure / in /* gets selected too
-          break;
-        case '/':
-          if (index == 0) {
-            break; // make sure we don't do an illegal memory access
-          }
-          if (inputCode[index-1] != '/') {
-            break;
+        else if (c == '"' || c == '\'') {
+          endToken = 1;
+          lexer->state = LEX_STRING;
+          lexer->quote = c;
+          lexer->stringStart = index;
+        }
+        else if (c == '/' && (next == '/' || next == '*')) {
+          // comments count as whitespace
+          endToken = 1;
+          lexer->state = next == '/' ? LEX_COMMENT : LEX_MULTILINE;
+          index++;
+        }
+        else if (isWhitespace(c)) {
+          endToken = 1;
+        }
+        else if (!lexer->inToken) {
+          lexer->inToken = 1;
+          lexer->tokenStart = index;
+          lexer->inStatement = c == '@' && next == '{';
+        }
+        break;
+      case LEX_STRING:
+        if (atEnd) {
+          if (!lexer->fatalErrors) {
+            lexer->failed = 1;
+            return index;
           }
-          inComment = 1;
-          tokenStart = index - 1;
-          break;
+          fprintf(stderr, "Error at line %lu, unterminated string literal.\n", lexer->lineNumber);
+          exit(-1);
+        }
+        if (c == '\\' && index + 1 < sourceLength) {
+          index++;
+          lexer->stringNewlines += next == '\n';
+        }
+        else if (c == lexer->quote) {
+          lexer->state = LEX_CODE;
+          addStringToken(lexer, lexer->stringStart, index);
+        }
+        else if (c == '\n') {
+          // the string carries on, but later lines still need the right line numbers
+          lexer->stringNewlines++;
+        }
+        break;
+      case LEX_COMMENT:
+        if (atEnd || c == '\n') {
+          lexer->state = LEX_CODE;
+          endLine = 1;
+        }
+        break;
+      case LEX_MULTILINE:
+        if (c == '*' && next == '/') {
+          lexer->state = LEX_CODE;
+          index++;
+        }
+        else if (atEnd || c == '\n') {
+          // keep line numbering intact across multiline comments
+          endLine = 1;
+        }
+        break;
+    }
+
+    if (endToken && lexer->inToken) {
+      addToken(lexer->code, classifyToken(lexer->atoms, source, lexer->tokenStart, tokenEnd - lexer->tokenStart));
+      lexer->inToken = 0;
+    }
+    if (endLine) {
+      // empty lines aren't stored, the line number records where each line came from
+      if (lexer->code->tokens.count > lexer->lineStart) {
+        addLine(lexer);
+        lexer->lineStart = lexer->code->tokens.count;
       }
+      lexer->lineNumber += 1 + lexer->stringNewlines;
+      lexer->stringNewlines = 0;
+      lexer->lineEndIndex = index + 1;
+      lexer->lineEndState = lexer->state;
+    }
+    lexer->atLineStart = endLine;
+    index++;
+  }
+  return index;
+}
 
-    }  
+struct Code tokenize(const char* source, size_t sourceLength) {
+  // single pass over the input: tokens are stored as views into source, strings are added to the string map
+  // (&S1, &S2, etc.), comments are dropped, and each line records the source line number it came from
+  struct Code code = newCode(source, sourceLength);
+  struct Lexer lexer = newLexer(&code, &atomTable, LEX_CODE, 1);
+  lexRange(&lexer, 0, sourceLength, 1);
+  return code;
+}
 
-    index++;
+// #######################  PARALLEL TOKENIZER  #######################
+
+// chunks smaller than this aren't worth handing to another thread
+#define MIN_CHUNK_SIZE (1 << 20)
+// more chunks than threads, so threads that finish early can pick up more work
+#define CHUNKS_PER_THREAD 4
+
+struct Chunk {
+  size_t start;  // chunks always start right after a newline
+  size_t end;
+  struct Code code;
+  struct InternTable atoms;
+  struct Lexer lexer;
+  __uint8_t skipped;         // chunk was swallowed by the chunk before it during fix up
+  __uint64_t lineOffset;     // added to the chunk's line numbers when merging
+};
+
+struct ChunkQueue {
+  const char* source;
+  size_t sourceLength;
+  struct Chunk* chunks;
+  size_t chunkCount;
+  size_t next;  // next chunk to be picked up, shared between threads
+};
+
+static void startChunk(struct Chunk* chunk, const char* source, size_t sourceLength, __uint8_t state, __uint64_t lineNumber) {
+  chunk->code = newCode(source, sourceLength);
+  chunk->atoms = newAtomTable();
+  chunk->lexer = newLexer(&chunk->code, &chunk->atoms, state, lineNumber);
+}
+
+static void dropChunk(struct Chunk* chunk) {
+  freeCode(&chunk->code);
+  freeInternTable(&chunk->atoms);
+}
+
+static void* lexChunks(void* argument) {
+  // thread body: lex chunks as if each one starts outside of any string or comment,
+  // the fix up pass redoes the ones where that guess was wrong
+  struct ChunkQueue* queue = argument;
+  while (1) {
+    size_t chunkIndex = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+    if (chunkIndex >= queue->chunkCount) {
+      return NULL;
+    }
+    struct Chunk* chunk = &queue->chunks[chunkIndex];
+    startChunk(chunk, queue->source, queue->sourceLength, LEX_CODE, 1);
+    chunk->lexer.fatalErrors = 0;
+    lexRange(&chunk->lexer, chunk->start, chunk->end, 0);
   }
+}
 
-  // Step 2:  add line numbers
-  index = 0;
-  c = inputCode[index];
-  size_t lineCount = 0;
-  while (c != 0) {
-    if (c != '\n') {
-      index++;
-      c = inputCode[index];
+static void fixChunks(struct Chunk* chunks, size_t chunkCount, const char* source, size_t sourceLength) {
+  // walk the chunks in order, tracking the real lexer state at each chunk boundary
+  // chunks that didn't start in plain code, or that ended in the middle of a line, get lexed again from the right state
+  size_t position = 0;
+  __uint8_t state = LEX_CODE;
+  __uint64_t lineNumber = 1;
+  size_t chunkIndex = 0;
+  while (chunkIndex < chunkCount) {
+    struct Chunk* chunk = &chunks[chunkIndex];
+    chunkIndex++;
+    if (chunk->end <= position && chunk->end < sourceLength) {
+      // the previous chunk ran all the way through this one
+      dropChunk(chunk);
+      chunk->skipped = 1;
+      continue;
+    }
+    __uint8_t finished = !chunk->lexer.failed && (chunk->lexer.atLineStart || chunk->end == sourceLength);
+    if (position == chunk->start && state == LEX_CODE && finished) {
+      chunk->lineOffset = lineNumber - 1;
+      lineNumber += chunk->lexer.lineNumber - 1;
+      state = chunk->lexer.state;
+      position = chunk->end;
       continue;
     }
-    lineCount++;
+    dropChunk(chunk);
+    startChunk(chunk, source, sourceLength, state, lineNumber);
+    position = lexRange(&chunk->lexer, position, chunk->end, 1);
+    chunk->lineOffset = 0;
+    lineNumber = chunk->lexer.lineNumber;
+    state = chunk->lexer.state;
+  }
+}
 
-    // get length sprintf will return
-    FILE* devNull = fopen("/dev/null", "w");
-    size_t length = fprintf(devNull, " &L%lu", lineCount);
-    fclose(devNull);
+static void mergeChunks(struct Code* code, struct Chunk* chunks, size_t chunkCount) {
+  // glue the chunks back together into one program, moving chunk local atoms, string ids and line numbers
+  // over to their global values
+  size_t lineCount = 0;
+  size_t chunkIndex = 0;
+  while (chunkIndex < chunkCount) {
+    if (!chunks[chunkIndex].skipped) {
+      lineCount += chunks[chunkIndex].code.lineCount;
+    }
+    chunkIndex++;
+  }
+  code->lines = arenaAlloc(&code->arena, lineCount * sizeof(struct Line));
 
-    // allocate memory for sprintf
-    char* lineMarker = malloc((length + 1) * sizeof(char));
-    sprintf(lineMarker, " &L%lu", lineCount);
-    insertStringInPlace(&inputCode, lineMarker, index);
+  size_t stringOffset = 0;
+  chunkIndex = 0;
+  while (chunkIndex < chunkCount) {
+    struct Chunk* chunk = &chunks[chunkIndex];
+    chunkIndex++;
+    if (chunk->skipped) {
+      continue;
+    }
+    // keywords have the same atom in every table, everything else gets interned into the global table
+    Atom* atomMap = malloc(chunk->atoms.count * sizeof(Atom));
+    Atom atom = 0;
+    while (atom < chunk->atoms.count) {
+      atomMap[atom] = atom < ATOM_KEYWORD_COUNT ? atom : intern(&atomTable, atomString(&chunk->atoms, atom), atomLength(&chunk->atoms, atom));
+      atom++;
+    }
 
-    // Prevent memory leaks and bad indexing
-    free(lineMarker);
-    index+=length+1;
-    c = inputCode[index];
-  }
-  // Add another line marker at the end of the final line
-  lineCount++;// step four: output code
-
-  FILE* devNull = fopen("/dev/null", "w");
-  size_t length = fprintf(devNull, " &L%lu", lineCount);
-  fclose(devNull);
-
-  // allocate memory for sprintf
-  char* lineMarker = malloc((length + 1) * sizeof(char));
-  sprintf(lineMarker, " &L%lu", lineCount);
-  insertStringInPlace(&inputCode, lineMarker, index);
-
-  // Prevent memory leaks and bad indexing
-  free(lineMarker);
-  index+=length;
-  c = inputCode[index];
-
-// step three: tokenize code
-  // prepare state
-  __uint8_t inToken = 0;
-  tokenStart = 0;
-  tokenEnd = 0;
-  struct Token* tokenList = malloc(sizeof(struct Token));
-  size_t tokenIndex = 0;
-
-  index = 0;
-  c = inputCode[index];
-  size_t codeLength = strlen(inputCode);
-  while (index <= codeLength) {
-    if (inToken) {
-      if (isWhitespace(c) || c == '\0') {
-        char* token = getSlice(inputCode, tokenStart, tokenEnd);
-        struct Token obj;
-        obj.string = token;
-        tokenList[tokenIndex] = obj;
-        tokenIndex++;
-        tokenList = realloc(tokenList, (tokenIndex + 1) * sizeof(struct Token));
-        inToken = 0;
-      }
-      else {
-        tokenEnd = index;
+    size_t tokenOffset = code->tokens.count;
+    size_t tokenIndex = 0;
+    while (tokenIndex < chunk->code.tokens.count) {
+      struct Token token = getToken(&chunk->code, tokenIndex);
+      token.atom = atomMap[token.atom];
+      if (token.type == TOKEN_STRING) {
+        token.value += stringOffset;
       }
+      addToken(code, token);
+      tokenIndex++;
     }
-    else {
-      if (!isWhitespace(c) && c != '\0') {
-        tokenStart = index;
-        tokenEnd = index;
-        inToken = 1;
+    free(atomMap);
+
+    size_t lineIndex = 0;
+    while (lineIndex < chunk->code.lineCount) {
+      struct Line line = chunk->code.lines[lineIndex];
+      line.firstToken += tokenOffset;
+      line.linenumber += chunk->lineOffset;
+      code->lines[code->lineCount] = line;
+      code->lineCount++;
+      lineIndex++;
+    }
+
+    size_t stringIndex = 1;
+    while (stringIndex <= chunk->lexer.stringCount) {
+      struct StringData* string = getString(&chunk->code, stringIndex);
+      addString(code, stringIndex + stringOffset, copyString(&code->arena, string));
+      stringIndex++;
+    }
+    stringOffset += chunk->lexer.stringCount;
+
+    dropChunk(chunk);
+  }
+}
+
+struct Code tokenizeParallel(const char* source, size_t sourceLength, unsigned int threadCount) {
+  // split the source at newlines and lex the pieces on threadCount threads, gives the same result as tokenize()
+  size_t chunkCount = threadCount * CHUNKS_PER_THREAD;
+  if (chunkCount > sourceLength / MIN_CHUNK_SIZE) {
+    chunkCount = sourceLength / MIN_CHUNK_SIZE;
+  }
+  if (threadCount <= 1 || chunkCount <= 1) {
+    return tokenize(source, sourceLength);
+  }
+
+  struct Chunk* chunks = calloc(chunkCount, sizeof(struct Chunk));
+  size_t start = 0;
+  size_t chunkIndex = 0;
+  while (chunkIndex < chunkCount) {
+    size_t end = sourceLength;
+    if (chunkIndex + 1 < chunkCount) {
+      // end each chunk just after a newline
+      end = sourceLength / chunkCount * (chunkIndex + 1);
+      if (end < start) {
+        end = start;
       }
+      const char* newline = memchr(source + end, '\n', sourceLength - end);
+      end = newline == NULL ? sourceLength : (size_t) (newline - source) + 1;
     }
-    index++;
-    c = inputCode[index];
+    chunks[chunkIndex].start = start;
+    chunks[chunkIndex].end = end;
+    start = end;
+    chunkIndex++;
   }
 
-  // step 4: put tokens into lines
-  struct Line* lines;
-  size_t linesIndex = 0;
-  lines = malloc(sizeof(struct Line));
-  
-  struct Line line;
-  size_t lineIndex = 0;
-  line.tokens = malloc(sizeof(struct Token));
-  line.tokenCount = 0;
-
-  index = 0;
-  while (index < tokenIndex) {
-    struct Token token = tokenList[index];
-
-    // put token in line
-    line.tokens[lineIndex] = token;
-    line.tokenCount++;
-    lineIndex++;
-    line.tokens = realloc(line.tokens, (lineIndex + 1) * sizeof(struct Token));
-    
-    if (token.string[0] == '&' && token.string[1] == 'L') {
-      // end of line
-      // add line to lines
-      lines[linesIndex] = line;
-      linesIndex++;
-      lines = realloc(lines, (linesIndex + 1) * sizeof(struct Line));
-
-      // make a new line
-      line.tokens = NULL;
-      line.tokens = malloc(sizeof(struct Token));
-      line.tokenCount = 0;
-      lineIndex = 0;
+  struct ChunkQueue queue;
+  queue.source = source;
+  queue.sourceLength = sourceLength;
+  queue.chunks = chunks;
+  queue.chunkCount = chunkCount;
+  queue.next = 0;
+
+  pthread_t* threads = malloc(threadCount * sizeof(pthread_t));
+  unsigned int threadIndex = 0;
+  while (threadIndex < threadCount) {
+    if (pthread_create(&threads[threadIndex], NULL, lexChunks, &queue) != 0) {
+      fprintf(stderr, "Error: could not start tokenizer thread.\n");
+      exit(-1);
     }
-    index++;
+    threadIndex++;
+  }
+  threadIndex = 0;
+  while (threadIndex < threadCount) {
+    pthread_join(threads[threadIndex], NULL);
+    threadIndex++;
   }
-  free(tokenList);
+  free(threads);
 
-// step 5: output code
-  struct Code output;
-  output.stringMap = stringMap;
-  output.lines = lines;
-  output.lineCount = linesIndex;
-  return output;
-}
\ No newline at end of file
+  fixChunks(chunks, chunkCount, source, sourceLength);
+  struct Code code = newCode(source, sourceLength);
+  mergeChunks(&code, chunks, chunkCount);
+  free(chunks);
+  return code;
+}
+
+char* tokenString(struct Code* code, struct Token token) {
+  // get a copy of a token's text, the copy lives in the code's arena
+  char* output;
+  switch (token.type) {
+    case TOKEN_STRING:
+      output = arenaAlloc(&code->arena, 23 * sizeof(char));
+      sprintf(output, "&S%lu", (__uint64_t) token.value);
+      return output;
+  }
+  return arenaCopyString(&code->arena, codeText(code, token.offset), token.length);
+}
+
+void printToken(FILE* stream, struct Code* code, struct Token token) {
+  // write a token's text to stream without allocating anything
+  switch (token.type) {
+    case TOKEN_STRING:
+      fprintf(stream, "&S%lu", (__uint64_t) token.value);
+      return;
+  }
+  fwrite(codeText(code, token.offset), sizeof(char), token.length, stream);
+}
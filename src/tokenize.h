@@ -19,8 +19,53 @@
 #ifndef TOKENIZE_H
 #define TOKENIZE_H
 
+#include <stdio.h>
+
 #include "codeobjects.h"
+#include "lib/intern.h"
+
+// lexer states
+#define LEX_CODE 0
+#define LEX_STRING 1
+#define LEX_COMMENT 2
+#define LEX_MULTILINE 3
+
+// resumable lexer state, lets a source be lexed in pieces
+struct Lexer {
+  struct Code* code;          // tokens, lines and strings get added to this
+  struct InternTable* atoms;  // names get interned into this
+  __uint8_t state;
+  char quote;                 // quote character the current string was opened with
+  __uint8_t inToken;
+  __uint8_t inStatement;      // inside an @{...} statement, which is one token spaces and all
+  __uint8_t atLineStart;      // the last character lexed ended a line
+  __uint8_t fatalErrors;      // if this is zero then errors set failed instead of exiting
+  __uint8_t failed;
+  size_t tokenStart;
+  size_t stringStart;
+  size_t lineStart;           // index of the first token of the current line
+  size_t lineEndIndex;        // source index just after the last line that was finished
+  __uint8_t lineEndState;     // lexer state at lineEndIndex
+  size_t lineCapacity;
+  __uint64_t lineNumber;      // source line the current line starts on
+  __uint64_t stringNewlines;  // newlines inside strings on the current line, added to lineNumber when it ends
+  size_t stringCount;
+};
+
+void initTokenizer();
+
+struct StringData* decodeLiteral(struct Arena* arena, const char* literal, size_t length);
+
+struct Lexer newLexer(struct Code* code, struct InternTable* atoms, __uint8_t state, __uint64_t lineNumber);
+
+size_t lexRange(struct Lexer* lexer, size_t index, size_t end, __uint8_t overrun);
+
+struct Code tokenize(const char* source, size_t sourceLength);
+
+struct Code tokenizeParallel(const char* source, size_t sourceLength, unsigned int threadCount);
+
+char* tokenString(struct Code* code, struct Token token);
 
-struct Code tokenize(char* inputCode);
+void printToken(FILE* stream, struct Code* code, struct Token token);
 
 #endif
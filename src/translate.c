@@ -0,0 +1,276 @@
+/*
+ * translate.c: turns parsed URCL code into target code using a translation table
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/stringutils.h"
+#include "codeobjects.h"
+#include "tokenize.h"
+#include "atoms.h"
+#include "translations.h"
+#include "expression.h"
+#include "translate.h"
+
+// output is built up in memory and written out in pieces this big
+#define TRANSLATE_FLUSH_SIZE (1 << 16)
+
+// how string tokens get written out
+#define STRINGS_AS_ADDRESS 0  // address of the string in the data section, for instruction operands
+#define STRINGS_AS_WORDS 1    // the string's characters, for DW
+#define STRINGS_AS_SOURCE 2   // the literal as it was written, for comments
+
+static void appendToken(struct StringBuilder* output, struct Code* code, size_t index, __uint8_t stringMode) {
+  if (tokenType(code, index) == TOKEN_STRING && stringMode != STRINGS_AS_SOURCE) {
+    __uint64_t id = tokenValue(code, index);
+    if (stringMode == STRINGS_AS_ADDRESS) {
+      builderAppendUnsigned(output, code->data.addresses[id]);
+      return;
+    }
+    struct StringData* string = getString(code, id);
+    builderAppendChar(output, '[');
+    size_t byteIndex = 0;
+    while (byteIndex < string->length) {
+      if (byteIndex != 0) {
+        builderAppendChar(output, ' ');
+      }
+      builderAppendUnsigned(output, string->bytes[byteIndex]);
+      byteIndex++;
+    }
+    builderAppendChar(output, ']');
+    return;
+  }
+  builderAppend(output, codeText(code, code->tokens.offsets[index]), code->tokens.lengths[index]);
+}
+
+static void appendRegister(struct StringBuilder* output, struct TranslationTable* table, struct Code* code, size_t index, __uint64_t lineNumber) {
+  // R1 up are written as the target register they were given, keeping the prefix the source used
+  // R0 always reads as zero and is left as it is
+  __uint64_t number = tokenValue(code, index);
+  if (number == 0) {
+    appendToken(output, code, index, STRINGS_AS_ADDRESS);
+    return;
+  }
+  if (number > table->config.registerOrderCount) {
+    fprintf(stderr, "Error at line %lu, R%lu has no target register, the translation file only has %u for programs to use.\n", lineNumber, number, table->config.registerOrderCount);
+    exit(-1);
+  }
+  const char* text = codeText(code, code->tokens.offsets[index]);
+  size_t prefixLength = 0;
+  while (prefixLength < code->tokens.lengths[index] && (text[prefixLength] < '0' || text[prefixLength] > '9')) {
+    prefixLength++;
+  }
+  builderAppend(output, text, prefixLength);
+  builderAppendUnsigned(output, table->registerOrder[number - 1]);
+}
+
+static void appendLine(struct StringBuilder* output, struct Code* code, struct Line line, __uint8_t stringMode) {
+  size_t tokenIndex = 0;
+  while (tokenIndex < line.tokenCount) {
+    if (tokenIndex != 0) {
+      builderAppendChar(output, ' ');
+    }
+    appendToken(output, code, line.firstToken + tokenIndex, stringMode);
+    tokenIndex++;
+  }
+}
+
+static __uint8_t operandKind(struct Code* code, size_t index) {
+  char type = tokenType(code, index);
+  if (type == TOKEN_REGISTER) {
+    return OPERAND_REGISTER;
+  }
+  if (type == TOKEN_NAME) {
+    Atom atom = upperAtom(&atomTable, code->tokens.atoms[index]);
+    if (atom == ATOM_SP || atom == ATOM_PC) {
+      return OPERAND_REGISTER;
+    }
+  }
+  return OPERAND_IMMEDIATE;
+}
+
+static void appendWide(struct StringBuilder* output, __uint128_t value) {
+  // append a value that might not fit in 64 bits in decimal
+  if (value <= ~(__uint64_t) 0) {
+    builderAppendUnsigned(output, (__uint64_t) value);
+    return;
+  }
+  char digits[40];
+  size_t digitCount = 0;
+  while (value > 0) {
+    digits[digitCount] = (char) (value % 10) + '0';
+    value /= 10;
+    digitCount++;
+  }
+  while (digitCount > 0) {
+    digitCount--;
+    builderAppendChar(output, digits[digitCount]);
+  }
+}
+
+static struct ExpressionInput expressionInput(struct TranslationTable* table, struct Code* code, struct Line line) {
+  // operand values for placeholder expressions, only numbers and strings (by their address) have one
+  struct ExpressionInput input;
+  memset(&input, 0, sizeof(struct ExpressionInput));
+  input.bits = table->config.dataBus;
+  size_t operandIndex = 0;
+  while (operandIndex < line.tokenCount - 1 && operandIndex < EXPRESSION_OPERANDS) {
+    size_t index = line.firstToken + 1 + operandIndex;
+    switch (tokenType(code, index)) {
+      case TOKEN_IMMEDIATE:
+      case TOKEN_MEMORY:
+        input.operands[operandIndex] = tokenValue(code, index);
+        input.known[operandIndex] = 1;
+        break;
+      case TOKEN_STRING:
+        input.operands[operandIndex] = code->data.addresses[tokenValue(code, index)];
+        input.known[operandIndex] = 1;
+        break;
+    }
+    operandIndex++;
+  }
+  return input;
+}
+
+static void appendExpression(struct StringBuilder* output, struct TranslationTable* table, struct TemplateSegment segment, const struct ExpressionInput* input, __uint64_t lineNumber) {
+  struct TranslationExpression expression = table->expressions[segment.expression];
+  if (expression.errorLength != 0) {
+    fprintf(stderr, "Error at line %lu, translation expression <%.*s> is invalid: %.*s.\n", lineNumber, (int) segment.length, table->text + segment.offset, (int) expression.errorLength, table->text + expression.error);
+    exit(-1);
+  }
+  __int128_t value;
+  const char* error;
+  if (evaluateExpression(table->expressionOps + expression.firstOp, expression.opCount, input, &value, &error) != 0) {
+    fprintf(stderr, "Error at line %lu, can't work out translation expression <%.*s>: %s.\n", lineNumber, (int) segment.length, table->text + segment.offset, error);
+    exit(-1);
+  }
+  // results are written as unsigned @BITS wide words
+  appendWide(output, (__uint128_t) maskToBits(value, input->bits));
+}
+
+static void translateInstruction(struct TranslationTable* table, struct Code* code, struct Line line, Atom opcode, struct StringBuilder* output) {
+  size_t operandCount = line.tokenCount - 1;
+  if (operandCount > MAX_OPERANDS) {
+    fprintf(stderr, "Error at line %lu, instructions take at most %d operands, got %lu.\n", line.linenumber, MAX_OPERANDS, operandCount);
+    exit(-1);
+  }
+  __uint8_t operands[MAX_OPERANDS];
+  size_t operandIndex = 0;
+  while (operandIndex < operandCount) {
+    operands[operandIndex] = operandKind(code, line.firstToken + 1 + operandIndex);
+    operandIndex++;
+  }
+  __uint8_t signature = packSignature(operands, operandCount);
+  struct Translation* translation = findTranslation(table, opcode, signature);
+  if (translation == NULL) {
+    char signatureText[2 * MAX_OPERANDS + 1];
+    signatureString(signature, signatureText);
+    fprintf(stderr, "Error at line %lu, translation file has no translation for \"%s\" with operands \"%s\".\n", line.linenumber, atomString(&atomTable, opcode), signatureText);
+    exit(-1);
+  }
+
+  struct ExpressionInput input;
+  __uint8_t haveInput = 0;
+  size_t lineIndex = translation->firstLine;
+  while (lineIndex < translation->firstLine + translation->lineCount) {
+    struct TemplateLine templateLine = table->lines[lineIndex];
+    size_t segmentIndex = templateLine.firstSegment;
+    while (segmentIndex < templateLine.firstSegment + templateLine.segmentCount) {
+      struct TemplateSegment segment = table->segments[segmentIndex];
+      switch (segment.type) {
+        case SEGMENT_TEXT:
+          builderAppend(output, table->text + segment.offset, segment.length);
+          break;
+        case SEGMENT_OPERAND:
+          if (segment.operand >= operandCount) {
+            fprintf(stderr, "Error at line %lu, translation uses operand <%c> but the instruction only has %lu.\n", line.linenumber, 'A' + segment.operand, operandCount);
+            exit(-1);
+          }
+          if (tokenType(code, line.firstToken + 1 + segment.operand) == TOKEN_REGISTER) {
+            appendRegister(output, table, code, line.firstToken + 1 + segment.operand, line.linenumber);
+          }
+          else {
+            appendToken(output, code, line.firstToken + 1 + segment.operand, STRINGS_AS_ADDRESS);
+          }
+          break;
+        case SEGMENT_EXPRESSION:
+          if (!haveInput) {
+            input = expressionInput(table, code, line);
+            haveInput = 1;
+          }
+          appendExpression(output, table, segment, &input, line.linenumber);
+          break;
+      }
+      segmentIndex++;
+    }
+    builderAppendChar(output, '\n');
+    lineIndex++;
+  }
+}
+
+void translateCode(struct TranslationTable* table, struct Code* code, FILE* output, __uint8_t verbose) {
+  // write every line of code out in the target's language
+  // headers and macros have done their job by now and are left out, labels and data are passed through
+  struct StringBuilder buffer = newStringBuilder(TRANSLATE_FLUSH_SIZE);
+  __uint8_t comments = verbose && table->config.commentsEnabled;
+  size_t lineIndex = 0;
+  while (lineIndex < code->lineCount) {
+    struct Line line = code->lines[lineIndex];
+    size_t first = line.firstToken;
+    char firstType = tokenType(code, first);
+    Atom opcode = upperAtom(&atomTable, code->tokens.atoms[first]);
+    lineIndex++;
+
+    if (firstType == TOKEN_MACRO || opcode == ATOM_BITS || opcode == ATOM_MINREG || opcode == ATOM_MINHEAP
+        || opcode == ATOM_MINSTACK || opcode == ATOM_RUN) {
+      continue;
+    }
+    if (comments) {
+      builderAppend(&buffer, table->text + table->config.commentStart, table->config.commentStartLength);
+      builderAppendChar(&buffer, ' ');
+      appendLine(&buffer, code, line, STRINGS_AS_SOURCE);
+      if (table->config.commentEndLength != 0) {
+        builderAppendChar(&buffer, ' ');
+        builderAppend(&buffer, table->text + table->config.commentEnd, table->config.commentEndLength);
+      }
+      builderAppendChar(&buffer, '\n');
+    }
+    if (opcode >= ATOM_FIRST_OPCODE && opcode <= ATOM_LAST_OPCODE) {
+      translateInstruction(table, code, line, opcode, &buffer);
+    }
+    else if (firstType == TOKEN_LABEL || opcode == ATOM_DW) {
+      appendLine(&buffer, code, line, STRINGS_AS_WORDS);
+      builderAppendChar(&buffer, '\n');
+    }
+    else {
+      fprintf(stderr, "Error at line %lu, unknown instruction \"", line.linenumber);
+      printToken(stderr, code, getToken(code, first));
+      fprintf(stderr, "\".\n");
+      exit(-1);
+    }
+
+    if (buffer.length >= TRANSLATE_FLUSH_SIZE) {
+      fwrite(buffer.data, sizeof(char), buffer.length, output);
+      buffer.length = 0;
+      buffer.data[0] = '\0';
+    }
+  }
+  fwrite(buffer.data, sizeof(char), buffer.length, output);
+  freeStringBuilder(&buffer);
+}
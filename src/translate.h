@@ -0,0 +1,28 @@
+/*
+ * translate.h: turns parsed URCL code into target code using a translation table
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+#include <stdio.h>
+
+#include "codeobjects.h"
+#include "translations.h"
+
+void translateCode(struct TranslationTable* table, struct Code* code, FILE* output, __uint8_t verbose);
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ * translationcache.c: precompiled translation tables that can be mapped straight into memory
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "translationcache.h"
+#include "translations.h"
+#include "atoms.h"
+#include "lib/mappedfile.h"
+
+// a cache image is this header followed by the table's arrays, each one starting on an 8 byte boundary
+// every array is found through an offset from the start of the image, so the image can be mapped anywhere
+// and used in place without fixing anything up
+
+#define CACHE_MAGIC "CURLTBL"
+#define CACHE_BYTE_ORDER 0x01020304
+
+struct CacheHeader {
+  char magic[8];
+  __uint32_t version;
+  __uint32_t byteOrder;        // reads back differently on a machine with the other endianness
+  __uint64_t headerSize;       // catches the structs changing size without the version being bumped
+  __uint64_t sourceHash;       // hash of the translation file the image was built from
+  __uint64_t sourceLength;
+  __uint64_t keywordHash;      // the index is keyed by keyword atoms, so the keyword list has to match too
+  __uint64_t imageLength;
+  struct TranslationConfig config;
+  __uint64_t indexOffset;
+  __uint64_t indexSize;
+  __uint64_t textOffset;
+  __uint64_t textLength;       // not counting the null terminator, which is stored too
+  __uint64_t registerOrderOffset;
+  __uint64_t segmentsOffset;
+  __uint64_t segmentCount;
+  __uint64_t linesOffset;
+  __uint64_t lineCount;
+  __uint64_t translationsOffset;
+  __uint64_t translationCount;
+  __uint64_t expressionsOffset;
+  __uint64_t expressionCount;
+  __uint64_t expressionOpsOffset;
+  __uint64_t expressionOpCount;
+};
+
+static __uint64_t hashBytes(__uint64_t hash, const char* bytes, size_t length) {
+  // 64 bit FNV-1a, pass 0xcbf29ce484222325 to start a new hash
+  size_t index = 0;
+  while (index < length) {
+    hash ^= (unsigned char) bytes[index];
+    hash *= 0x100000001b3ULL;
+    index++;
+  }
+  return hash;
+}
+
+static __uint64_t keywordHash() {
+  __uint64_t hash = 0xcbf29ce484222325ULL;
+  Atom atom = 1;
+  while (atom < ATOM_KEYWORD_COUNT) {
+    // the terminator goes in too, so "AB" "C" and "A" "BC" hash differently
+    hash = hashBytes(hash, atomString(&atomTable, atom), atomLength(&atomTable, atom) + 1);
+    atom++;
+  }
+  return hash;
+}
+
+static __uint64_t alignImage(__uint64_t offset) {
+  return (offset + 7) & ~(__uint64_t) 7;
+}
+
+static char* cachePath(char* path) {
+  size_t length = strlen(path);
+  char* output = malloc(length + sizeof(TRANSLATION_CACHE_EXTENSION));
+  if (output == NULL) {
+    fprintf(stderr, "Fatal error: out of memory.\n");
+    exit(-1);
+  }
+  memcpy(output, path, length);
+  memcpy(output + length, TRANSLATION_CACHE_EXTENSION, sizeof(TRANSLATION_CACHE_EXTENSION));
+  return output;
+}
+
+static int writeSection(FILE* file, __uint64_t* position, __uint64_t offset, const void* data, size_t size) {
+  // pad up to offset, then write size bytes of data
+  // returns 0 on success
+  static const char zeros[8] = {0};
+  if (fwrite(zeros, 1, offset - *position, file) != offset - *position) {
+    return -1;
+  }
+  if (size != 0 && fwrite(data, 1, size, file) != size) {
+    return -1;
+  }
+  *position = offset + size;
+  return 0;
+}
+
+static int saveTranslationCache(struct TranslationTable* table, __uint64_t sourceHash, size_t sourceLength, char* path) {
+  // write table out as a cache image
+  // the image is written next to its final name and renamed into place, so a run that maps the cache
+  // never sees a half written image, even with several compiles going at once
+  // returns 0 on success
+  // returns -1 if the image couldn't be written
+  struct CacheHeader header;
+  memset(&header, 0, sizeof(struct CacheHeader));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = TRANSLATION_CACHE_VERSION;
+  header.byteOrder = CACHE_BYTE_ORDER;
+  header.headerSize = sizeof(struct CacheHeader);
+  header.sourceHash = sourceHash;
+  header.sourceLength = sourceLength;
+  header.keywordHash = keywordHash();
+  header.config = table->config;
+
+  header.indexOffset = alignImage(sizeof(struct CacheHeader));
+  header.indexSize = sizeof(table->index);
+  header.textOffset = alignImage(header.indexOffset + header.indexSize);
+  header.textLength = table->textLength;
+  header.registerOrderOffset = alignImage(header.textOffset + table->textLength + 1);
+  size_t registerOrderSize = table->config.registerOrderCount * sizeof(__uint32_t);
+  header.segmentsOffset = alignImage(header.registerOrderOffset + registerOrderSize);
+  header.segmentCount = table->segmentCount;
+  size_t segmentsSize = table->segmentCount * sizeof(struct TemplateSegment);
+  header.linesOffset = alignImage(header.segmentsOffset + segmentsSize);
+  header.lineCount = table->lineCount;
+  size_t linesSize = table->lineCount * sizeof(struct TemplateLine);
+  header.translationsOffset = alignImage(header.linesOffset + linesSize);
+  header.translationCount = table->translationCount;
+  size_t translationsSize = table->translationCount * sizeof(struct Translation);
+  header.expressionsOffset = alignImage(header.translationsOffset + translationsSize);
+  header.expressionCount = table->expressionCount;
+  size_t expressionsSize = table->expressionCount * sizeof(struct TranslationExpression);
+  header.expressionOpsOffset = alignImage(header.expressionsOffset + expressionsSize);
+  header.expressionOpCount = table->expressionOpCount;
+  size_t expressionOpsSize = table->expressionOpCount * sizeof(struct ExpressionOp);
+  header.imageLength = header.expressionOpsOffset + expressionOpsSize;
+
+  size_t pathLength = strlen(path);
+  char* temporaryPath = malloc(pathLength + 32);
+  if (temporaryPath == NULL) {
+    return -1;
+  }
+  snprintf(temporaryPath, pathLength + 32, "%s.%ld.tmp", path, (long) getpid());
+  FILE* file = fopen(temporaryPath, "wb");
+  if (file == NULL) {
+    free(temporaryPath);
+    return -1;
+  }
+
+  __uint64_t position = 0;
+  int failed = 0;
+  failed |= writeSection(file, &position, 0, &header, sizeof(struct CacheHeader));
+  failed |= writeSection(file, &position, header.indexOffset, table->index, header.indexSize);
+  failed |= writeSection(file, &position, header.textOffset, table->text, table->textLength + 1);
+  failed |= writeSection(file, &position, header.registerOrderOffset, table->registerOrder, registerOrderSize);
+  failed |= writeSection(file, &position, header.segmentsOffset, table->segments, segmentsSize);
+  failed |= writeSection(file, &position, header.linesOffset, table->lines, linesSize);
+  failed |= writeSection(file, &position, header.translationsOffset, table->translations, translationsSize);
+  failed |= writeSection(file, &position, header.expressionsOffset, table->expressions, expressionsSize);
+  failed |= writeSection(file, &position, header.expressionOpsOffset, table->expressionOps, expressionOpsSize);
+  failed |= fclose(file) != 0;
+
+  if (failed || rename(temporaryPath, path) != 0) {
+    unlink(temporaryPath);
+    free(temporaryPath);
+    return -1;
+  }
+  free(temporaryPath);
+  return 0;
+}
+
+static __uint8_t sectionFits(const struct CacheHeader* header, __uint64_t offset, __uint64_t count, size_t elementSize) {
+  // checks that a section is aligned and lies entirely inside the image
+  if (offset % 8 != 0 || offset < sizeof(struct CacheHeader) || offset > header->imageLength) {
+    return 0;
+  }
+  return count <= (header->imageLength - offset) / elementSize;
+}
+
+static int tableFromImage(struct MappedFile* image, __uint64_t sourceHash, size_t sourceLength, struct TranslationTable* output) {
+  // point output at the arrays inside image
+  // returns 0 on success
+  // returns -1 if the image is damaged, from another version, or wasn't built from this translation file
+  if (image->length < sizeof(struct CacheHeader)) {
+    return -1;
+  }
+  const struct CacheHeader* header = (const struct CacheHeader*) image->data;
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+      || header->version != TRANSLATION_CACHE_VERSION
+      || header->byteOrder != CACHE_BYTE_ORDER
+      || header->headerSize != sizeof(struct CacheHeader)
+      || header->imageLength != image->length) {
+    return -1;
+  }
+  if (header->sourceHash != sourceHash || header->sourceLength != sourceLength || header->keywordHash != keywordHash()) {
+    return -1;
+  }
+  if (header->indexSize != sizeof(output->index)
+      || !sectionFits(header, header->indexOffset, header->indexSize, 1)
+      || !sectionFits(header, header->textOffset, header->textLength + 1, 1)
+      || !sectionFits(header, header->registerOrderOffset, header->config.registerOrderCount, sizeof(__uint32_t))
+      || !sectionFits(header, header->segmentsOffset, header->segmentCount, sizeof(struct TemplateSegment))
+      || !sectionFits(header, header->linesOffset, header->lineCount, sizeof(struct TemplateLine))
+      || !sectionFits(header, header->translationsOffset, header->translationCount, sizeof(struct Translation))
+      || !sectionFits(header, header->expressionsOffset, header->expressionCount, sizeof(struct TranslationExpression))
+      || !sectionFits(header, header->expressionOpsOffset, header->expressionOpCount, sizeof(struct ExpressionOp))) {
+    return -1;
+  }
+
+  const char* base = image->data;
+  memset(output, 0, sizeof(struct TranslationTable));
+  output->config = header->config;
+  // the index is the only part that's copied, since it's stored inside the table itself
+  memcpy(output->index, base + header->indexOffset, sizeof(output->index));
+  output->text = (char*) (base + header->textOffset);
+  output->textLength = header->textLength;
+  output->registerOrder = (__uint32_t*) (base + header->registerOrderOffset);
+  output->segments = (struct TemplateSegment*) (base + header->segmentsOffset);
+  output->segmentCount = header->segmentCount;
+  output->lines = (struct TemplateLine*) (base + header->linesOffset);
+  output->lineCount = header->lineCount;
+  output->translations = (struct Translation*) (base + header->translationsOffset);
+  output->translationCount = header->translationCount;
+  output->expressions = (struct TranslationExpression*) (base + header->expressionsOffset);
+  output->expressionCount = header->expressionCount;
+  output->expressionOps = (struct ExpressionOp*) (base + header->expressionOpsOffset);
+  output->expressionOpCount = header->expressionOpCount;
+  output->cache = *image;
+  return 0;
+}
+
+int compileTranslationCache(char* path) {
+  // build the cache image for the translation file at path
+  // returns 0 on success
+  // returns -1 if the translation file couldn't be read or the image couldn't be written
+  struct MappedFile source;
+  if (mapFile(path, &source) != 0) {
+    return -1;
+  }
+  __uint64_t sourceHash = hashBytes(0xcbf29ce484222325ULL, source.data, source.length);
+  size_t sourceLength = source.length;
+  unmapFile(&source);
+
+  struct TranslationTable table;
+  if (loadTranslations(path, &table) != 0) {
+    return -1;
+  }
+  char* imagePath = cachePath(path);
+  int result = saveTranslationCache(&table, sourceHash, sourceLength, imagePath);
+  free(imagePath);
+  freeTranslations(&table);
+  return result;
+}
+
+int openTranslations(char* path, struct TranslationTable* output) {
+  // load the translation file at path, from its cache image if there's one that matches the file
+  // returns 0 on success
+  // returns -1 if the translation file couldn't be read or parsed
+  struct MappedFile source;
+  if (mapFile(path, &source) != 0) {
+    return -1;
+  }
+  __uint64_t sourceHash = hashBytes(0xcbf29ce484222325ULL, source.data, source.length);
+  size_t sourceLength = source.length;
+  unmapFile(&source);
+
+  char* imagePath = cachePath(path);
+  struct MappedFile image;
+  if (mapFile(imagePath, &image) == 0) {
+    if (tableFromImage(&image, sourceHash, sourceLength, output) == 0) {
+      free(imagePath);
+      return 0;
+    }
+    fprintf(stderr, "Warning: translation cache \"%s\" doesn't match \"%s\", reading the translation file instead.\n", imagePath, path);
+    unmapFile(&image);
+  }
+  free(imagePath);
+  return loadTranslations(path, output);
+}
@@ -0,0 +1,36 @@
+/*
+ * translationcache.h: precompiled translation tables that can be mapped straight into memory
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TRANSLATIONCACHE_H
+#define TRANSLATIONCACHE_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+#include "translations.h"
+
+// bump this whenever the image layout or anything it stores changes
+#define TRANSLATION_CACHE_VERSION 3
+
+// the cache for a translation file sits next to it, ex. wii.yml -> wii.yml.cache
+#define TRANSLATION_CACHE_EXTENSION ".cache"
+
+int compileTranslationCache(char* path);
+
+int openTranslations(char* path, struct TranslationTable* output);
+
+#endif
@@ -0,0 +1,563 @@
+/*
+ * translations.c: loads a translation file once, config and templates are turned into flat tables
+ *                 so translating an instruction is a table lookup and a few copies
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libfyaml.h>
+
+#include "lib/stringutils.h"
+#include "lib/intern.h"
+#include "atoms.h"
+#include "translations.h"
+#include "opcodes.h"
+
+// state while a translation file is being loaded, the finished arrays get moved into the table
+struct TableBuilder {
+  struct StringBuilder text;
+  struct TemplateSegment* segments;
+  size_t segmentCapacity;
+  struct TemplateLine* lines;
+  size_t lineCapacity;
+  struct Translation* translations;
+  size_t translationCapacity;
+  __uint32_t* registerOrder;
+  struct InternTable expressionTexts;  // atom n is expression n - 1, so repeats of a placeholder compile once
+  struct TranslationExpression* expressions;
+  size_t expressionCapacity;
+  struct ExpressionCode expressionOps;
+};
+
+static void* growArray(void* array, size_t* capacity, size_t count, size_t elementSize) {
+  // make room for one more element
+  if (count < *capacity) {
+    return array;
+  }
+  *capacity = *capacity == 0 ? 64 : *capacity * 2;
+  return realloc(array, *capacity * elementSize);
+}
+
+__uint8_t packSignature(const __uint8_t* operands, size_t operandCount) {
+  // "r r i" -> 0b011110, the leading operand kind is never 0 so signatures of different lengths can't collide
+  __uint8_t signature = 0;
+  size_t operandIndex = 0;
+  while (operandIndex < operandCount) {
+    signature = signature * 4 + operands[operandIndex];
+    operandIndex++;
+  }
+  return signature;
+}
+
+void signatureString(__uint8_t signature, char* output) {
+  // turn a packed signature back into text for error messages, output needs room for 2 * MAX_OPERANDS characters
+  char kinds[MAX_OPERANDS];
+  size_t kindCount = 0;
+  while (signature != 0) {
+    kinds[kindCount] = "?ri?"[signature % 4];
+    signature /= 4;
+    kindCount++;
+  }
+  size_t outputLength = 0;
+  while (kindCount > 0) {
+    kindCount--;
+    output[outputLength] = kinds[kindCount];
+    outputLength++;
+    if (kindCount > 0) {
+      output[outputLength] = ' ';
+      outputLength++;
+    }
+  }
+  output[outputLength] = '\0';
+}
+
+static int parseSignature(const char* text, size_t length, __uint8_t* output) {
+  // returns 0 on success
+  // returns -1 if the signature has too many operands
+  __uint8_t operands[MAX_OPERANDS];
+  size_t operandCount = 0;
+  size_t index = 0;
+  while (index < length) {
+    if (isWhitespace(text[index])) {
+      index++;
+      continue;
+    }
+    size_t start = index;
+    while (index < length && !isWhitespace(text[index])) {
+      index++;
+    }
+    if (operandCount == MAX_OPERANDS) {
+      return -1;
+    }
+    __uint8_t kind = OPERAND_OTHER;
+    if (index - start == 1 && text[start] == 'r') {
+      kind = OPERAND_REGISTER;
+    }
+    else if (index - start == 1 && text[start] == 'i') {
+      kind = OPERAND_IMMEDIATE;
+    }
+    operands[operandCount] = kind;
+    operandCount++;
+  }
+  *output = packSignature(operands, operandCount);
+  return 0;
+}
+
+static __uint32_t addText(struct TableBuilder* builder, const char* text, size_t length) {
+  __uint32_t offset = builder->text.length;
+  builderAppend(&builder->text, text, length);
+  return offset;
+}
+
+static __uint32_t addExpression(struct TableBuilder* builder, struct TranslationTable* table, const char* text, size_t length) {
+  // compile an expression placeholder, returns its expression number
+  // expressions that don't compile are kept with their error, which only gets reported if a program uses them
+  Atom atom = intern(&builder->expressionTexts, text, length);
+  if (atom <= table->expressionCount) {
+    return atom - 1;
+  }
+  builder->expressions = growArray(builder->expressions, &builder->expressionCapacity, table->expressionCount, sizeof(struct TranslationExpression));
+  struct TranslationExpression expression;
+  const char* error;
+  expression.firstOp = builder->expressionOps.count;
+  expression.error = 0;
+  expression.errorLength = 0;
+  if (compileExpression(text, length, &builder->expressionOps, &error) != 0) {
+    expression.errorLength = strlen(error);
+    expression.error = addText(builder, error, expression.errorLength);
+  }
+  expression.opCount = builder->expressionOps.count - expression.firstOp;
+  builder->expressions[table->expressionCount] = expression;
+  table->expressionCount++;
+  return atom - 1;
+}
+
+static void addSegment(struct TableBuilder* builder, struct TranslationTable* table, __uint8_t type, __uint8_t operand, const char* text, size_t length) {
+  if (length == 0 && type == SEGMENT_TEXT) {
+    return;
+  }
+  builder->segments = growArray(builder->segments, &builder->segmentCapacity, table->segmentCount, sizeof(struct TemplateSegment));
+  struct TemplateSegment segment;
+  segment.type = type;
+  segment.operand = operand;
+  segment.offset = addText(builder, text, length);
+  segment.length = length;
+  segment.expression = type == SEGMENT_EXPRESSION ? addExpression(builder, table, text, length) : 0;
+  builder->segments[table->segmentCount] = segment;
+  table->segmentCount++;
+}
+
+static void addTemplateLine(struct TableBuilder* builder, struct TranslationTable* table, const char* text, size_t length) {
+  // split a template line into text and placeholders
+  // placeholders can hold expressions with > in them (ex. <(B>>C)@l>), so only a > outside of parentheses ends one
+  builder->lines = growArray(builder->lines, &builder->lineCapacity, table->lineCount, sizeof(struct TemplateLine));
+  struct TemplateLine line;
+  line.firstSegment = table->segmentCount;
+
+  size_t textStart = 0;
+  size_t index = 0;
+  while (index < length) {
+    if (text[index] != '<') {
+      index++;
+      continue;
+    }
+    size_t end = index + 1;
+    int depth = 0;
+    while (end < length && !(text[end] == '>' && depth == 0)) {
+      if (text[end] == '(') {
+        depth++;
+      }
+      else if (text[end] == ')') {
+        depth--;
+      }
+      end++;
+    }
+    if (end >= length) {
+      // no closing bracket, treat the rest as text
+      break;
+    }
+    addSegment(builder, table, SEGMENT_TEXT, 0, text + textStart, index - textStart);
+    const char* inside = text + index + 1;
+    size_t insideLength = end - index - 1;
+    if (insideLength == 1 && inside[0] >= 'A' && inside[0] < 'A' + MAX_OPERANDS) {
+      addSegment(builder, table, SEGMENT_OPERAND, inside[0] - 'A', inside, insideLength);
+    }
+    else {
+      addSegment(builder, table, SEGMENT_EXPRESSION, 0, inside, insideLength);
+    }
+    index = end + 1;
+    textStart = index;
+  }
+  addSegment(builder, table, SEGMENT_TEXT, 0, text + textStart, length - textStart);
+
+  line.segmentCount = table->segmentCount - line.firstSegment;
+  builder->lines[table->lineCount] = line;
+  table->lineCount++;
+}
+
+static const char* scalarAt(struct fy_node* root, const char* path, size_t* length) {
+  // returns NULL if there's nothing at path or it isn't a scalar
+  struct fy_node* node = fy_node_by_path(root, path, (size_t) -1, FYNWF_DONT_FOLLOW);
+  if (node == NULL || fy_node_get_type(node) != FYNT_SCALAR) {
+    return NULL;
+  }
+  return fy_node_get_scalar(node, length);
+}
+
+static __uint32_t numberAt(struct fy_node* root, const char* path, __uint32_t fallback) {
+  size_t length;
+  const char* text = scalarAt(root, path, &length);
+  if (text == NULL || length == 0) {
+    return fallback;
+  }
+  // scalars aren't null terminated
+  char* copy = malloc(length + 1);
+  memcpy(copy, text, length);
+  copy[length] = '\0';
+  char* end;
+  unsigned long value = strtoul(copy, &end, 0);
+  if (*end != '\0') {
+    fprintf(stderr, "Error in provided translation file, expected a number at \"%s\" but got \"%s\".\n", path, copy);
+    exit(-1);
+  }
+  free(copy);
+  return (__uint32_t) value;
+}
+
+static __uint8_t flagAt(struct fy_node* root, const char* path, __uint8_t fallback) {
+  size_t length;
+  const char* text = scalarAt(root, path, &length);
+  if (text == NULL) {
+    return fallback;
+  }
+  return length == 4 && strncmp(text, "true", 4) == 0;
+}
+
+static __uint32_t textAt(struct TableBuilder* builder, struct fy_node* root, const char* path, __uint32_t* length) {
+  size_t textLength = 0;
+  const char* text = scalarAt(root, path, &textLength);
+  *length = text == NULL ? 0 : textLength;
+  return text == NULL ? 0 : addText(builder, text, textLength);
+}
+
+static void loadConfig(struct TableBuilder* builder, struct TranslationTable* table, struct fy_node* root) {
+  // anything left out of the config gets the same defaults urcl itself uses
+  struct TranslationConfig* config = &table->config;
+  config->commentsEnabled = flagAt(root, "/config/comments/enabled", 0);
+  config->commentStart = textAt(builder, root, "/config/comments/start", &config->commentStartLength);
+  config->commentEnd = textAt(builder, root, "/config/comments/end", &config->commentEndLength);
+  config->registerCount = numberAt(root, "/config/cpu/registers/count", 8);
+  config->firstRegister = numberAt(root, "/config/cpu/registers/first", 1);
+  config->runRam = flagAt(root, "/config/cpu/run-ram", 0);
+  config->dataBus = numberAt(root, "/config/cpu/data-bus", 8);
+  config->addressBus = numberAt(root, "/config/cpu/address-bus", config->dataBus);
+  config->baseMemoryAddress = textAt(builder, root, "/config/cpu/base-memory-address", &config->baseMemoryAddressLength);
+
+  config->registerOrderCount = 0;
+  builder->registerOrder = NULL;
+  struct fy_node* order = fy_node_by_path(root, "/config/cpu/registers/order", (size_t) -1, FYNWF_DONT_FOLLOW);
+  if (order != NULL && fy_node_get_type(order) == FYNT_SEQUENCE) {
+    size_t capacity = 0;
+    void* iterator = NULL;
+    struct fy_node* item;
+    while ((item = fy_node_sequence_iterate(order, &iterator)) != NULL) {
+      builder->registerOrder = growArray(builder->registerOrder, &capacity, config->registerOrderCount, sizeof(__uint32_t));
+      const char* text = fy_node_get_scalar0(item);
+      builder->registerOrder[config->registerOrderCount] = text == NULL ? 0 : (__uint32_t) strtoul(text, NULL, 0);
+      config->registerOrderCount++;
+    }
+  }
+}
+
+static void loadInstruction(struct TableBuilder* builder, struct TranslationTable* table, const char* name, size_t nameLength, struct fy_node* signatures) {
+  Atom opcode = upperAtom(&atomTable, intern(&atomTable, name, nameLength));
+  if (opcode < ATOM_FIRST_OPCODE || opcode > ATOM_LAST_OPCODE) {
+    printf("Warning: translation file has translations for unknown instruction \"%.*s\", ignoring them.\n", (int) nameLength, name);
+    return;
+  }
+  if (fy_node_get_type(signatures) != FYNT_MAPPING) {
+    fprintf(stderr, "Error in provided translation file, expected operand signatures under \"%.*s\".\n", (int) nameLength, name);
+    exit(-1);
+  }
+
+  void* iterator = NULL;
+  struct fy_node_pair* pair;
+  while ((pair = fy_node_mapping_iterate(signatures, &iterator)) != NULL) {
+    size_t keyLength;
+    const char* key = fy_node_get_scalar(fy_node_pair_key(pair), &keyLength);
+    struct fy_node* templateNode = fy_node_pair_value(pair);
+    __uint8_t signature;
+    if (key == NULL || parseSignature(key, keyLength, &signature) != 0) {
+      fprintf(stderr, "Error in provided translation file, bad operand signature under \"%.*s\".\n", (int) nameLength, name);
+      exit(-1);
+    }
+    if (table->index[opcode][signature] != 0) {
+      printf("Warning: \"%.*s\" has more than one translation for \"%.*s\", using the first one.\n", (int) nameLength, name, (int) keyLength, key);
+      continue;
+    }
+    if (templateNode == NULL || fy_node_get_type(templateNode) != FYNT_SEQUENCE) {
+      fprintf(stderr, "Error in provided translation file, expected a list of lines for \"%.*s\" \"%.*s\".\n", (int) nameLength, name, (int) keyLength, key);
+      exit(-1);
+    }
+
+    builder->translations = growArray(builder->translations, &builder->translationCapacity, table->translationCount, sizeof(struct Translation));
+    struct Translation translation;
+    translation.opcode = opcode;
+    translation.signature = signature;
+    translation.firstLine = table->lineCount;
+    void* lineIterator = NULL;
+    struct fy_node* lineNode;
+    while ((lineNode = fy_node_sequence_iterate(templateNode, &lineIterator)) != NULL) {
+      size_t lineLength;
+      const char* line = fy_node_get_scalar(lineNode, &lineLength);
+      if (line == NULL) {
+        fprintf(stderr, "Error in provided translation file, expected text in the lines for \"%.*s\" \"%.*s\".\n", (int) nameLength, name, (int) keyLength, key);
+        exit(-1);
+      }
+      addTemplateLine(builder, table, line, lineLength);
+    }
+    translation.lineCount = table->lineCount - translation.firstLine;
+    builder->translations[table->translationCount] = translation;
+    table->translationCount++;
+    table->index[opcode][signature] = table->translationCount;
+  }
+}
+
+static int isWordCharacter(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void markTemplateRegisters(const char* text, size_t length, __uint8_t* used, size_t highest) {
+  // flag every register the template text names itself, ex. the r0 and r3 in "add r3,r3,r0"
+  size_t index = 0;
+  while (index < length) {
+    if ((text[index] == 'r' || text[index] == 'R') && (index == 0 || !isWordCharacter(text[index - 1]))) {
+      size_t end = index + 1;
+      __uint64_t number = 0;
+      while (end < length && text[end] >= '0' && text[end] <= '9' && number <= highest) {
+        number = number * 10 + (__uint64_t) (text[end] - '0');
+        end++;
+      }
+      if (end > index + 1 && (end == length || !isWordCharacter(text[end])) && number <= highest) {
+        used[number] = 1;
+      }
+      index = end;
+      continue;
+    }
+    index++;
+  }
+}
+
+static void assignRegisters(struct TableBuilder* builder, struct TranslationTable* table) {
+  // work out which target register each urcl register from R1 up becomes
+  // that's the configured order, or registers counting up from the first one,
+  // minus any the templates use as temporaries since those get overwritten behind the program's back
+  struct TranslationConfig* config = &table->config;
+  if (config->registerOrderCount == 0) {
+    builder->registerOrder = malloc((config->registerCount + 1) * sizeof(__uint32_t));
+    if (builder->registerOrder == NULL) {
+      fprintf(stderr, "Error: out of memory while loading translation file.\n");
+      exit(-1);
+    }
+    while (config->registerOrderCount < config->registerCount) {
+      builder->registerOrder[config->registerOrderCount] = config->firstRegister + config->registerOrderCount;
+      config->registerOrderCount++;
+    }
+  }
+  __uint32_t highest = 0;
+  size_t index = 0;
+  while (index < config->registerOrderCount) {
+    if (builder->registerOrder[index] > highest) {
+      highest = builder->registerOrder[index];
+    }
+    index++;
+  }
+  __uint8_t* used = calloc((size_t) highest + 1, sizeof(__uint8_t));
+  if (used == NULL) {
+    fprintf(stderr, "Error: out of memory while loading translation file.\n");
+    exit(-1);
+  }
+  index = 0;
+  while (index < table->segmentCount) {
+    struct TemplateSegment segment = builder->segments[index];
+    if (segment.type == SEGMENT_TEXT) {
+      markTemplateRegisters(builder->text.data + segment.offset, segment.length, used, highest);
+    }
+    index++;
+  }
+  __uint32_t kept = 0;
+  index = 0;
+  while (index < config->registerOrderCount) {
+    __uint32_t target = builder->registerOrder[index];
+    if (used[target]) {
+      printf("Warning: translation templates use r%u themselves, so programs won't be given it.\n", target);
+    }
+    else {
+      builder->registerOrder[kept] = target;
+      kept++;
+    }
+    index++;
+  }
+  config->registerOrderCount = kept;
+  free(used);
+}
+
+int loadTranslations(char* path, struct TranslationTable* output) {
+  // read a yaml or json translation file into output
+  // the file can either have config and translations sections, or just be a map of translations
+  // returns 0 on success
+  // returns -1 if the file couldn't be read or parsed
+  struct fy_document* document = fy_document_build_from_file(NULL, path);
+  if (document == NULL) {
+    return -1;
+  }
+  struct fy_node* root = fy_document_root(document);
+  if (root == NULL || fy_node_get_type(root) != FYNT_MAPPING) {
+    fy_document_destroy(document);
+    return -1;
+  }
+
+  struct TranslationTable* table = output;
+  memset(table, 0, sizeof(struct TranslationTable));
+  struct TableBuilder builder;
+  memset(&builder, 0, sizeof(struct TableBuilder));
+  builder.text = newStringBuilder(1 << 12);
+  builder.expressionTexts = newInternTable();
+
+  loadConfig(&builder, table, root);
+
+  struct fy_node* translations = fy_node_by_path(root, "/translations", (size_t) -1, FYNWF_DONT_FOLLOW);
+  if (translations == NULL && fy_node_by_path(root, "/config", (size_t) -1, FYNWF_DONT_FOLLOW) == NULL) {
+    translations = root;
+  }
+  if (translations != NULL && fy_node_get_type(translations) == FYNT_MAPPING) {
+    void* iterator = NULL;
+    struct fy_node_pair* pair;
+    while ((pair = fy_node_mapping_iterate(translations, &iterator)) != NULL) {
+      size_t nameLength;
+      const char* name = fy_node_get_scalar(fy_node_pair_key(pair), &nameLength);
+      if (name == NULL) {
+        continue;
+      }
+      loadInstruction(&builder, table, name, nameLength, fy_node_pair_value(pair));
+    }
+  }
+  fy_document_destroy(document);
+  assignRegisters(&builder, table);
+
+  table->textLength = builder.text.length;
+  table->text = builderFinish(&builder.text);
+  table->registerOrder = builder.registerOrder;
+  table->segments = builder.segments;
+  table->lines = builder.lines;
+  table->translations = builder.translations;
+  table->expressions = builder.expressions;
+  table->expressionOps = builder.expressionOps.ops;
+  table->expressionOpCount = builder.expressionOps.count;
+  freeInternTable(&builder.expressionTexts);
+  return 0;
+}
+
+void freeTranslations(struct TranslationTable* table) {
+  if (table->cache.data != NULL) {
+    // everything lives in the cache image, which goes away in one piece
+    unmapFile(&table->cache);
+    table->text = NULL;
+    table->registerOrder = NULL;
+    table->segments = NULL;
+    table->lines = NULL;
+    table->translations = NULL;
+    table->expressions = NULL;
+    table->expressionOps = NULL;
+    return;
+  }
+  free(table->text);
+  free(table->registerOrder);
+  free(table->segments);
+  free(table->lines);
+  free(table->translations);
+  free(table->expressions);
+  free(table->expressionOps);
+  table->text = NULL;
+  table->registerOrder = NULL;
+  table->segments = NULL;
+  table->lines = NULL;
+  table->translations = NULL;
+  table->expressions = NULL;
+  table->expressionOps = NULL;
+}
+
+struct Translation* findTranslation(struct TranslationTable* table, Atom opcode, __uint8_t signature) {
+  // returns NULL if there is no translation for that instruction and signature
+  if (opcode < ATOM_FIRST_OPCODE || opcode > ATOM_LAST_OPCODE || signature >= SIGNATURE_SLOTS) {
+    return NULL;
+  }
+  __uint32_t entry = table->index[opcode][signature];
+  return entry == 0 ? NULL : &table->translations[entry - 1];
+}
+
+// instructions the optimizer always writes in the same form, the target needs a translation for that form
+struct WrittenForm {
+  Atom opcode;
+  __uint8_t operandCount;
+  __uint8_t operands[MAX_OPERANDS];
+};
+
+static const struct WrittenForm writtenForms[] = {
+  {ATOM_ADD, 3, {OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_REGISTER}},
+  {ATOM_RSH, 2, {OPERAND_REGISTER, OPERAND_REGISTER, 0}},
+  {ATOM_NOR, 3, {OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_REGISTER}},
+  {ATOM_NOR, 3, {OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_IMMEDIATE}},
+  {ATOM_IMM, 2, {OPERAND_REGISTER, OPERAND_IMMEDIATE, 0}},
+  {ATOM_MOV, 2, {OPERAND_REGISTER, OPERAND_REGISTER, 0}},
+  {ATOM_LSH, 2, {OPERAND_REGISTER, OPERAND_REGISTER, 0}},
+  {ATOM_AND, 3, {OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_IMMEDIATE}},
+  {ATOM_BSL, 3, {OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_IMMEDIATE}},
+  {ATOM_BSR, 3, {OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_IMMEDIATE}},
+  {ATOM_BSS, 3, {OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_IMMEDIATE}},
+  {ATOM_UMLT, 3, {OPERAND_REGISTER, OPERAND_REGISTER, OPERAND_IMMEDIATE}},
+};
+
+void translationOpcodes(struct TranslationTable* table, __uint8_t* available, __uint64_t* forms) {
+  // flag the instructions the table translates and the operand signatures it has for each,
+  // both lists need ATOM_LAST_OPCODE + 1 entries
+  // any form will do for an instruction to count, except the ones in writtenForms need every form listed
+  memset(available, 0, ATOM_LAST_OPCODE + 1);
+  memset(forms, 0, (ATOM_LAST_OPCODE + 1) * sizeof(__uint64_t));
+  Atom opcode = ATOM_FIRST_OPCODE;
+  while (opcode <= ATOM_LAST_OPCODE) {
+    size_t signature = 0;
+    while (signature < SIGNATURE_SLOTS) {
+      if (table->index[opcode][signature] != 0) {
+        forms[opcode] |= (__uint64_t) 1 << signature;
+      }
+      signature++;
+    }
+    available[opcode] = forms[opcode] != 0;
+    opcode++;
+  }
+  size_t index = 0;
+  while (index < sizeof(writtenForms) / sizeof(writtenForms[0])) {
+    const struct WrittenForm* form = &writtenForms[index];
+    if (findTranslation(table, form->opcode, packSignature(form->operands, form->operandCount)) == NULL) {
+      available[form->opcode] = 0;
+    }
+    index++;
+  }
+}
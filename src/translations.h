@@ -0,0 +1,124 @@
+/*
+ * translations.h: translation files loaded into lookup tables
+ * Copyright (C) 2025-2026, Ada (Tape), <adadispenser@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TRANSLATIONS_H
+#define TRANSLATIONS_H
+
+#include <stddef.h>
+#include <bits/types.h>
+
+#include "lib/intern.h"
+#include "lib/mappedfile.h"
+#include "atoms.h"
+#include "expression.h"
+
+// operand kinds in a translation signature, ex. "r r i"
+#define OPERAND_REGISTER 1
+#define OPERAND_IMMEDIATE 2
+#define OPERAND_OTHER 3    // anything else a translation file writes, never matches an instruction
+
+// signatures are packed two bits per operand, so every signature of up to three operands has its own slot
+#define MAX_OPERANDS 3
+#define SIGNATURE_SLOTS 64
+
+// template segment types
+#define SEGMENT_TEXT 0        // copied to the output as is
+#define SEGMENT_OPERAND 1     // <A>, <B> or <C>, replaced with that operand
+#define SEGMENT_EXPRESSION 2  // anything else in angle brackets, ex. <(B+C)@ha>
+
+// everything below refers to other parts of the table by index rather than by pointer,
+// so a loaded table can be written out and read back in as is
+
+struct TemplateSegment {
+  __uint8_t type;
+  __uint8_t operand;     // operand number for SEGMENT_OPERAND
+  __uint32_t offset;     // into the table's text, without the angle brackets for placeholders
+  __uint32_t length;
+  __uint32_t expression; // expression number for SEGMENT_EXPRESSION
+};
+
+// a compiled placeholder expression, identical placeholders share one
+struct TranslationExpression {
+  __uint32_t firstOp;    // into the table's expression ops
+  __uint32_t opCount;
+  __uint32_t error;      // into the table's text, an errorLength of 0 means the expression compiled
+  __uint32_t errorLength;
+};
+
+struct TemplateLine {
+  __uint32_t firstSegment;
+  __uint32_t segmentCount;
+};
+
+struct Translation {
+  Atom opcode;
+  __uint8_t signature;
+  __uint32_t firstLine;
+  __uint32_t lineCount;
+};
+
+// text settings point into the table's text, a length of 0 means not set
+struct TranslationConfig {
+  __uint8_t commentsEnabled;
+  __uint32_t commentStart;
+  __uint32_t commentStartLength;
+  __uint32_t commentEnd;
+  __uint32_t commentEndLength;
+  __uint32_t registerCount;
+  __uint32_t firstRegister;
+  __uint32_t registerOrderCount;  // registers programs can use, R1 up become the table's registerOrder in turn
+  __uint8_t runRam;
+  __uint32_t dataBus;
+  __uint32_t addressBus;
+  __uint32_t baseMemoryAddress;
+  __uint32_t baseMemoryAddressLength;
+};
+
+struct TranslationTable {
+  struct TranslationConfig config;
+  char* text;
+  size_t textLength;
+  __uint32_t* registerOrder;
+  struct TemplateSegment* segments;
+  size_t segmentCount;
+  struct TemplateLine* lines;
+  size_t lineCount;
+  struct Translation* translations;
+  size_t translationCount;
+  struct TranslationExpression* expressions;
+  size_t expressionCount;
+  struct ExpressionOp* expressionOps;
+  size_t expressionOpCount;
+  // translation index plus one for each opcode and signature, 0 if there is no translation
+  __uint32_t index[ATOM_LAST_OPCODE + 1][SIGNATURE_SLOTS];
+  // set when the arrays above point into a mapped translation cache instead of the heap
+  struct MappedFile cache;
+};
+
+int loadTranslations(char* path, struct TranslationTable* output);
+
+void freeTranslations(struct TranslationTable* table);
+
+struct Translation* findTranslation(struct TranslationTable* table, Atom opcode, __uint8_t signature);
+
+__uint8_t packSignature(const __uint8_t* operands, size_t operandCount);
+
+void signatureString(__uint8_t signature, char* output);
+
+void translationOpcodes(struct TranslationTable* table, __uint8_t* available, __uint64_t* forms);
+
+#endif